@@ -21,8 +21,23 @@ echo "✓ Emscripten found: $(emcc --version | head -n1)"
 
 
 BUILD_DIR="build-web"
-# Check for --clean flag
-if [ "$1" == "--clean" ]; then
+CLEAN=0
+MEASURE=0
+SERVE=0
+WEB_SIMD=ON
+WEB_THREADS=OFF
+for arg in "$@"; do
+    case "$arg" in
+        --clean) CLEAN=1 ;;
+        --measure) MEASURE=1 ;;       # time to first frame in headless Chrome
+        --threads) WEB_THREADS=ON ;;  # tree worker on a pthread
+        --no-simd) WEB_SIMD=OFF ;;
+        --serve) SERVE=1 ;;           # serve bin/ with COOP/COEP headers after building
+        *) echo "Usage: $0 [--clean] [--measure] [--threads] [--no-simd] [--serve]"; exit 1 ;;
+    esac
+done
+
+if [ "$CLEAN" == "1" ]; then
     echo "🧹 Clean build requested..."
     rm -rf "$BUILD_DIR"
     echo "✓ Removed build directory"
@@ -48,13 +63,16 @@ if command -v ccache &> /dev/null; then
     echo "✓ ccache found, using it for faster builds"
 fi
 
-# Configure with Emscripten (only if needed)
-if [ ! -f "$BUILD_DIR/CMakeCache.txt" ]; then
-    echo "⚙️  Configuring with Emscripten..."
+# Configure with Emscripten (only if needed or the options changed)
+WEB_OPTIONS="-DBTREE_WEB_SIMD=$WEB_SIMD -DBTREE_WEB_THREADS=$WEB_THREADS"
+if [ ! -f "$BUILD_DIR/CMakeCache.txt" ] || [ "$(cat "$BUILD_DIR/.web-options" 2>/dev/null)" != "$WEB_OPTIONS" ]; then
+    echo "⚙️  Configuring with Emscripten ($WEB_OPTIONS)..."
     emcmake cmake -S . -B "$BUILD_DIR" \
         -DCMAKE_BUILD_TYPE=Release \
         -DPLATFORM=Web \
+        $WEB_OPTIONS \
         $CMAKE_EXTRA_FLAGS
+    echo "$WEB_OPTIONS" > "$BUILD_DIR/.web-options"
 else
     echo "⚙️  Configuration exists, skipping..."
 fi
@@ -65,11 +83,113 @@ cmake --build "$BUILD_DIR" -j$(nproc)
 
 echo ""
 echo "✅ Build complete!"
+
+# Size report against the previous build in this directory
+SIZE_REPORT="$BUILD_DIR/.size-report"
+echo ""
+echo "📦 Output sizes:"
+NEW_REPORT=""
+TOTAL=0
+PREV_TOTAL=0
+for f in "$BUILD_DIR"/bin/btree-raylib.*; do
+    [ -f "$f" ] || continue
+    name=$(basename "$f")
+    size=$(wc -c < "$f" | tr -d ' ')
+    prev=$(awk -v n="$name" '$1 == n { print $2 }' "$SIZE_REPORT" 2>/dev/null)
+    TOTAL=$((TOTAL + size))
+    if [ -n "$prev" ]; then
+        PREV_TOTAL=$((PREV_TOTAL + prev))
+        printf "   %-22s %10d bytes  (%+d)\n" "$name" "$size" "$((size - prev))"
+    else
+        printf "   %-22s %10d bytes  (new)\n" "$name" "$size"
+    fi
+    NEW_REPORT="$NEW_REPORT$name $size"$'\n'
+done
+if [ "$PREV_TOTAL" -gt 0 ]; then
+    printf "   %-22s %10d bytes  (%+d)\n" "total" "$TOTAL" "$((TOTAL - PREV_TOTAL))"
+else
+    printf "   %-22s %10d bytes\n" "total" "$TOTAL"
+fi
+
+# Serves the build with the cross-origin isolation headers that
+# SharedArrayBuffer (and so the threaded build) requires
+serve() {
+    python3 -c '
+import http.server, sys
+class Handler(http.server.SimpleHTTPRequestHandler):
+    def end_headers(self):
+        self.send_header("Cross-Origin-Opener-Policy", "same-origin")
+        self.send_header("Cross-Origin-Embedder-Policy", "require-corp")
+        super().end_headers()
+    def log_message(self, *args):
+        pass
+http.server.ThreadingHTTPServer(("127.0.0.1", int(sys.argv[1])), Handler).serve_forever()
+' "$1"
+}
+
+# Startup time: the app prints "startup-ms <t>" on its first frame, where t
+# is measured from navigation start
+if [ "$MEASURE" == "1" ]; then
+    CHROME=""
+    for c in google-chrome chromium chromium-browser; do
+        if command -v "$c" &> /dev/null; then CHROME="$c"; break; fi
+    done
+    if [ -z "$CHROME" ]; then
+        echo "⚠️  --measure needs Chrome or Chromium on PATH, skipping startup timing"
+    else
+        PORT=8765
+        LOG=$(mktemp)
+        (cd "$BUILD_DIR/bin" && serve $PORT) &
+        SERVER_PID=$!
+        sleep 1
+        "$CHROME" --headless=new --no-sandbox --use-angle=swiftshader --enable-logging=stderr --v=0 \
+            --user-data-dir="$(mktemp -d)" "http://127.0.0.1:$PORT/btree-raylib.html" 2> "$LOG" &
+        CHROME_PID=$!
+        STARTUP=""
+        for _ in $(seq 1 40); do
+            STARTUP=$(grep -o 'startup-ms [0-9.]*' "$LOG" | head -n1 | cut -d' ' -f2)
+            [ -n "$STARTUP" ] && break
+            sleep 0.5
+        done
+        kill $CHROME_PID $SERVER_PID 2> /dev/null || true
+        rm -f "$LOG"
+
+        if [ -z "$STARTUP" ]; then
+            echo "⚠️  No startup-ms line within 20s"
+        else
+            PREV_STARTUP=$(awk '$1 == "startup-ms" { print $2 }' "$SIZE_REPORT" 2>/dev/null)
+            if [ -n "$PREV_STARTUP" ]; then
+                echo "⏱️  Startup to first frame: ${STARTUP} ms ($(awk -v a="$STARTUP" -v b="$PREV_STARTUP" 'BEGIN { printf "%+.1f", a - b }') ms)"
+            else
+                echo "⏱️  Startup to first frame: ${STARTUP} ms"
+            fi
+            NEW_REPORT="${NEW_REPORT}startup-ms $STARTUP"$'\n'
+        fi
+    fi
+fi
+# Keep the last startup time if this run did not measure one
+if [ "$MEASURE" != "1" ]; then
+    OLD_STARTUP=$(grep '^startup-ms ' "$SIZE_REPORT" 2>/dev/null || true)
+    [ -n "$OLD_STARTUP" ] && NEW_REPORT="$NEW_REPORT$OLD_STARTUP"$'\n'
+fi
+printf "%s" "$NEW_REPORT" > "$SIZE_REPORT"
+
 echo ""
 echo "📂 Output files in: $BUILD_DIR/bin/"
 echo ""
 echo "🚀 To test locally, run:"
-echo "   cd $BUILD_DIR/bin"
-echo "   python3 -m http.server 8000"
+if [ "$WEB_THREADS" == "ON" ]; then
+    # Threaded builds need COOP/COEP headers, which plain http.server lacks
+    echo "   ./build-web.sh --threads --serve"
+else
+    echo "   cd $BUILD_DIR/bin"
+    echo "   python3 -m http.server 8000"
+fi
 echo ""
 echo "   Then open: http://localhost:8000"
+
+if [ "$SERVE" == "1" ]; then
+    echo ""
+    echo "🌍 Serving $BUILD_DIR/bin on http://localhost:8000 (Ctrl+C to stop)"
+    cd "$BUILD_DIR/bin" && serve 8000
+fi
@@ -1,14 +1,21 @@
 # Script to embed a binary file as a C array
+#
+# -DINPUT_FILE=<file> -DOUTPUT_FILE=<header> -DVARIABLE_NAME=<name>
+# The include guard is derived from the header's file name.
 
 file(READ ${INPUT_FILE} file_contents HEX)
 
 # Convert hex to array of bytes
 string(REGEX MATCHALL "([0-9a-f][0-9a-f])" bytes ${file_contents})
 
+get_filename_component(guard ${OUTPUT_FILE} NAME)
+string(TOUPPER ${guard} guard)
+string(MAKE_C_IDENTIFIER ${guard} guard)
+
 # Create the header file
 set(output_content "// Auto-generated file - do not edit\n")
-string(APPEND output_content "#ifndef EMBEDDED_FONT_H\n")
-string(APPEND output_content "#define EMBEDDED_FONT_H\n\n")
+string(APPEND output_content "#ifndef ${guard}\n")
+string(APPEND output_content "#define ${guard}\n\n")
 string(APPEND output_content "static const unsigned char ${VARIABLE_NAME}[] = {\n")
 
 # Write bytes in rows of 16
@@ -35,6 +42,6 @@ endforeach()
 
 string(APPEND output_content "\n};\n\n")
 string(APPEND output_content "static const unsigned int ${VARIABLE_NAME}_size = ${byte_count};\n\n")
-string(APPEND output_content "#endif // EMBEDDED_FONT_H\n")
+string(APPEND output_content "#endif // ${guard}\n")
 
 file(WRITE ${OUTPUT_FILE} "${output_content}")
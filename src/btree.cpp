@@ -1,19 +1,31 @@
 #include "btree.hpp"
+#include "frozen_btree.hpp"
+#include "simd_search.hpp"
+#include "thread_pool.hpp"
 #include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <climits>
 #include <cmath>
 #include <unordered_map>
 
+thread_local std::vector<BTree::NodeAccess>* BTree::accessLog = nullptr;
+
 BTree::Node::Node(int _t, bool _leaf) : leaf(_leaf), t(_t) {}
 
 BTree::Node::~Node() {
     for (auto c : children) delete c;
 }
 
+void BTree::Node::sumSubtree() {
+    agg = Aggregate();
+    for (size_t i = 0; i < keyCount(); ++i) agg.add(keyAt(i), countAt(i));
+    for (const Node* child : children) agg += child->agg;
+}
+
 void BTree::Node::traverse(const std::function<void(Node*, int, int)>& cb, int depth) {
     int i;
-    for (i = 0; i < (int)keys.size(); ++i) {
+    for (i = 0; i < (int)keyCount(); ++i) {
         if (!leaf && i < (int)children.size()) children[i]->traverse(cb, depth + 1);
         cb(this, depth, i);
     }
@@ -21,107 +33,1467 @@ void BTree::Node::traverse(const std::function<void(Node*, int, int)>& cb, int d
 }
 
 BTree::Node* BTree::Node::search(int k) {
-    int i = 0;
-    while (i < (int)keys.size() && k > keys[i]) i++;
-    if (i < (int)keys.size() && keys[i] == k) return this;
+    int i = (int)lowerBound(k);
+    if (accessLog) {
+        // The scan reads four keys at a time up to the first one >= k. A
+        // packed leaf decodes each group of four from two rows of four
+        // words, and reads nothing when k is at or below its base.
+        touch(NodePart::Header, 0, sizeof(Node));
+        size_t bytes;
+        if (packed) {
+            size_t groups = (packedSize + 3) / 4;
+            size_t last = std::min((size_t)i / 4, groups - 1);
+            bytes = groups == 0 || k <= packedBase
+                        ? 0 : std::min(packedWords(), (last * packedWidth / 32) * 4 + 8) * sizeof(uint32_t);
+        } else {
+            bytes = std::min(keys.size(), (size_t)(i / 4 + 1) * 4) * sizeof(int);
+        }
+        touch(NodePart::Keys, 0, bytes);
+    }
+    if (i < (int)keyCount() && keyAt(i) == k) return this;
     if (leaf) return nullptr;
+    touch(NodePart::Children, i * sizeof(Node*), sizeof(Node*));
     return children[i]->search(k);
 }
 
-void BTree::Node::insertNonFull(int k) {
+void BTree::Node::logAccess(NodePart part, size_t offset, size_t bytes) const {
+    if (bytes == 0) return;
+    const void* base = this;
+    switch (part) {
+    case NodePart::Header: break;
+    case NodePart::Keys: base = packed ? (const void*)packedKeys.get() : keys.data(); break;
+    case NodePart::Values: base = values.data(); break;
+    case NodePart::Counts: base = counts.data(); break;
+    case NodePart::Children: base = children.data(); break;
+    }
+    accessLog->push_back(NodeAccess{this, (uintptr_t)base + offset, (uint32_t)offset, (uint32_t)bytes, part});
+}
+
+size_t BTree::Node::memoryBytes() const {
+    return sizeof(Node) + keys.capacity() * sizeof(int) + values.capacity() * sizeof(Value) +
+           counts.capacity() * sizeof(uint32_t) + children.capacity() * sizeof(Node*) +
+           (packed ? packedWords() * sizeof(uint32_t) : 0);
+}
+
+size_t BTree::Node::lowerBound(int k) const {
+    return packed ? packedLowerBound(k) : simdLowerBound(keys.data(), keys.size(), k);
+}
+
+// Each lane holds the offsets of every fourth slot back to back. One row
+// past the last group's first word lets the decoder always read a pair.
+size_t BTree::Node::packedWords() const {
+    size_t groups = (packedSize + 3) / 4;
+    return (groups == 0 ? 0 : ((groups - 1) * packedWidth / 32 + 2)) * 4;
+}
+
+void BTree::Node::pack() {
+    if (packed || !leaf || keys.empty()) return;
+    uint32_t span = (uint32_t)keys.back() - (uint32_t)keys.front();
+    packedWidth = 0;
+    while (packedWidth < 32 && (span >> packedWidth) != 0) ++packedWidth;
+    packedSize = (uint16_t)keys.size();
+    packedBase = keys.front();
+    packedKeys.reset(new uint32_t[packedWords()]());
+    // Slots past the end hold the widest offset, so the slots stay sorted
+    uint64_t widest = ((uint64_t)1 << packedWidth) - 1;
+    for (size_t i = 0; i < (keys.size() + 3) / 4 * 4; ++i) {
+        uint64_t offset = i < keys.size() ? (uint32_t)keys[i] - (uint32_t)packedBase : widest;
+        size_t bit = (i / 4) * packedWidth, word = (bit / 32) * 4 + i % 4;
+        packedKeys[word] |= (uint32_t)(offset << (bit % 32));
+        packedKeys[word + 4] |= (uint32_t)((offset << (bit % 32)) >> 32);
+    }
+    std::vector<int>().swap(keys);
+    if (std::all_of(values.begin(), values.end(), [](Value v) { return v == 0; })) std::vector<Value>().swap(values);
+    else values.shrink_to_fit();
+    if (std::all_of(counts.begin(), counts.end(), [](uint32_t c) { return c == 1; })) std::vector<uint32_t>().swap(counts);
+    else counts.shrink_to_fit();
+    packed = true;
+}
+
+void BTree::Node::unpack() {
+    if (!packed) return;
+    size_t n = packedSize;
+    // Room for a full node, as an unpacked leaf is about to change
+    keys.reserve(2 * t - 1);
+    for (size_t i = 0; i < n; ++i) keys.push_back(packedKey(i));
+    if (values.empty()) values.assign(n, 0);
+    if (counts.empty()) counts.assign(n, 1);
+    packedKeys.reset();
+    packed = false;
+    packedSize = 0;
+}
+
+int BTree::Node::packedKey(size_t i) const {
+    size_t bit = (i / 4) * packedWidth, word = (bit / 32) * 4 + i % 4;
+    uint64_t pair = packedKeys[word] | ((uint64_t)packedKeys[word + 4] << 32);
+    uint64_t mask = ((uint64_t)1 << packedWidth) - 1;
+    return (int)((uint32_t)packedBase + (uint32_t)((pair >> (bit % 32)) & mask));
+}
+
+size_t BTree::Node::packedLowerBound(int k) const {
+    if (k <= packedBase) return 0;
+    // Offsets and the target compare unsigned. Slots past the end hold the
+    // widest offset but can still be below the target, hence the cap.
+    uint32_t target = (uint32_t)k - (uint32_t)packedBase;
+    size_t groups = (packedSize + 3) / 4;
+    size_t below = 0;
+#if defined(SIMD_SEARCH_SSE2)
+    const __m128i bias = _mm_set1_epi32(INT_MIN);
+    const __m128i needle = _mm_xor_si128(_mm_set1_epi32((int)target), bias);
+    const __m128i mask = _mm_set1_epi32((int)(uint32_t)(((uint64_t)1 << packedWidth) - 1));
+    for (size_t g = 0; g < groups; ++g) {
+        size_t bit = g * packedWidth, shift = bit % 32;
+        const __m128i* row = reinterpret_cast<const __m128i*>(packedKeys.get() + (bit / 32) * 4);
+        // Shifts of 32 clear every lane, so a slot that fits one word needs no branch
+        __m128i v = _mm_or_si128(_mm_srl_epi32(_mm_loadu_si128(row), _mm_cvtsi32_si128((int)shift)),
+                                 _mm_sll_epi32(_mm_loadu_si128(row + 1), _mm_cvtsi32_si128((int)(32 - shift))));
+        v = _mm_xor_si128(_mm_and_si128(v, mask), bias);
+        int lanes = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, needle)));
+        below += (size_t)((lanes & 1) + ((lanes >> 1) & 1) + ((lanes >> 2) & 1) + ((lanes >> 3) & 1));
+        if (lanes != 0xF) break;
+    }
+#else
+    for (size_t i = 0; i < groups * 4; ++i) {
+        if ((uint32_t)packedKey(i) - (uint32_t)packedBase >= target) break;
+        ++below;
+    }
+#endif
+    return std::min(below, (size_t)packedSize);
+}
+
+namespace {
+
+// Keeps Stats::nodeBytes right across changes to one node, whose arrays may
+// reallocate. Unsigned wrap-around in between cancels out.
+struct NodeBytesScope {
+    BTree::Stats& stats;
+    const BTree::Node* node;
+    NodeBytesScope(BTree::Stats& s, const BTree::Node* n) : stats(s), node(n) { stats.nodeBytes -= node->memoryBytes(); }
+    ~NodeBytesScope() { stats.nodeBytes += node->memoryBytes(); }
+};
+
+// Stats of two trees that become one, or of a part that leaves a tree
+void addStats(BTree::Stats& into, const BTree::Stats& part) {
+    into.keys += part.keys;
+    into.occurrences += part.occurrences;
+    into.nodes += part.nodes;
+    into.leaves += part.leaves;
+    into.nodeBytes += part.nodeBytes;
+    if (into.levelNodes.size() < part.levelNodes.size()) into.levelNodes.resize(part.levelNodes.size(), 0);
+    for (size_t level = 0; level < part.levelNodes.size(); ++level) into.levelNodes[level] += part.levelNodes[level];
+}
+
+void removeStats(BTree::Stats& from, const BTree::Stats& part) {
+    from.keys -= part.keys;
+    from.occurrences -= part.occurrences;
+    from.nodes -= part.nodes;
+    from.leaves -= part.leaves;
+    from.nodeBytes -= part.nodeBytes;
+    for (size_t level = 0; level < part.levelNodes.size(); ++level) from.levelNodes[level] -= part.levelNodes[level];
+    while (!from.levelNodes.empty() && from.levelNodes.back() == 0) from.levelNodes.pop_back();
+}
+
+} // namespace
+
+void BTree::Node::insertNonFull(int k, Value v, uint32_t count, Stats& stats, int level) {
+    // k ends up somewhere below, whatever splits on the way
+    if (augmented) agg.add(k, count);
     int i = (int)keys.size() - 1;
     if (leaf) {
+        NodeBytesScope bytes(stats, this);
         keys.push_back(0);
+        values.push_back(0);
+        counts.push_back(0);
         while (i >= 0 && keys[i] > k) {
             keys[i + 1] = keys[i];
+            values[i + 1] = values[i];
+            counts[i + 1] = counts[i];
             --i;
         }
         keys[i + 1] = k;
+        values[i + 1] = v;
+        counts[i + 1] = count;
+        ++stats.keys;
+        stats.occurrences += count;
+        if (accessLog) {
+            // Every slot from the new key's on is read and written
+            size_t from = i + 1, moved = keys.size() - from;
+            touch(NodePart::Header, 0, sizeof(Node));
+            touch(NodePart::Keys, from * sizeof(int), moved * sizeof(int));
+            touch(NodePart::Values, from * sizeof(Value), moved * sizeof(Value));
+            touch(NodePart::Counts, from * sizeof(uint32_t), moved * sizeof(uint32_t));
+        }
     } else {
         while (i >= 0 && keys[i] > k) --i;
         ++i;
+        if (accessLog) {
+            // The scan from the right stops at the first key <= k
+            size_t from = i > 0 ? i - 1 : 0;
+            touch(NodePart::Header, 0, sizeof(Node));
+            touch(NodePart::Keys, from * sizeof(int), (keys.size() - from) * sizeof(int));
+            touch(NodePart::Children, i * sizeof(Node*), sizeof(Node*));
+        }
         if ((int)children[i]->keys.size() == 2 * t - 1) {
-            splitChild(i, children[i]);
+            splitChild(i, children[i], stats, level - 1);
             if (keys[i] < k) ++i;
         }
-        children[i]->insertNonFull(k);
+        children[i]->insertNonFull(k, v, count, stats, level - 1);
     }
 }
 
-void BTree::Node::splitChild(int idx, Node* y) {
+void BTree::Node::splitChild(int idx, Node* y, Stats& stats, int childLevel) {
     
     Node* z = new Node(y->t, y->leaf);
+    z->augmented = y->augmented;
+    {
+        NodeBytesScope yBytes(stats, y), ownBytes(stats, this);
     
-    int midKey = y->keys[t - 1];
+        int midKey = y->keys[t - 1];
+        Value midValue = y->values[t - 1];
+        uint32_t midCount = y->counts[t - 1];
     
-    z->keys.assign(y->keys.begin() + t, y->keys.end());
+        z->keys.assign(y->keys.begin() + t, y->keys.end());
+        z->values.assign(y->values.begin() + t, y->values.end());
+        z->counts.assign(y->counts.begin() + t, y->counts.end());
     
-    if (!y->leaf) {
-        z->children.assign(y->children.begin() + t, y->children.end());
-    }
+        if (!y->leaf) {
+            z->children.assign(y->children.begin() + t, y->children.end());
+        }
     
-    y->keys.resize(t - 1);
-    if (!y->leaf) y->children.resize(t);
+        y->keys.resize(t - 1);
+        y->values.resize(t - 1);
+        y->counts.resize(t - 1);
+        if (!y->leaf) y->children.resize(t);
 
     
-    children.insert(children.begin() + idx + 1, z);
+        children.insert(children.begin() + idx + 1, z);
     
-    keys.insert(keys.begin() + idx, midKey);
+        keys.insert(keys.begin() + idx, midKey);
+        values.insert(values.begin() + idx, midValue);
+        counts.insert(counts.begin() + idx, midCount);
+    }
+
+    if (accessLog) {
+        // y's upper half moves to z, its middle key up here where every
+        // slot from idx on shifts right
+        y->touch(NodePart::Header, 0, sizeof(Node));
+        y->touch(NodePart::Keys, (t - 1) * sizeof(int), t * sizeof(int));
+        y->touch(NodePart::Values, (t - 1) * sizeof(Value), t * sizeof(Value));
+        y->touch(NodePart::Counts, (t - 1) * sizeof(uint32_t), t * sizeof(uint32_t));
+        z->touch(NodePart::Header, 0, sizeof(Node));
+        z->touch(NodePart::Keys, 0, (t - 1) * sizeof(int));
+        z->touch(NodePart::Values, 0, (t - 1) * sizeof(Value));
+        z->touch(NodePart::Counts, 0, (t - 1) * sizeof(uint32_t));
+        if (!y->leaf) {
+            y->touch(NodePart::Children, t * sizeof(Node*), t * sizeof(Node*));
+            z->touch(NodePart::Children, 0, t * sizeof(Node*));
+        }
+        size_t moved = keys.size() - idx;
+        touch(NodePart::Header, 0, sizeof(Node));
+        touch(NodePart::Keys, idx * sizeof(int), moved * sizeof(int));
+        touch(NodePart::Values, idx * sizeof(Value), moved * sizeof(Value));
+        touch(NodePart::Counts, idx * sizeof(uint32_t), moved * sizeof(uint32_t));
+        touch(NodePart::Children, (idx + 1) * sizeof(Node*), moved * sizeof(Node*));
+    }
+
+    stats.nodeBytes += z->memoryBytes();
+    ++stats.nodes;
+    if (z->leaf) ++stats.leaves;
+    ++stats.levelNodes[childLevel];
+
+    // This node's total is unchanged; its two halves are not
+    if (y->augmented) {
+        y->sumSubtree();
+        z->sumSubtree();
+    }
 }
 
 
-BTree::BTree(int _t) : root(nullptr), t(_t) {}
+BTree::BTree(int _t, bool _multiset) : root(nullptr), t(_t), multiset(_multiset) {}
 
 BTree::~BTree() { clear(); }
 
-void BTree::insert(int k) {
+bool BTree::insert(int k) {
+    return insert(k, 0);
+}
+
+bool BTree::insert(int k, Value v) {
+    if (addOccurrence(k)) return false;
+    insertEntry(k, v, 1);
+    settle(k);
+    return true;
+}
+
+bool BTree::addOccurrence(int k) {
+    EqualRange run = equal_range(k);
+    if (!run.node) return false;
+    if (multiset) {
+        thaw(run.node);
+        ++run.node->counts[run.index];
+        ++stats.occurrences;
+        ++version;
+        if (aggregates) adjustPathCount(k, 1);
+        settle(k);
+    }
+    return true;
+}
+
+bool BTree::upsert(int k, Value v) {
+    if (Value* slot = find(k)) {
+        *slot = v;
+        ++version;
+        settle(k);
+        return false;
+    }
+    insertEntry(k, v, 1);
+    settle(k);
+    return true;
+}
+
+void BTree::insertEntry(int k, Value v, uint32_t count) {
+    ++version;
     if (!root) {
         root = new Node(t, true);
+        root->augmented = aggregates;
         root->keys.push_back(k);
+        root->values.push_back(v);
+        root->counts.push_back(count);
+        if (aggregates) root->sumSubtree();
+        stats = Stats();
+        stats.keys = 1;
+        stats.occurrences = count;
+        stats.nodes = stats.leaves = 1;
+        stats.nodeBytes = root->memoryBytes();
+        stats.levelNodes.push_back(1);
         all_keys.push_back(k);
         return;
     }
+    if (packedLeaves > 0) {
+        // Splits on the way down leave the leaf k falls into as it is
+        Node* x = root;
+        while (!x->leaf) x = x->children[x->lowerBound(k)];
+        thaw(x);
+    }
     if (root->keys.size() == (size_t)(2 * t - 1)) {
         Node* s = new Node(t, false);
         s->children.push_back(root);
-        s->splitChild(0, root);
+        growRoot(s);
+        s->splitChild(0, root, stats, stats.height() - 2);
         int i = 0;
         if (s->keys[0] < k) i++;
-        s->children[i]->insertNonFull(k);
+        if (bStar) insertBStar(s->children[i], k, v, count, stats.height() - 2);
+        else s->children[i]->insertNonFull(k, v, count, stats, stats.height() - 2);
+        if (aggregates) s->sumSubtree();
         root = s;
+    } else if (bStar) {
+        insertBStar(root, k, v, count, stats.height() - 1);
     } else {
-        root->insertNonFull(k);
+        root->insertNonFull(k, v, count, stats, stats.height() - 1);
     }
     all_keys.push_back(k);
 }
 
+void BTree::growRoot(Node* newRoot) {
+    newRoot->augmented = aggregates;
+    stats.nodeBytes += newRoot->memoryBytes();
+    ++stats.nodes;
+    stats.levelNodes.push_back(1);
+}
+
+BTree::Value* BTree::find(int k) {
+    EqualRange run = equal_range(k);
+    if (!run.node) return nullptr;
+    thaw(run.node);
+    return &run.node->values[run.index];
+}
+
+const BTree::Value* BTree::find(int k) const {
+    static const Value zero = 0;
+    EqualRange run = equal_range(k);
+    if (!run.node) return nullptr;
+    return run.node->values.empty() ? &zero : &run.node->values[run.index];
+}
+
 bool BTree::contains(int k) const {
     if (!root) return false;
+    sampleHeat(k);
     return root->search(k) != nullptr;
 }
 
+namespace {
+
+inline void prefetchLine(const void* p) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p, 0, 3);
+#elif defined(SIMD_SEARCH_SSE2)
+    _mm_prefetch((const char*)p, _MM_HINT_T0);
+#else
+    (void)p;
+#endif
+}
+
+void prefetchBytes(const void* p, size_t bytes) {
+    const char* c = (const char*)p;
+    for (size_t offset = 0; offset < bytes; offset += 64) prefetchLine(c + offset);
+}
+
+} // namespace
+
+// AMAC-style interleaving: every in-flight lookup is a small state machine
+// that gets one step per round. A node's keys and children live in their
+// own arrays, reachable only through the node object, so each level takes
+// two steps: the first finds the (prefetched) node and prefetches its
+// arrays, the second searches them and prefetches the next node.
+template <typename Done>
+void BTree::searchBatch(const int* keys, size_t n, Done&& done) const {
+    if (!root) {
+        for (size_t i = 0; i < n; ++i) done(i, nullptr, -1);
+        return;
+    }
+    struct Lookup {
+        const Node* node;
+        size_t key;
+        bool arraysFetched;
+    };
+    Lookup slots[BatchWidth];
+    int active = 0;
+    size_t next = 0;
+    auto begin = [&](Lookup& l) {
+        sampleHeat(keys[next]);
+        l = Lookup{root, next++, false};
+        prefetchLine(root);
+    };
+    while (active < BatchWidth && next < n) begin(slots[active++]);
+
+    while (active > 0) {
+        for (int s = 0; s < active;) {
+            Lookup& l = slots[s];
+            const Node* node = l.node;
+            if (!l.arraysFetched) {
+                if (node->packed) prefetchBytes(node->packedKeys.get(), node->packedWords() * sizeof(uint32_t));
+                else prefetchBytes(node->keys.data(), node->keys.size() * sizeof(int));
+                if (!node->leaf) prefetchBytes(node->children.data(), node->children.size() * sizeof(Node*));
+                l.arraysFetched = true;
+                ++s;
+                continue;
+            }
+            int k = keys[l.key];
+            int i = (int)node->lowerBound(k);
+            if (accessLog) {
+                node->touch(NodePart::Header, 0, sizeof(Node));
+                node->touch(NodePart::Keys, 0, std::min(node->keys.size(), (size_t)(i / 4 + 1) * 4) * sizeof(int));
+            }
+            if (i < (int)node->keyCount() && node->keyAt(i) == k) {
+                done(l.key, node, i);
+            } else if (node->leaf) {
+                done(l.key, nullptr, -1);
+            } else {
+                node->touch(NodePart::Children, i * sizeof(Node*), sizeof(Node*));
+                l.node = node->children[i];
+                l.arraysFetched = false;
+                prefetchLine(l.node);
+                ++s;
+                continue;
+            }
+            // Finished: start the next key here, or close the gap
+            if (next < n) {
+                begin(l);
+                ++s;
+            } else {
+                l = slots[--active];
+            }
+        }
+    }
+}
+
+void BTree::containsBatch(const int* keys, size_t n, std::vector<bool>& found) const {
+    found.assign(n, false);
+    searchBatch(keys, n, [&](size_t i, const Node* node, int) { if (node) found[i] = true; });
+}
+
+void BTree::findBatch(const int* keys, size_t n, std::vector<Value*>& values) {
+    unpackAll();
+    values.assign(n, nullptr);
+    searchBatch(keys, n, [&](size_t i, const Node* node, int index) {
+        if (node) values[i] = &const_cast<Node*>(node)->values[index];
+    });
+}
+
+void BTree::findBatch(const int* keys, size_t n, std::vector<const Value*>& values) const {
+    values.assign(n, nullptr);
+    // Packed leaves without values hold only zeros
+    static const Value zero = 0;
+    searchBatch(keys, n, [&](size_t i, const Node* node, int index) {
+        if (node) values[i] = node->values.empty() ? &zero : &node->values[index];
+    });
+}
+
+FrozenBTree BTree::freeze() const {
+    return FrozenBTree(*this);
+}
+
+uint32_t BTree::count(int k) const {
+    return equal_range(k).count;
+}
+
+BTree::EqualRange BTree::equal_range(int k) const {
+    EqualRange run;
+    if (root) sampleHeat(k);
+    Node* node = root ? root->search(k) : nullptr;
+    if (!node) return run;
+    run.node = node;
+    run.index = (int)node->lowerBound(k);
+    run.count = node->countAt(run.index);
+    return run;
+}
+
 void BTree::erase(int k) {
-    
-    
+    EqualRange run = equal_range(k);
+    if (!run.node) return;
+    ++version;
+
+    // Dropping one of several occurrences leaves the structure alone
+    if (run.count > 1) {
+        thaw(run.node);
+        --run.node->counts[run.index];
+        --stats.occurrences;
+        if (aggregates) adjustPathCount(k, -1);
+        settle(k);
+        return;
+    }
+
+    eraseFrom(root, k, stats.height() - 1);
+    --stats.keys;
+    stats.occurrences -= run.count;
+
+    // A root emptied by a merge hands over to its only child
+    if (root->keys.empty()) {
+        Node* oldRoot = root;
+        root = root->leaf ? nullptr : root->children[0];
+        oldRoot->children.clear();
+        stats.nodeBytes -= oldRoot->memoryBytes();
+        --stats.nodes;
+        if (oldRoot->leaf) --stats.leaves;
+        stats.levelNodes.pop_back();
+        forget(oldRoot);
+        delete oldRoot;
+    }
+
     auto it = std::find(all_keys.begin(), all_keys.end(), k);
-    if (it == all_keys.end()) return;
-    
-    std::vector<int> remaining;
-    remaining.reserve(all_keys.size() - 1);
-    bool skipped = false;
-    for (size_t i = 0; i < all_keys.size(); ++i) {
-        if (!skipped && all_keys[i] == k) { skipped = true; continue; }
-        remaining.push_back(all_keys[i]);
+    if (it != all_keys.end()) all_keys.erase(it);
+    settle(k);
+}
+
+void BTree::eraseFrom(Node* x, int k, int level) {
+    thaw(x);
+    int i = (int)simdLowerBound(x->keys.data(), x->keys.size(), k);
+    bool here = i < (int)x->keys.size() && x->keys[i] == k;
+    // Leaves this step may read or change: the child k is in or goes
+    // through, and its neighbours to borrow from or merge with
+    if (level == 1 && packedLeaves > 0) {
+        for (int c = std::max(i - 1, 0); c <= std::min(i + 1, (int)x->keys.size()); ++c) thaw(x->children[c]);
     }
-    
-    clear();
-    all_keys.clear();
-    for (int key : remaining) insert(key);
+
+    if (here && x->leaf) {
+        removeSlot(x, i);
+        if (x->augmented) x->sumSubtree();
+        return;
+    }
+    if (here) {
+        Node* y = x->children[i];
+        Node* z = x->children[i + 1];
+        if ((int)y->keys.size() >= t) {
+            // Replace k by its predecessor, then delete that from y
+            Node* p = y;
+            while (!p->leaf) p = p->children.back();
+            thaw(p);
+            x->keys[i] = p->keys.back();
+            x->values[i] = p->values.back();
+            x->counts[i] = p->counts.back();
+            eraseFrom(y, x->keys[i], level - 1);
+        } else if ((int)z->keys.size() >= t) {
+            Node* s = z;
+            while (!s->leaf) s = s->children.front();
+            thaw(s);
+            x->keys[i] = s->keys.front();
+            x->values[i] = s->values.front();
+            x->counts[i] = s->counts.front();
+            eraseFrom(z, x->keys[i], level - 1);
+        } else {
+            // Both neighbours minimal: fold k and z into y and go on there
+            mergeChildren(x, i, level - 1);
+            eraseFrom(y, k, level - 1);
+        }
+        if (x->augmented) x->sumSubtree();
+        return;
+    }
+    if (x->leaf) return;
+
+    // Top the child up to t keys before descending, so a removal below
+    // never leaves it short
+    if ((int)x->children[i]->keys.size() < t) {
+        if (i > 0 && (int)x->children[i - 1]->keys.size() >= t) {
+            borrowFromLeft(x, i);
+        } else if (i < (int)x->keys.size() && (int)x->children[i + 1]->keys.size() >= t) {
+            borrowFromRight(x, i);
+        } else {
+            if (i == (int)x->keys.size()) --i;
+            mergeChildren(x, i, level - 1);
+        }
+    }
+    eraseFrom(x->children[i], k, level - 1);
+    if (x->augmented) x->sumSubtree();
+}
+
+void BTree::removeSlot(Node* x, int i) {
+    NodeBytesScope bytes(stats, x);
+    x->keys.erase(x->keys.begin() + i);
+    x->values.erase(x->values.begin() + i);
+    x->counts.erase(x->counts.begin() + i);
+}
+
+void BTree::mergeChildren(Node* x, int i, int childLevel) {
+    Node* y = x->children[i];
+    Node* z = x->children[i + 1];
+    {
+        NodeBytesScope xBytes(stats, x), yBytes(stats, y);
+        y->keys.push_back(x->keys[i]);
+        y->values.push_back(x->values[i]);
+        y->counts.push_back(x->counts[i]);
+        y->keys.insert(y->keys.end(), z->keys.begin(), z->keys.end());
+        y->values.insert(y->values.end(), z->values.begin(), z->values.end());
+        y->counts.insert(y->counts.end(), z->counts.begin(), z->counts.end());
+        y->children.insert(y->children.end(), z->children.begin(), z->children.end());
+        x->keys.erase(x->keys.begin() + i);
+        x->values.erase(x->values.begin() + i);
+        x->counts.erase(x->counts.begin() + i);
+        x->children.erase(x->children.begin() + i + 1);
+    }
+    z->children.clear();
+    stats.nodeBytes -= z->memoryBytes();
+    --stats.nodes;
+    if (z->leaf) --stats.leaves;
+    --stats.levelNodes[childLevel];
+    forget(z);
+    delete z;
+    // x's total is unchanged; refreshing it is up to the caller
+    if (y->augmented) y->sumSubtree();
+}
+
+void BTree::borrowFromLeft(Node* x, int i) {
+    Node* c = x->children[i];
+    Node* s = x->children[i - 1];
+    NodeBytesScope xBytes(stats, x), cBytes(stats, c), sBytes(stats, s);
+    // Separator moves down into c, s's last key moves up in its place
+    c->keys.insert(c->keys.begin(), x->keys[i - 1]);
+    c->values.insert(c->values.begin(), x->values[i - 1]);
+    c->counts.insert(c->counts.begin(), x->counts[i - 1]);
+    x->keys[i - 1] = s->keys.back();
+    x->values[i - 1] = s->values.back();
+    x->counts[i - 1] = s->counts.back();
+    s->keys.pop_back();
+    s->values.pop_back();
+    s->counts.pop_back();
+    if (!c->leaf) {
+        c->children.insert(c->children.begin(), s->children.back());
+        s->children.pop_back();
+    }
+    if (c->augmented) {
+        c->sumSubtree();
+        s->sumSubtree();
+    }
+}
+
+void BTree::borrowFromRight(Node* x, int i) {
+    Node* c = x->children[i];
+    Node* s = x->children[i + 1];
+    NodeBytesScope xBytes(stats, x), cBytes(stats, c), sBytes(stats, s);
+    c->keys.push_back(x->keys[i]);
+    c->values.push_back(x->values[i]);
+    c->counts.push_back(x->counts[i]);
+    x->keys[i] = s->keys.front();
+    x->values[i] = s->values.front();
+    x->counts[i] = s->counts.front();
+    s->keys.erase(s->keys.begin());
+    s->values.erase(s->values.begin());
+    s->counts.erase(s->counts.begin());
+    if (!c->leaf) {
+        c->children.push_back(s->children.front());
+        s->children.erase(s->children.begin());
+    }
+    if (c->augmented) {
+        c->sumSubtree();
+        s->sumSubtree();
+    }
+}
+
+void BTree::insertBStar(Node* x, int k, Value v, uint32_t count, int level) {
+    // The descent of Node::insertNonFull, with makeRoom for splitChild
+    const size_t full = (size_t)(2 * t - 1);
+    while (!x->leaf) {
+        if (x->augmented) x->agg.add(k, count);
+        int i = (int)x->lowerBound(k);
+        if (accessLog) {
+            size_t from = i > 0 ? i - 1 : 0;
+            x->touch(NodePart::Header, 0, sizeof(Node));
+            x->touch(NodePart::Keys, from * sizeof(int), (x->keys.size() - from) * sizeof(int));
+            x->touch(NodePart::Children, i * sizeof(Node*), sizeof(Node*));
+        }
+        // A packed leaf shows no keys until it is thawed
+        if (x->children[i]->leaf) thaw(x->children[i]);
+        if (x->children[i]->keys.size() == full) i = makeRoom(x, i, k, level - 1, false);
+        x = x->children[i];
+        --level;
+    }
+    x->insertNonFull(k, v, count, stats, 0);
+}
+
+int BTree::makeRoom(Node* x, int i, int k, int childLevel, bool animate) {
+    const size_t full = (size_t)(2 * t - 1);
+    Node* c = x->children[i];
+    int last = (int)x->keys.size();
+    if (c->leaf) {
+        if (i > 0) thaw(x->children[i - 1]);
+        if (i < last) thaw(x->children[i + 1]);
+    }
+    if (animate) {
+        AnimationStep violationAnim;
+        violationAnim.type = AnimationType::KeyHighlight;
+        violationAnim.duration = 0.4f;
+        violationAnim.highlightNode = c;
+        violationAnim.highlightKeyIndex = -1;
+        violationAnim.highlightColor = ORANGE;
+        violationAnim.completed = false;
+        addAnimationStep(violationAnim);
+    }
+    // The separator goes down into the sibling, then a key of c up in its
+    // place; with several shifted the ones between follow unanimated
+    auto rotate = [&](int key, Node* from, int fromIndex, Node* to, int toIndex) {
+        AnimationStep move;
+        move.type = AnimationType::KeyMoving;
+        move.operation = AnimationStep::BalanceTree;
+        move.duration = 0.6f;
+        move.movingKey = key;
+        move.operationKey = key;
+        move.sourceNode = from;
+        move.sourceIndex = fromIndex;
+        move.targetNode = to;
+        move.targetIndex = toIndex;
+        move.needsRecalculation = false;
+        move.completed = false;
+        addAnimationStep(move);
+    };
+
+    // A sibling needs two free slots: evening out with one would fill it,
+    // and k may go there next
+    bool left = i > 0 && x->children[i - 1]->keys.size() + 2 <= full;
+    bool right = !left && i < last && x->children[i + 1]->keys.size() + 2 <= full;
+    if (left || right) {
+        // Even the pair out, which moves at least one entry
+        int sep = left ? i - 1 : i;
+        Node* s = x->children[left ? i - 1 : i + 1];
+        size_t had = s->keys.size();
+        int n = (int)(full - had + 1) / 2;
+        int down = x->keys[sep];
+        shiftEntries(x, sep, left ? n : -n);
+        if (animate) {
+            rotate(down, x, sep, s, left ? (int)had : n - 1);
+            rotate(x->keys[sep], c, left ? 0 : (int)c->keys.size() - 1, x, sep);
+        }
+        if (left) return k < x->keys[sep] ? i - 1 : i;
+        return k > x->keys[sep] ? i + 1 : i;
+    }
+
+    // Every neighbour is (nearly) full: c and one of them become three
+    int first = i < last ? i : i - 1;
+    splitThree(x, first, childLevel);
+    if (animate) {
+        AnimationStep splitAnim;
+        splitAnim.type = AnimationType::NodeSplitting;
+        splitAnim.duration = 1.0f;
+        splitAnim.operationNode = x->children[first + 1];
+        splitAnim.operation = AnimationStep::SplitNode;
+        splitAnim.keysToAnimate = x->children[first + 1]->keys;
+        splitAnim.operationKey = x->keys[first];
+        splitAnim.completed = false;
+        addAnimationStep(splitAnim);
+    }
+    int j = first;
+    while (j < first + 2 && x->keys[j] < k) ++j;
+    return j;
+}
+
+void BTree::shiftEntries(Node* x, int i, int n) {
+    Node* y = x->children[i];
+    Node* z = x->children[i + 1];
+    size_t ySize = y->keys.size(), zSize = z->keys.size();
+    {
+        NodeBytesScope xBytes(stats, x), yBytes(stats, y), zBytes(stats, z);
+        // Rotates each array through the separator like borrowFromLeft and
+        // borrowFromRight, n entries at once
+        auto shift = [n](auto& ys, auto& sep, auto& zs) {
+            if (n > 0) {
+                ys.push_back(sep);
+                ys.insert(ys.end(), zs.begin(), zs.begin() + (n - 1));
+                sep = zs[n - 1];
+                zs.erase(zs.begin(), zs.begin() + n);
+            } else {
+                size_t from = ys.size() + n;
+                zs.insert(zs.begin(), sep);
+                zs.insert(zs.begin(), ys.begin() + (from + 1), ys.end());
+                sep = ys[from];
+                ys.resize(from);
+            }
+        };
+        shift(y->keys, x->keys[i], z->keys);
+        shift(y->values, x->values[i], z->values);
+        shift(y->counts, x->counts[i], z->counts);
+        if (!y->leaf) {
+            if (n > 0) {
+                y->children.insert(y->children.end(), z->children.begin(), z->children.begin() + n);
+                z->children.erase(z->children.begin(), z->children.begin() + n);
+            } else {
+                z->children.insert(z->children.begin(), y->children.end() + n, y->children.end());
+                y->children.resize(y->children.size() + n);
+            }
+        }
+    }
+
+    if (accessLog) {
+        // The giving and taking ends of y, all of z, which shifts either
+        // way, and the separator
+        auto touchSlots = [](const Node* node, size_t from, size_t count) {
+            node->touch(NodePart::Header, 0, sizeof(Node));
+            node->touch(NodePart::Keys, from * sizeof(int), count * sizeof(int));
+            node->touch(NodePart::Values, from * sizeof(Value), count * sizeof(Value));
+            node->touch(NodePart::Counts, from * sizeof(uint32_t), count * sizeof(uint32_t));
+            if (!node->leaf) node->touch(NodePart::Children, from * sizeof(Node*), (count + 1) * sizeof(Node*));
+        };
+        size_t yFrom = std::min(ySize, y->keys.size());
+        touchSlots(y, yFrom, std::max(ySize, y->keys.size()) - yFrom);
+        touchSlots(z, 0, std::max(zSize, z->keys.size()));
+        x->touch(NodePart::Header, 0, sizeof(Node));
+        x->touch(NodePart::Keys, i * sizeof(int), sizeof(int));
+        x->touch(NodePart::Values, i * sizeof(Value), sizeof(Value));
+        x->touch(NodePart::Counts, i * sizeof(uint32_t), sizeof(uint32_t));
+    }
+
+    // x's total is unchanged
+    if (y->augmented) {
+        y->sumSubtree();
+        z->sumSubtree();
+    }
+}
+
+void BTree::splitThree(Node* x, int i, int childLevel) {
+    Node* y = x->children[i];
+    Node* z = x->children[i + 1];
+    Node* w = makeNode(y->leaf, childLevel);
+    // y, the separator and z hold up to 4t - 1 entries: three nodes of
+    // about (4t - 3) / 3 keys and two separators between them
+    size_t keys = y->keys.size() + z->keys.size() - 1;
+    size_t a = (keys + 2) / 3;
+    size_t b = (keys - a + 1) / 2;
+    {
+        NodeBytesScope xBytes(stats, x), yBytes(stats, y), zBytes(stats, z), wBytes(stats, w);
+        x->keys.insert(x->keys.begin() + i + 1, 0);
+        x->values.insert(x->values.begin() + i + 1, 0);
+        x->counts.insert(x->counts.begin() + i + 1, 0);
+        x->children.insert(x->children.begin() + i + 1, w);
+        auto regroup = [a, b](auto& ys, auto& ws, auto& zs, auto& sep1, auto& sep2) {
+            auto all = ys;
+            all.push_back(sep1);
+            all.insert(all.end(), zs.begin(), zs.end());
+            ys.assign(all.begin(), all.begin() + a);
+            sep1 = all[a];
+            ws.assign(all.begin() + (a + 1), all.begin() + (a + 1 + b));
+            sep2 = all[a + 1 + b];
+            zs.assign(all.begin() + (a + 2 + b), all.end());
+        };
+        regroup(y->keys, w->keys, z->keys, x->keys[i], x->keys[i + 1]);
+        regroup(y->values, w->values, z->values, x->values[i], x->values[i + 1]);
+        regroup(y->counts, w->counts, z->counts, x->counts[i], x->counts[i + 1]);
+        if (!y->leaf) {
+            std::vector<Node*> all = y->children;
+            all.insert(all.end(), z->children.begin(), z->children.end());
+            y->children.assign(all.begin(), all.begin() + (a + 1));
+            w->children.assign(all.begin() + (a + 1), all.begin() + (a + b + 2));
+            z->children.assign(all.begin() + (a + b + 2), all.end());
+        }
+    }
+
+    if (accessLog) {
+        // All three children are rewritten, and x from the separators on
+        for (const Node* node : {y, w, z}) {
+            node->touch(NodePart::Header, 0, sizeof(Node));
+            node->touch(NodePart::Keys, 0, node->keys.size() * sizeof(int));
+            node->touch(NodePart::Values, 0, node->keys.size() * sizeof(Value));
+            node->touch(NodePart::Counts, 0, node->keys.size() * sizeof(uint32_t));
+            if (!node->leaf) node->touch(NodePart::Children, 0, node->children.size() * sizeof(Node*));
+        }
+        size_t moved = x->keys.size() - i;
+        x->touch(NodePart::Header, 0, sizeof(Node));
+        x->touch(NodePart::Keys, i * sizeof(int), moved * sizeof(int));
+        x->touch(NodePart::Values, i * sizeof(Value), moved * sizeof(Value));
+        x->touch(NodePart::Counts, i * sizeof(uint32_t), moved * sizeof(uint32_t));
+        x->touch(NodePart::Children, (i + 1) * sizeof(Node*), moved * sizeof(Node*));
+    }
+
+    if (y->augmented) {
+        y->sumSubtree();
+        w->sumSubtree();
+        z->sumSubtree();
+    }
+}
+
+BTree::Node* BTree::makeNode(bool leaf, int level) {
+    Node* node = new Node(t, leaf);
+    node->augmented = aggregates;
+    stats.nodeBytes += node->memoryBytes();
+    ++stats.nodes;
+    if (leaf) ++stats.leaves;
+    if ((int)stats.levelNodes.size() <= level) stats.levelNodes.resize(level + 1, 0);
+    ++stats.levelNodes[level];
+    return node;
+}
+
+void BTree::freeNode(Node* node, int level) {
+    node->children.clear();
+    stats.nodeBytes -= node->memoryBytes();
+    --stats.nodes;
+    if (node->leaf) --stats.leaves;
+    --stats.levelNodes[level];
+    delete node;
+}
+
+size_t BTree::dropSubtree(Node* node, int level) {
+    size_t keys = node->keyCount();
+    for (Node* child : node->children) keys += dropSubtree(child, level - 1);
+    stats.keys -= node->keyCount();
+    for (size_t i = 0; i < node->keyCount(); ++i) stats.occurrences -= node->countAt(i);
+    if (node->packed) --packedLeaves;
+    forget(node);
+    freeNode(node, level);
+    return keys;
+}
+
+BTree::Piece BTree::normalize(Piece p) {
+    while (p.root && p.root->keys.empty()) {
+        Node* child = p.root->leaf ? nullptr : p.root->children[0];
+        freeNode(p.root, p.height - 1);
+        p.root = child;
+        p.height = child ? p.height - 1 : 0;
+    }
+    return p;
+}
+
+void BTree::splitPiece(Piece p, int k, Piece& left, Entry& mid, bool& found, Piece& right) {
+    found = false;
+    left = right = Piece();
+    Node* x = p.root;
+    if (!x) return;
+    int level = p.height - 1;
+    int n = (int)x->keys.size();
+    int i = (int)simdLowerBound(x->keys.data(), x->keys.size(), k);
+    bool here = i < n && x->keys[i] == k;
+    Node* r = makeNode(x->leaf, level);
+
+    if (here || x->leaf) {
+        // Nothing below needs cutting: x keeps what is left of k, r the rest
+        int from = here ? i + 1 : i;
+        {
+            NodeBytesScope xBytes(stats, x), rBytes(stats, r);
+            if (here) {
+                mid = Entry{x->keys[i], x->values[i], x->counts[i]};
+                found = true;
+            }
+            r->keys.assign(x->keys.begin() + from, x->keys.end());
+            r->values.assign(x->values.begin() + from, x->values.end());
+            r->counts.assign(x->counts.begin() + from, x->counts.end());
+            x->keys.resize(i);
+            x->values.resize(i);
+            x->counts.resize(i);
+            if (!x->leaf) {
+                r->children.assign(x->children.begin() + i + 1, x->children.end());
+                x->children.resize(i + 1);
+            }
+        }
+        if (aggregates) {
+            x->sumSubtree();
+            r->sumSubtree();
+        }
+        left = normalize({x, p.height});
+        right = normalize({r, p.height});
+        return;
+    }
+
+    // k lies under children[i]: cut that child, then glue its halves to the
+    // parts of x on either side, using the keys around it as separators
+    Piece lower, upper;
+    splitPiece({x->children[i], p.height - 1}, k, lower, mid, found, upper);
+    Entry sepLeft{}, sepRight{};
+    {
+        NodeBytesScope xBytes(stats, x), rBytes(stats, r);
+        if (i < n) {
+            sepRight = Entry{x->keys[i], x->values[i], x->counts[i]};
+            r->keys.assign(x->keys.begin() + i + 1, x->keys.end());
+            r->values.assign(x->values.begin() + i + 1, x->values.end());
+            r->counts.assign(x->counts.begin() + i + 1, x->counts.end());
+            r->children.assign(x->children.begin() + i + 1, x->children.end());
+        }
+        if (i > 0) sepLeft = Entry{x->keys[i - 1], x->values[i - 1], x->counts[i - 1]};
+        int keep = i > 0 ? i - 1 : 0;
+        x->keys.resize(keep);
+        x->values.resize(keep);
+        x->counts.resize(keep);
+        x->children.resize(i);
+    }
+    if (aggregates) {
+        x->sumSubtree();
+        r->sumSubtree();
+    }
+    if (i > 0) {
+        left = joinPieces(normalize({x, p.height}), sepLeft, lower);
+    } else {
+        freeNode(x, level);
+        left = lower;
+    }
+    if (i < n) {
+        right = joinPieces(upper, sepRight, normalize({r, p.height}));
+    } else {
+        freeNode(r, level);
+        right = upper;
+    }
+}
+
+BTree::Piece BTree::joinPieces(Piece a, const Entry& sep, Piece b) {
+    if (a.height == b.height) {
+        if (!a.root) {
+            Node* leaf = makeNode(true, 0);
+            NodeBytesScope bytes(stats, leaf);
+            leaf->keys.push_back(sep.key);
+            leaf->values.push_back(sep.value);
+            leaf->counts.push_back(sep.count);
+            if (aggregates) leaf->sumSubtree();
+            return {leaf, 1};
+        }
+        int level = a.height - 1;
+        if (a.root->keys.size() + b.root->keys.size() < (size_t)(2 * t - 1)) {
+            // Both roots and the separator fit in one node
+            {
+                NodeBytesScope aBytes(stats, a.root);
+                Node* x = a.root;
+                x->keys.push_back(sep.key);
+                x->values.push_back(sep.value);
+                x->counts.push_back(sep.count);
+                x->keys.insert(x->keys.end(), b.root->keys.begin(), b.root->keys.end());
+                x->values.insert(x->values.end(), b.root->values.begin(), b.root->values.end());
+                x->counts.insert(x->counts.end(), b.root->counts.begin(), b.root->counts.end());
+                x->children.insert(x->children.end(), b.root->children.begin(), b.root->children.end());
+            }
+            freeNode(b.root, level);
+            if (aggregates) a.root->sumSubtree();
+            return a;
+        }
+        Node* r = makeNode(false, a.height);
+        {
+            NodeBytesScope bytes(stats, r);
+            r->keys.push_back(sep.key);
+            r->values.push_back(sep.value);
+            r->counts.push_back(sep.count);
+            r->children.push_back(a.root);
+            r->children.push_back(b.root);
+        }
+        balancePair(r, 0, level);
+        if (aggregates) r->sumSubtree();
+        return {r, a.height + 1};
+    }
+
+    // Hang the shorter piece off the taller one's right (or left) spine,
+    // at the node whose children are as high as it is
+    bool intoA = a.height > b.height;
+    Piece& tall = intoA ? a : b;
+    const Piece& small = intoA ? b : a;
+    std::vector<Node*> path;
+    Node* x = tall.root;
+    int level = tall.height - 1;
+    while (level > small.height) {
+        path.push_back(x);
+        x = intoA ? x->children.back() : x->children.front();
+        --level;
+    }
+    {
+        NodeBytesScope bytes(stats, x);
+        if (intoA) {
+            x->keys.push_back(sep.key);
+            x->values.push_back(sep.value);
+            x->counts.push_back(sep.count);
+            if (small.root) x->children.push_back(small.root);
+        } else {
+            x->keys.insert(x->keys.begin(), sep.key);
+            x->values.insert(x->values.begin(), sep.value);
+            x->counts.insert(x->counts.begin(), sep.count);
+            if (small.root) x->children.insert(x->children.begin(), small.root);
+        }
+    }
+    // The short piece's root may be under-full
+    if (small.root) balancePair(x, intoA ? (int)x->keys.size() - 1 : 0, level - 1);
+
+    // One key too many splits its way up the spine
+    while ((int)x->keys.size() > 2 * t - 1) {
+        if (path.empty()) {
+            Node* r = makeNode(false, level + 1);
+            {
+                NodeBytesScope bytes(stats, r);
+                r->children.push_back(x);
+            }
+            r->splitChild(0, x, stats, level);
+            tall.root = r;
+            ++tall.height;
+            x = r;
+            break;
+        }
+        Node* parent = path.back();
+        path.pop_back();
+        parent->splitChild(intoA ? (int)parent->children.size() - 1 : 0, x, stats, level);
+        x = parent;
+        ++level;
+    }
+    // Everything from the graft up holds the short piece now
+    if (aggregates) {
+        x->sumSubtree();
+        for (auto it = path.rbegin(); it != path.rend(); ++it) (*it)->sumSubtree();
+    }
+    return tall;
+}
+
+BTree::Piece BTree::joinPieces(Piece a, Piece b) {
+    if (!a.root) return b;
+    if (!b.root) return a;
+    Node* first = b.root;
+    while (!first->leaf) first = first->children.front();
+    Piece none, rest;
+    Entry sep;
+    bool found;
+    splitPiece(b, first->keys.front(), none, sep, found, rest);
+    return joinPieces(a, sep, rest);
+}
+
+void BTree::balancePair(Node* x, int i, int childLevel) {
+    size_t minKeys = (size_t)(t - 1);
+    size_t a = x->children[i]->keys.size(), b = x->children[i + 1]->keys.size();
+    if (a >= minKeys && b >= minKeys) return;
+    if (a + b < (size_t)(2 * t - 1)) {
+        mergeChildren(x, i, childLevel);
+        return;
+    }
+    while (x->children[i]->keys.size() < minKeys) borrowFromRight(x, i);
+    while (x->children[i + 1]->keys.size() < minKeys) borrowFromLeft(x, i + 1);
+}
+
+bool BTree::firstKeyFrom(int k, int& key) const {
+    bool any = false;
+    for (const Node* x = root; x;) {
+        int i = (int)x->lowerBound(k);
+        if (i < (int)x->keyCount()) {
+            key = x->keyAt(i);
+            any = true;
+            if (key == k) return true;
+        }
+        x = x->leaf ? nullptr : x->children[i];
+    }
+    return any;
+}
+
+size_t BTree::eraseRangeFromTree(int lo, int hi) {
+    int first;
+    if (lo > hi || !firstKeyFrom(lo, first) || first > hi) return 0;
+
+    Piece left, rest, middle, right;
+    Entry atLo, atHi;
+    bool hasLo, hasHi;
+    splitPiece({root, stats.height()}, lo, left, atLo, hasLo, rest);
+    splitPiece(rest, hi, middle, atHi, hasHi, right);
+
+    size_t removed = 0;
+    if (hasLo) {
+        ++removed;
+        --stats.keys;
+        stats.occurrences -= atLo.count;
+    }
+    if (hasHi) {
+        ++removed;
+        --stats.keys;
+        stats.occurrences -= atHi.count;
+    }
+    if (middle.root) removed += dropSubtree(middle.root, middle.height - 1);
+
+    root = joinPieces(left, right).root;
+    while (!stats.levelNodes.empty() && stats.levelNodes.back() == 0) stats.levelNodes.pop_back();
+    return removed;
+}
+
+size_t BTree::eraseRange(int lo, int hi) {
+    unpackAll();
+    size_t removed = eraseRangeFromTree(lo, hi);
+    if (removed == 0) return 0;
+    ++version;
+    clearKeyPositions();
+    all_keys.erase(std::remove_if(all_keys.begin(), all_keys.end(), [&](int k) { return k >= lo && k <= hi; }),
+                   all_keys.end());
+    return removed;
+}
+
+size_t BTree::eraseBatch(std::vector<int> keys) {
+    unpackAll();
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    size_t removed = 0;
+    for (size_t i = 0; i < keys.size();) {
+        // Grow the run while the next listed key is also the tree's next key
+        size_t j = i;
+        int next;
+        while (j + 1 < keys.size() && keys[j] < INT_MAX && firstKeyFrom(keys[j] + 1, next) && next == keys[j + 1]) ++j;
+        removed += eraseRangeFromTree(keys[i], keys[j]);
+        i = j + 1;
+    }
+    if (removed == 0) return 0;
+    ++version;
+    clearKeyPositions();
+    all_keys.erase(std::remove_if(all_keys.begin(), all_keys.end(),
+                                  [&](int k) { return std::binary_search(keys.begin(), keys.end(), k); }),
+                   all_keys.end());
+    return removed;
+}
+
+bool BTree::countSmaller(Piece a, Piece b, Stats& counted) {
+    struct Walk {
+        std::vector<std::pair<const Node*, int>> stack;
+        Stats stats;
+        explicit Walk(Piece p) {
+            if (p.root) stack.push_back({p.root, p.height - 1});
+        }
+        void next() {
+            auto [node, level] = stack.back();
+            stack.pop_back();
+            for (const Node* child : node->children) stack.push_back({child, level - 1});
+            if ((int)stats.levelNodes.size() <= level) stats.levelNodes.resize(level + 1, 0);
+            ++stats.levelNodes[level];
+            ++stats.nodes;
+            if (node->leaf) ++stats.leaves;
+            stats.keys += node->keys.size();
+            for (uint32_t count : node->counts) stats.occurrences += count;
+            stats.nodeBytes += node->memoryBytes();
+        }
+    } wa(a), wb(b);
+    while (!wa.stack.empty() && !wb.stack.empty()) {
+        wa.next();
+        wb.next();
+    }
+    bool aDone = wa.stack.empty();
+    Walk& done = aDone ? wa : wb;
+    counted = std::move(done.stats);
+    return aDone;
+}
+
+void BTree::split(int pivot, BTree& right) {
+    unpackAll();
+    right.clearAll();
+    right.t = t;
+    right.multiset = multiset;
+    right.aggregates = aggregates;
+    right.leafCompression = leafCompression;
+    right.bStar = bStar;
+    ++version;
+    ++right.version;
+    clearKeyPositions();
+    right.clearKeyPositions();
+    if (!root) return;
+
+    Piece lower, upper;
+    Entry mid;
+    bool found;
+    splitPiece({root, stats.height()}, pivot, lower, mid, found, upper);
+    // The pivot itself belongs to the right half, as its smallest key
+    if (found) upper = joinPieces(Piece(), mid, upper);
+    root = lower.root;
+    right.root = upper.root;
+
+    // stats still covers both halves; count the smaller and move it over
+    Stats counted;
+    if (countSmaller(lower, upper, counted)) {
+        right.stats = stats;
+        removeStats(right.stats, counted);
+        stats = std::move(counted);
+    } else {
+        removeStats(stats, counted);
+        right.stats = std::move(counted);
+    }
+
+    auto moved = std::stable_partition(all_keys.begin(), all_keys.end(), [&](int k) { return k < pivot; });
+    right.all_keys.assign(moved, all_keys.end());
+    all_keys.erase(moved, all_keys.end());
+}
+
+bool BTree::join(BTree& right) {
+    if (&right == this || right.t != t || right.multiset != multiset) return false;
+    int lastLeft, firstRight;
+    if (!right.minKey(firstRight)) return true;
+    if (maxKey(lastLeft) && lastLeft >= firstRight) return false;
+    if (right.aggregates != aggregates) right.setAggregates(aggregates);
+    unpackAll();
+    right.unpackAll();
+
+    ++version;
+    ++right.version;
+    clearKeyPositions();
+    right.clearKeyPositions();
+    Piece a{root, stats.height()}, b{right.root, right.stats.height()};
+    addStats(stats, right.stats);
+    root = joinPieces(a, b).root;
+    while (!stats.levelNodes.empty() && stats.levelNodes.back() == 0) stats.levelNodes.pop_back();
+    right.root = nullptr;
+    right.stats = Stats();
+
+    all_keys.insert(all_keys.end(), right.all_keys.begin(), right.all_keys.end());
+    right.all_keys.clear();
+    return true;
+}
+
+void BTree::setAggregates(bool enabled) {
+    if (enabled == aggregates) return;
+    aggregates = enabled;
+    if (root) markAggregates(root, enabled);
+}
+
+void BTree::markAggregates(Node* x, bool enabled) {
+    for (Node* child : x->children) markAggregates(child, enabled);
+    x->augmented = enabled;
+    if (enabled) x->sumSubtree();
+}
+
+void BTree::adjustPathCount(int k, int64_t delta) {
+    for (Node* x = root; x;) {
+        x->agg.count += delta;
+        x->agg.sum += (int64_t)k * delta;
+        int i = (int)x->lowerBound(k);
+        if (i < (int)x->keyCount() && x->keyAt(i) == k) return;
+        x = x->leaf ? nullptr : x->children[i];
+    }
+}
+
+bool BTree::select(uint64_t k, int& key) const {
+    if (!aggregates) {
+        // Walk in order, counting occurrences
+        bool found = false;
+        if (root) root->traverse([&](Node* node, int, int i) {
+            if (found) return;
+            if (k < node->countAt(i)) {
+                key = node->keyAt(i);
+                found = true;
+            } else {
+                k -= node->countAt(i);
+            }
+        });
+        return found;
+    }
+    if (!root || k >= root->agg.count) return false;
+    for (const Node* x = root;;) {
+        size_t n = x->keyCount();
+        for (size_t i = 0; i <= n; ++i) {
+            if (!x->leaf) {
+                uint64_t below = x->children[i]->agg.count;
+                if (k < below) {
+                    x = x->children[i];
+                    break;
+                }
+                k -= below;
+            }
+            if (i == n) return false;
+            if (k < x->countAt(i)) {
+                key = x->keyAt(i);
+                return true;
+            }
+            k -= x->countAt(i);
+        }
+    }
+}
+
+uint64_t BTree::rank(int key) const {
+    uint64_t below = 0;
+    if (!aggregates) {
+        if (root) root->traverse([&](Node* node, int, int i) {
+            if (node->keyAt(i) < key) below += node->countAt(i);
+        });
+        return below;
+    }
+    for (const Node* x = root; x;) {
+        int i = (int)x->lowerBound(key);
+        for (int j = 0; j < i; ++j) {
+            below += x->countAt(j);
+            if (!x->leaf) below += x->children[j]->agg.count;
+        }
+        // Keys equal to key and everything right of them are not below
+        if (x->leaf || (i < (int)x->keyCount() && x->keyAt(i) == key)) {
+            if (!x->leaf) below += x->children[i]->agg.count;
+            break;
+        }
+        x = x->children[i];
+    }
+    return below;
+}
+
+BTree::Aggregate BTree::rangeAggregate(int lo, int hi) const {
+    Aggregate out;
+    if (!root || lo > hi) return out;
+    if (!aggregates) {
+        root->traverse([&](Node* node, int, int i) {
+            int key = node->keyAt(i);
+            if (key >= lo && key <= hi) out.add(key, node->countAt(i));
+        });
+        return out;
+    }
+    rangeAggregate(root, lo, hi, out);
+    return out;
+}
+
+void BTree::rangeAggregate(const Node* x, int lo, int hi, Aggregate& out) const {
+    if (x->agg.max < lo || x->agg.min > hi) return;
+    if (x->agg.min >= lo && x->agg.max <= hi) {
+        out += x->agg;
+        return;
+    }
+    size_t n = x->keyCount();
+    for (size_t i = 0; i <= n; ++i) {
+        if (!x->leaf) rangeAggregate(x->children[i], lo, hi, out);
+        if (i == n) break;
+        int key = x->keyAt(i);
+        if (key >= lo && key <= hi) out.add(key, x->countAt(i));
+    }
+}
+
+bool BTree::minKey(int& key) const {
+    if (!root) return false;
+    const Node* x = root;
+    while (!x->leaf) x = x->children.front();
+    key = x->keyAt(0);
+    return true;
+}
+
+bool BTree::maxKey(int& key) const {
+    if (!root) return false;
+    const Node* x = root;
+    while (!x->leaf) x = x->children.back();
+    key = x->keyAt(x->keyCount() - 1);
+    return true;
 }
 
 void BTree::clear() {
+    ++version;
     if (root) { delete root; root = nullptr; }
-    
+    stats = Stats();
+    packedLeaves = 0;
+    thawed.clear();
 }
 
 void BTree::clearAll() {
@@ -129,7 +1501,447 @@ void BTree::clearAll() {
     all_keys.clear();
 }
 
+void BTree::setLeafCompression(bool enabled) {
+    leafCompression = enabled;
+    if (enabled) compressLeaves();
+    else unpackAll();
+}
+
+void BTree::compressLeaves() {
+    thawed.clear();
+    if (root) packAll(root);
+}
+
+void BTree::packAll(Node* x) {
+    if (x->leaf) packLeaf(x);
+    else for (Node* child : x->children) packAll(child);
+}
+
+void BTree::unpackAll() {
+    thawed.clear();
+    if (root && packedLeaves > 0) unpackAll(root);
+}
+
+void BTree::unpackAll(Node* x) {
+    if (!x->leaf) {
+        for (Node* child : x->children) unpackAll(child);
+    } else if (x->packed) {
+        NodeBytesScope bytes(stats, x);
+        x->unpack();
+        --packedLeaves;
+    }
+}
+
+void BTree::packLeaf(Node* leaf) {
+    if (leaf->packed || !leaf->leaf || leaf->keys.empty()) return;
+    NodeBytesScope bytes(stats, leaf);
+    leaf->pack();
+    ++packedLeaves;
+}
+
+void BTree::thaw(Node* leaf) {
+    if (!leaf->packed) return;
+    {
+        NodeBytesScope bytes(stats, leaf);
+        leaf->unpack();
+    }
+    --packedLeaves;
+    thawed.push_back(leaf);
+}
+
+void BTree::forget(Node* node) {
+    thawed.erase(std::remove(thawed.begin(), thawed.end(), node), thawed.end());
+}
+
+void BTree::settle(int k) {
+    if (!leafCompression) {
+        thawed.clear();
+        return;
+    }
+    for (Node* leaf : thawed) packLeaf(leaf);
+    thawed.clear();
+    // A split leaves a new unpacked leaf beside the one k is in
+    if (!root) return;
+    if (root->leaf) {
+        packLeaf(root);
+        return;
+    }
+    for (Node* x = root;;) {
+        size_t i = x->lowerBound(k);
+        if (!x->children[i]->leaf) {
+            x = x->children[i];
+            continue;
+        }
+        for (size_t c = i > 0 ? i - 1 : 0; c <= std::min(i + 1, x->keys.size()); ++c) packLeaf(x->children[c]);
+        return;
+    }
+}
+
+void BTree::bulkLoad(std::vector<int> keys) {
+    std::vector<Value> values(keys.size(), 0);
+    bulkLoad(std::move(keys), std::move(values));
+}
+
+void BTree::bulkLoad(std::vector<int> keys, std::vector<Value> values) {
+    clearAll();
+    values.resize(keys.size(), 0);
+
+    // Sort key/value pairs together; the stable sort keeps the first of
+    // several equal keys in front
+    std::vector<size_t> order(keys.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] < keys[b]; });
+    std::vector<int> sortedKeys;
+    std::vector<Value> sortedValues;
+    std::vector<uint32_t> sortedCounts;
+    std::vector<char> first(keys.size(), 0);
+    sortedKeys.reserve(keys.size());
+    sortedValues.reserve(keys.size());
+    sortedCounts.reserve(keys.size());
+    for (size_t i : order) {
+        if (!sortedKeys.empty() && sortedKeys.back() == keys[i]) {
+            if (multiset) ++sortedCounts.back();
+            continue;
+        }
+        first[i] = 1;
+        sortedKeys.push_back(keys[i]);
+        sortedValues.push_back(values[i]);
+        sortedCounts.push_back(1);
+    }
+
+    build(sortedKeys, sortedValues, sortedCounts);
+    // Distinct keys in insertion order, for getLastInsertedKey and erase
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (first[i]) all_keys.push_back(keys[i]);
+    }
+}
+
+namespace {
+
+// fn(begin, end, part) over [0, n): split across pool when there is one
+template <typename F>
+void forRanges(ThreadPool* pool, size_t n, F&& fn) {
+    if (pool) pool->parallelFor(n, fn);
+    else if (n > 0) fn((size_t)0, n, (size_t)0);
+}
+
+// Sort word for the parallel bulk load: the key, biased so unsigned order
+// matches signed order, above its input position, which keeps equal keys in
+// input order and makes every word distinct
+uint64_t packKey(int key, size_t position) {
+    return ((uint64_t)((uint32_t)key ^ 0x80000000u) << 32) | (uint64_t)position;
+}
+
+int unpackKey(uint64_t word) {
+    return (int)((uint32_t)(word >> 32) ^ 0x80000000u);
+}
+
+} // namespace
+
+void BTree::bulkLoad(std::vector<int> keys, std::vector<Value> values, ThreadPool& pool) {
+    size_t n = keys.size();
+    size_t parts = pool.size();
+    // Below this the threads cost more than they save; positions must fit
+    // the low half of the sort word
+    if (n < (size_t)1 << 16 || n > UINT32_MAX) {
+        bulkLoad(std::move(keys), std::move(values));
+        return;
+    }
+    clearAll();
+    values.resize(n, 0);
+
+    // Sort chunks of the input, one per thread
+    std::vector<uint64_t> words(n);
+    auto chunkBegin = [&](size_t c) { return n * c / parts; };
+    pool.run(parts, [&](size_t c) {
+        for (size_t i = chunkBegin(c); i < chunkBegin(c + 1); ++i) words[i] = packKey(keys[i], i);
+        std::sort(words.begin() + chunkBegin(c), words.begin() + chunkBegin(c + 1));
+    });
+
+    // Splitters from an evenly spaced sample of every chunk. They cut on
+    // the key alone, so all copies of a key land in one bucket and
+    // deduplication never crosses buckets.
+    const size_t oversample = 16;
+    std::vector<uint64_t> sample;
+    sample.reserve(parts * parts * oversample);
+    for (size_t c = 0; c < parts; ++c) {
+        size_t size = chunkBegin(c + 1) - chunkBegin(c);
+        for (size_t j = 0; j < parts * oversample; ++j) {
+            sample.push_back(words[chunkBegin(c) + size * j / (parts * oversample)] >> 32);
+        }
+    }
+    std::sort(sample.begin(), sample.end());
+    // Bucket b holds biased keys from bound[b] up to the next bound; the
+    // last bucket runs to the end
+    std::vector<uint64_t> bound(parts);
+    bound[0] = 0;
+    for (size_t b = 1; b < parts; ++b) bound[b] = std::max(bound[b - 1], sample[sample.size() * b / parts]);
+
+    // Where each bucket starts in each chunk
+    std::vector<size_t> cut((parts + 1) * parts);
+    pool.run(parts, [&](size_t c) {
+        auto first = words.begin() + chunkBegin(c), last = words.begin() + chunkBegin(c + 1);
+        for (size_t b = 0; b < parts; ++b) {
+            cut[b * parts + c] = (size_t)(std::lower_bound(first, last, bound[b] << 32) - words.begin());
+        }
+        cut[parts * parts + c] = chunkBegin(c + 1);
+    });
+    std::vector<size_t> bucketBegin(parts + 1, 0);
+    for (size_t b = 0; b < parts; ++b) {
+        size_t size = 0;
+        for (size_t c = 0; c < parts; ++c) size += cut[(b + 1) * parts + c] - cut[b * parts + c];
+        bucketBegin[b + 1] = bucketBegin[b] + size;
+    }
+
+    // Each bucket gathers its sorted runs from every chunk and merges them
+    // pairwise; then counts its distinct keys
+    std::vector<uint64_t> sorted(n);
+    std::vector<size_t> distinct(parts + 1, 0);
+    pool.run(parts, [&](size_t b) {
+        std::vector<size_t> runs{bucketBegin[b]};
+        for (size_t c = 0; c < parts; ++c) {
+            auto from = words.begin() + cut[b * parts + c], to = words.begin() + cut[(b + 1) * parts + c];
+            std::copy(from, to, sorted.begin() + runs.back());
+            runs.push_back(runs.back() + (size_t)(to - from));
+        }
+        while (runs.size() > 2) {
+            std::vector<size_t> merged;
+            for (size_t r = 0; r + 2 < runs.size(); r += 2) {
+                std::inplace_merge(sorted.begin() + runs[r], sorted.begin() + runs[r + 1], sorted.begin() + runs[r + 2]);
+                merged.push_back(runs[r]);
+            }
+            if (runs.size() % 2 == 0) merged.push_back(runs[runs.size() - 2]);
+            merged.push_back(runs.back());
+            runs.swap(merged);
+        }
+        size_t count = 0;
+        for (size_t i = bucketBegin[b]; i < bucketBegin[b + 1]; ++i) {
+            if (i == bucketBegin[b] || (sorted[i] >> 32) != (sorted[i - 1] >> 32)) ++count;
+        }
+        distinct[b + 1] = count;
+    });
+    for (size_t b = 0; b < parts; ++b) distinct[b + 1] += distinct[b];
+    words.clear();
+    words.shrink_to_fit();
+
+    // Deduplicate: the first copy of a key in input order keeps its value
+    size_t unique = distinct[parts];
+    std::vector<int> sortedKeys(unique);
+    std::vector<Value> sortedValues(unique);
+    std::vector<uint32_t> sortedCounts(unique);
+    std::vector<char> first(n, 0);
+    pool.run(parts, [&](size_t b) {
+        size_t out = distinct[b];
+        for (size_t i = bucketBegin[b]; i < bucketBegin[b + 1];) {
+            size_t j = i + 1;
+            while (j < bucketBegin[b + 1] && (sorted[j] >> 32) == (sorted[i] >> 32)) ++j;
+            size_t position = (size_t)(uint32_t)sorted[i];
+            sortedKeys[out] = unpackKey(sorted[i]);
+            sortedValues[out] = values[position];
+            sortedCounts[out] = multiset ? (uint32_t)(j - i) : 1;
+            first[position] = 1;
+            ++out;
+            i = j;
+        }
+    });
+    sorted.clear();
+    sorted.shrink_to_fit();
+
+    build(sortedKeys, sortedValues, sortedCounts, &pool);
+
+    // Distinct keys in insertion order, for getLastInsertedKey and erase
+    std::vector<size_t> kept(parts + 1, 0);
+    pool.run(parts, [&](size_t c) {
+        size_t count = 0;
+        for (size_t i = chunkBegin(c); i < chunkBegin(c + 1); ++i) count += (size_t)first[i];
+        kept[c + 1] = count;
+    });
+    for (size_t c = 0; c < parts; ++c) kept[c + 1] += kept[c];
+    all_keys.resize(kept[parts]);
+    pool.run(parts, [&](size_t c) {
+        size_t out = kept[c];
+        for (size_t i = chunkBegin(c); i < chunkBegin(c + 1); ++i) {
+            if (first[i]) all_keys[out++] = keys[i];
+        }
+    });
+}
+
+void BTree::build(const std::vector<int>& keys, const std::vector<Value>& values, const std::vector<uint32_t>& counts,
+                  ThreadPool* pool) {
+    stats = Stats();
+    if (keys.empty()) return;
+    size_t threads = pool ? pool->size() : 1;
+    // Per-thread sums for the stats
+    std::vector<size_t> bytes(threads), occurrences(threads);
+    auto addStatsFrom = [&](size_t created, bool leaves) {
+        for (size_t i = 0; i < threads; ++i) {
+            stats.nodeBytes += bytes[i];
+            stats.occurrences += occurrences[i];
+            bytes[i] = occurrences[i] = 0;
+        }
+        stats.levelNodes.push_back(created);
+        stats.nodes += created;
+        if (leaves) stats.leaves = created;
+    };
+
+    // Leaves: the fewest nodes that hold every key plus the separators
+    // between them, with keys spread evenly. m = ceil((n + 1) / 2t) keeps
+    // every leaf between t - 1 and 2t - 1 keys. Leaf i starts after i
+    // earlier leaves and the separator that follows each; separators are
+    // kept as positions in keys.
+    size_t n = keys.size();
+    size_t m = std::max<size_t>(1, (n + 1 + 2 * t - 1) / (2 * t));
+    size_t perLeaf = (n - (m - 1)) / m, extra = (n - (m - 1)) % m;
+    std::vector<Node*> level(m);
+    std::vector<size_t> separators(m - 1);
+    forRanges(pool, m, [&](size_t begin, size_t end, size_t part) {
+        for (size_t i = begin; i < end; ++i) {
+            size_t pos = i * (perLeaf + 1) + std::min(i, extra);
+            size_t count = perLeaf + (i < extra ? 1 : 0);
+            Node* leaf = new Node(t, true);
+            leaf->augmented = aggregates;
+            leaf->keys.assign(keys.begin() + pos, keys.begin() + pos + count);
+            leaf->values.assign(values.begin() + pos, values.begin() + pos + count);
+            leaf->counts.assign(counts.begin() + pos, counts.begin() + pos + count);
+            if (aggregates) leaf->sumSubtree();
+            for (uint32_t c : leaf->counts) occurrences[part] += c;
+            if (leafCompression) leaf->pack();
+            level[i] = leaf;
+            if (i + 1 < m) separators[i] = pos + count;
+            bytes[part] += leaf->memoryBytes();
+        }
+    });
+    addStatsFrom(m, true);
+    if (leafCompression) packedLeaves = m;
+    for (size_t i = 0; i + 1 < m; ++i) stats.occurrences += counts[separators[i]];
+
+    // Internal levels: group children the same way, between t and 2t each,
+    // and promote the separators that fall between groups
+    while (level.size() > 1) {
+        size_t c = level.size();
+        size_t p = (c + 2 * t - 1) / (2 * t);
+        size_t perNode = c / p, more = c % p;
+        std::vector<Node*> parents(p);
+        std::vector<size_t> promoted(p - 1);
+        forRanges(pool, p, [&](size_t begin, size_t end, size_t part) {
+            for (size_t i = begin; i < end; ++i) {
+                size_t child = i * perNode + std::min(i, more);
+                size_t count = perNode + (i < more ? 1 : 0);
+                Node* node = new Node(t, false);
+                node->children.assign(level.begin() + child, level.begin() + child + count);
+                node->keys.reserve(count - 1);
+                node->values.reserve(count - 1);
+                node->counts.reserve(count - 1);
+                for (size_t j = child; j + 1 < child + count; ++j) {
+                    node->keys.push_back(keys[separators[j]]);
+                    node->values.push_back(values[separators[j]]);
+                    node->counts.push_back(counts[separators[j]]);
+                }
+                node->augmented = aggregates;
+                if (aggregates) node->sumSubtree();
+                parents[i] = node;
+                if (i + 1 < p) promoted[i] = separators[child + count - 1];
+                bytes[part] += node->memoryBytes();
+            }
+        });
+        addStatsFrom(p, false);
+        level.swap(parents);
+        separators.swap(promoted);
+    }
+    root = level.front();
+    stats.keys = n;
+}
+
+double BTree::fillFactor() const {
+    if (stats.nodes == 0) return 0.0;
+    return (double)stats.keys / ((double)stats.nodes * (2 * t - 1));
+}
+
+size_t BTree::memoryBytes() const {
+    return sizeof(*this) + stats.nodeBytes + all_keys.capacity() * sizeof(int) + keyPositionBytes();
+}
+
+double BTree::bytesPerKey() const {
+    return stats.keys ? (double)memoryBytes() / (double)stats.keys : 0.0;
+}
+
+void BTree::setDegree(int newT) {
+    if (newT < 2 || newT == t) return;
+    std::vector<int> keys;
+    std::vector<Value> values;
+    std::vector<uint32_t> counts;
+    collect(keys, values, counts);
+    t = newT;
+    clear();
+    build(keys, values, counts);
+}
+
+void BTree::collect(std::vector<int>& keys, std::vector<Value>& values, std::vector<uint32_t>& counts) const {
+    keys.clear();
+    values.clear();
+    counts.clear();
+    keys.reserve(all_keys.size());
+    values.reserve(all_keys.size());
+    counts.reserve(all_keys.size());
+    if (root) root->traverse([&](Node* node, int, int i) {
+        keys.push_back(node->keyAt(i));
+        values.push_back(node->valueAt(i));
+        counts.push_back(node->countAt(i));
+    });
+}
+
+void BTree::setHeatTracking(bool enabled, uint32_t sampleEvery, uint32_t halfLife) {
+    heatState.enabled = enabled;
+    heatState.sampleEvery = std::max<uint32_t>(1, sampleEvery);
+    heatState.halfLife = std::max<uint32_t>(1, halfLife);
+    heatState.skipped = 0;
+}
+
+void BTree::touchPath(int k) const {
+    heatState.skipped = 0;
+    ++heatState.samples;
+    uint32_t epoch = heatState.epoch;
+    for (Node* node = root; node;) {
+        if (node->heatEpoch != epoch) {
+            uint32_t age = epoch - node->heatEpoch;
+            node->heat = age >= 32 ? 0 : node->heat >> age;
+            node->heatEpoch = epoch;
+        }
+        ++node->heat;
+        int i = (int)node->lowerBound(k);
+        if ((i < (int)node->keyCount() && node->keyAt(i) == k) || node->leaf) break;
+        node = node->children[i];
+    }
+    if (++heatState.inEpoch >= heatState.halfLife) {
+        heatState.inEpoch = 0;
+        ++heatState.epoch;
+    }
+}
+
+uint32_t BTree::heatOf(const Node* node) const {
+    uint32_t age = heatState.epoch - node->heatEpoch;
+    return age >= 32 ? 0 : node->heat >> age;
+}
+
+std::vector<BTree::HotNode> BTree::hotNodes(size_t limit) const {
+    std::vector<HotNode> all;
+    std::vector<size_t> position(stats.height(), 0);
+    std::function<void(const Node*, int)> walk = [&](const Node* node, int depth) {
+        uint32_t h = heatOf(node);
+        if (h > 0) all.push_back(HotNode{node, depth, position[depth], h});
+        ++position[depth];
+        for (const Node* child : node->children) walk(child, depth + 1);
+    };
+    if (root) walk(root, 0);
+    limit = std::min(limit, all.size());
+    std::partial_sort(all.begin(), all.begin() + limit, all.end(),
+        [](const HotNode& a, const HotNode& b) { return a.heat > b.heat; });
+    all.resize(limit);
+    return all;
+}
+
 void BTree::traverse(const std::function<void(Node*, int, int)>& cb) {
+    unpackAll();
     if (root) root->traverse(cb, 0);
 }
 
@@ -137,13 +1949,27 @@ void BTree::traverse(const std::function<void(Node*, int, int)>& cb) {
 
 void BTree::setKeyPosition(Node* node, int keyIndex, Vector2 position) {
     if (nodeKeyPositions.find(node) == nodeKeyPositions.end()) {
-        nodeKeyPositions[node] = std::vector<Vector2>(node->keys.size());
+        nodeKeyPositions[node] = std::vector<Vector2>(node->keyCount());
+        keyPositionArrays += nodeKeyPositions[node].capacity() * sizeof(Vector2);
     }
     if (keyIndex >= 0 && keyIndex < (int)nodeKeyPositions[node].size()) {
         nodeKeyPositions[node][keyIndex] = position;
     }
 }
 
+void BTree::clearKeyPositions() {
+    nodeKeyPositions.clear();
+    keyPositionArrays = 0;
+}
+
+size_t BTree::keyPositionBytes() const {
+    // Bucket array, one heap node per entry (next pointer plus the pair)
+    // and the position vectors
+    using Entry = std::pair<Node* const, std::vector<Vector2>>;
+    return nodeKeyPositions.bucket_count() * sizeof(void*) +
+           nodeKeyPositions.size() * (sizeof(void*) + sizeof(Entry)) + keyPositionArrays;
+}
+
 Vector2 BTree::getKeyTargetPosition(int key) {
     // Find where this key should be in the tree
     if (!root) return {400.0f, 200.0f};
@@ -200,12 +2026,14 @@ void BTree::updateAnimation(float deltaTime) {
             if (anim.type == AnimationType::KeyMoving) {
                 // Actually insert the key now
                 if (anim.operation == AnimationStep::InsertKey) {
-                    insertInternal(anim.movingKey);
+                    insertInternal(anim.movingKey, anim.operationValue);
                 }
             } else if (anim.type == AnimationType::NodeOperation) {
                 // Execute deletion or other node operations
-                if (anim.operationKey != 0 && anim.operation == AnimationStep::None) {
+                if (anim.operation == AnimationStep::DeleteKey) {
                     eraseInternal(anim.operationKey);
+                } else if (anim.operation == AnimationStep::EraseRange && !anim.keysToAnimate.empty()) {
+                    eraseRange(anim.keysToAnimate.front(), anim.keysToAnimate.back());
                 }
             }
         }
@@ -251,7 +2079,8 @@ void BTree::processNextAnimation() {
     currentAnimations.push_back(step);
 }
 
-void BTree::insertAnimated(int k) {
+void BTree::insertAnimated(int k, Value v) {
+    unpackAll();
     // Create animation for key moving to target position
     AnimationStep moveAnim;
     moveAnim.type = AnimationType::KeyMoving;
@@ -262,18 +2091,20 @@ void BTree::insertAnimated(int k) {
     moveAnim.needsRecalculation = true; // Will update as tree changes
     moveAnim.operation = AnimationStep::InsertKey;
     moveAnim.operationKey = k;
+    moveAnim.operationValue = v;
     
     addAnimationStep(moveAnim);
 }
 
-void BTree::insertInternal(int k) {
-    // This is the actual insertion that happens after animation
+void BTree::insertInternal(int k, Value v) {
+    // This is the actual insertion that happens after animation. A key
+    // that is already present only adds an occurrence.
+    if (addOccurrence(k)) return;
     if (!root) {
-        root = new Node(t, true);
-        root->keys.push_back(k);
-        all_keys.push_back(k);
+        insertEntry(k, v, 1);
         return;
     }
+    ++version;
     
     // Check if root needs splitting
     if ((int)root->keys.size() == 2*t - 1) {
@@ -303,44 +2134,69 @@ void BTree::insertInternal(int k) {
         // Actually do the split
         Node* newRoot = new Node(t, false);
         newRoot->children.push_back(root);
-        newRoot->splitChild(0, root);
+        growRoot(newRoot);
+        newRoot->splitChild(0, root, stats, stats.height() - 2);
         int i = (newRoot->keys[0] < k) ? 1 : 0;
         
-        // Check if the child we're inserting into will also need splitting
-        if ((int)newRoot->children[i]->keys.size() == 2*t - 1) {
-            // Queue another split animation
-            AnimationStep childSplitAnim;
-            childSplitAnim.type = AnimationType::NodeSplitting;
-            childSplitAnim.duration = 1.0f;
-            childSplitAnim.operationNode = newRoot->children[i];
-            childSplitAnim.operation = AnimationStep::SplitNode;
-            childSplitAnim.keysToAnimate = newRoot->children[i]->keys;
-            childSplitAnim.operationKey = newRoot->children[i]->keys[t - 1];
-            childSplitAnim.completed = false;
-            addAnimationStep(childSplitAnim);
+        if (bStar) {
+            // Room below is made, and animated, on the way down
+            insertNonFullWithAnimation(newRoot->children[i], k, v, stats.height() - 2);
+        } else {
+            // Check if the child we're inserting into will also need splitting
+            if ((int)newRoot->children[i]->keys.size() == 2*t - 1) {
+                // Queue another split animation
+                AnimationStep childSplitAnim;
+                childSplitAnim.type = AnimationType::NodeSplitting;
+                childSplitAnim.duration = 1.0f;
+                childSplitAnim.operationNode = newRoot->children[i];
+                childSplitAnim.operation = AnimationStep::SplitNode;
+                childSplitAnim.keysToAnimate = newRoot->children[i]->keys;
+                childSplitAnim.operationKey = newRoot->children[i]->keys[t - 1];
+                childSplitAnim.completed = false;
+                addAnimationStep(childSplitAnim);
+            }
+            
+            newRoot->children[i]->insertNonFull(k, v, 1, stats, stats.height() - 2);
         }
-        
-        newRoot->children[i]->insertNonFull(k);
+        if (aggregates) newRoot->sumSubtree();
         root = newRoot;
     } else {
         // Check if insertion will cause any splits down the path
-        insertNonFullWithAnimation(root, k);
+        insertNonFullWithAnimation(root, k, v, stats.height() - 1);
     }
     
     all_keys.push_back(k);
 }
 
-void BTree::insertNonFullWithAnimation(Node* node, int k) {
+void BTree::insertNonFullWithAnimation(Node* node, int k, Value v, int level) {
     // This method inserts and queues animations for any splits that occur
+    if (node->augmented) node->agg.add(k, 1);
     int i = (int)node->keys.size() - 1;
     
     if (node->leaf) {
+        NodeBytesScope bytes(stats, node);
         node->keys.push_back(0);
+        node->values.push_back(0);
+        node->counts.push_back(0);
         while (i >= 0 && node->keys[i] > k) {
             node->keys[i + 1] = node->keys[i];
+            node->values[i + 1] = node->values[i];
+            node->counts[i + 1] = node->counts[i];
             --i;
         }
         node->keys[i + 1] = k;
+        node->values[i + 1] = v;
+        node->counts[i + 1] = 1;
+        ++stats.keys;
+        ++stats.occurrences;
+        if (accessLog) {
+            // Same accesses as Node::insertNonFull
+            size_t from = i + 1, moved = node->keys.size() - from;
+            node->touch(NodePart::Header, 0, sizeof(Node));
+            node->touch(NodePart::Keys, from * sizeof(int), moved * sizeof(int));
+            node->touch(NodePart::Values, from * sizeof(Value), moved * sizeof(Value));
+            node->touch(NodePart::Counts, from * sizeof(uint32_t), moved * sizeof(uint32_t));
+        }
         
         // Check if node is now overfull (violation)
         if ((int)node->keys.size() >= 2 * t) {
@@ -356,8 +2212,16 @@ void BTree::insertNonFullWithAnimation(Node* node, int k) {
     } else {
         while (i >= 0 && node->keys[i] > k) --i;
         ++i;
-        
-        if ((int)node->children[i]->keys.size() == 2 * t - 1) {
+        if (accessLog) {
+            size_t from = i > 0 ? i - 1 : 0;
+            node->touch(NodePart::Header, 0, sizeof(Node));
+            node->touch(NodePart::Keys, from * sizeof(int), (node->keys.size() - from) * sizeof(int));
+            node->touch(NodePart::Children, i * sizeof(Node*), sizeof(Node*));
+        }
+
+        if ((int)node->children[i]->keys.size() == 2 * t - 1 && bStar) {
+            i = makeRoom(node, i, k, level - 1, true);
+        } else if ((int)node->children[i]->keys.size() == 2 * t - 1) {
             // Queue violation animation
             AnimationStep violationAnim;
             violationAnim.type = AnimationType::KeyHighlight;
@@ -379,14 +2243,15 @@ void BTree::insertNonFullWithAnimation(Node* node, int k) {
             splitAnim.completed = false;
             addAnimationStep(splitAnim);
             
-            node->splitChild(i, node->children[i]);
+            node->splitChild(i, node->children[i], stats, level - 1);
             if (node->keys[i] < k) ++i;
         }
-        insertNonFullWithAnimation(node->children[i], k);
+        insertNonFullWithAnimation(node->children[i], k, v, level - 1);
     }
 }
 
 void BTree::eraseAnimated(int k) {
+    unpackAll();
     // Check if key exists
     Node* node = root ? root->search(k) : nullptr;
     
@@ -429,42 +2294,137 @@ void BTree::eraseAnimated(int k) {
     AnimationStep deleteAnim;
     deleteAnim.type = AnimationType::NodeOperation;
     deleteAnim.duration = 0.1f;
-    deleteAnim.operation = AnimationStep::None;
+    // Tagged rather than keyed on operationKey != 0, so key 0 is erased too
+    deleteAnim.operation = AnimationStep::DeleteKey;
     deleteAnim.operationKey = k;
     deleteAnim.completed = false;
     addAnimationStep(deleteAnim);
 }
 
+BTree::Node* BTree::highlightPath(int k, AnimationStep::Operation operation, Color color, int& index) {
+    // The path is taken now; input waits for the animation, so the tree
+    // does not change under it
+    index = -1;
+    for (Node* node = root; node;) {
+        int i = (int)simdLowerBound(node->keys.data(), node->keys.size(), k);
+        bool here = i < (int)node->keys.size() && node->keys[i] == k;
+
+        AnimationStep visit;
+        visit.type = AnimationType::KeyHighlight;
+        visit.operation = operation;
+        visit.operationKey = k;
+        visit.duration = 0.45f;
+        visit.highlightNode = node;
+        visit.highlightKeyIndex = -1;
+        visit.highlightColor = color;
+        visit.completed = false;
+        addAnimationStep(visit);
+
+        if (here || node->leaf) {
+            if (here) index = i;
+            return node;
+        }
+        node = node->children[i];
+    }
+    return nullptr;
+}
+
+void BTree::searchAnimated(int k) {
+    unpackAll();
+    sampleHeat(k);
+    int index;
+    Node* last = highlightPath(k, AnimationStep::SearchKey, Color{59, 130, 246, 255}, index);
+    if (!last) return;
+
+    // Found: the key itself; missing: the leaf where it would be
+    AnimationStep result;
+    result.type = AnimationType::KeyHighlight;
+    result.operation = AnimationStep::SearchKey;
+    result.operationKey = k;
+    result.duration = 0.8f;
+    result.highlightNode = last;
+    result.highlightKeyIndex = index;
+    result.highlightColor = index >= 0 ? GREEN : RED;
+    result.completed = false;
+    addAnimationStep(result);
+}
+
+void BTree::splitPathAnimated(int pivot) {
+    unpackAll();
+    int index;
+    highlightPath(pivot, AnimationStep::SplitTree, Color{249, 115, 22, 255}, index);
+}
+
+void BTree::joinSeamAnimated(int key) {
+    unpackAll();
+    int index;
+    Node* seam = highlightPath(key, AnimationStep::JoinTree, Color{16, 185, 129, 255}, index);
+    if (!seam || index < 0) return;
+
+    AnimationStep graft;
+    graft.type = AnimationType::KeyHighlight;
+    graft.operation = AnimationStep::JoinTree;
+    graft.operationKey = key;
+    graft.duration = 0.8f;
+    graft.highlightNode = seam;
+    graft.highlightKeyIndex = index;
+    graft.highlightColor = Color{16, 185, 129, 255};
+    graft.completed = false;
+    addAnimationStep(graft);
+}
+
+void BTree::eraseRangeAnimated(int lo, int hi) {
+    unpackAll();
+    // Keys in range, in order, from only the subtrees that overlap it
+    std::vector<int> keys;
+    std::vector<const Node*> stack;
+    if (root && lo <= hi) stack.push_back(root);
+    while (!stack.empty()) {
+        const Node* x = stack.back();
+        stack.pop_back();
+        int n = (int)x->keys.size();
+        int first = (int)simdLowerBound(x->keys.data(), x->keys.size(), lo);
+        int i = first;
+        for (; i < n && x->keys[i] <= hi; ++i) keys.push_back(x->keys[i]);
+        if (!x->leaf) {
+            for (int c = first; c <= i; ++c) stack.push_back(x->children[c]);
+        }
+    }
+    if (keys.empty()) return;
+    std::sort(keys.begin(), keys.end());
+
+    AnimationStep fade;
+    fade.type = AnimationType::NodeOperation;
+    fade.operation = AnimationStep::EraseRange;
+    fade.duration = 0.9f;
+    fade.operationNode = nullptr;
+    fade.operationKey = keys.front();
+    fade.keysToAnimate = std::move(keys);
+    fade.completed = false;
+    addAnimationStep(fade);
+}
+
 void BTree::eraseInternal(int k) {
     if (!root) return;
+    ++version;
     
     // Check if node might become too small after deletion
     Node* node = root->search(k);
     if (node) {
+        // erase rebalances on the way down and keeps all_keys in step; a
+        // multiset key with several occurrences only loses one
+        int heightBefore = stats.height();
         erase(k);
         
-        // Remove from all_keys
-        auto it = std::find(all_keys.begin(), all_keys.end(), k);
-        if (it != all_keys.end()) {
-            all_keys.erase(it);
-        }
-        
-        // Check if any nodes need rebalancing after deletion
-        // This is where merge animations would be added
-        if (root && root->keys.empty() && !root->leaf && !root->children.empty()) {
-            // Root became empty, promote its only child
+        if (root && stats.height() < heightBefore) {
+            // Root was emptied by a merge and its only child promoted
             AnimationStep promoteAnim;
             promoteAnim.type = AnimationType::NodeOperation;
             promoteAnim.duration = 0.8f;
-            promoteAnim.operationNode = root->children[0];
+            promoteAnim.operationNode = root;
             promoteAnim.operation = AnimationStep::BalanceTree;
             promoteAnim.completed = false;
             addAnimationStep(promoteAnim);
-            
-            Node* oldRoot = root;
-            root = root->children[0];
-            oldRoot->children.clear();
-            delete oldRoot;
         }
     }
 }
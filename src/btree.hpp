@@ -1,6 +1,8 @@
 #ifndef BTREE_HPP
 #define BTREE_HPP
 
+#include <climits>
+#include <cstdint>
 #include <vector>
 #include <memory>
 #include <functional>
@@ -8,23 +10,138 @@
 #include <unordered_map>
 #include <raylib.h>
 
+class FrozenBTree;
+class ThreadPool;
+
 class BTree {
 public:
+    struct Stats;
+    struct Node;
+
+    // Memory access recording for the cache simulator (cache_sim.hpp).
+    // While a log is installed on the calling thread, search, insertNonFull
+    // and splitChild append every part of a node they read or write. Header
+    // is the node object itself (leaf flag and array bookkeeping).
+    enum class NodePart : uint8_t { Header, Keys, Values, Counts, Children };
+    struct NodeAccess {
+        const Node* node;
+        uintptr_t address;   // of the first byte, in this process
+        uint32_t offset;     // from the start of the part
+        uint32_t bytes;
+        NodePart part;
+    };
+    // nullptr stops recording. The log belongs to the calling thread.
+    static void setAccessLog(std::vector<NodeAccess>* log) { accessLog = log; }
+
+    // Payload stored with each key. Eight bytes, so larger payloads are kept
+    // elsewhere and referenced by a handle or index stored here.
+    using Value = std::int64_t;
+
+    // Count, sum, smallest and largest of a set of keys, each key counted
+    // with its occurrences. min > max when empty.
+    struct Aggregate {
+        uint64_t count = 0;
+        int64_t sum = 0;
+        int min = INT_MAX;
+        int max = INT_MIN;
+
+        void add(int key, uint32_t occurrences) {
+            count += occurrences;
+            sum += (int64_t)key * occurrences;
+            if (key < min) min = key;
+            if (key > max) max = key;
+        }
+        Aggregate& operator+=(const Aggregate& other) {
+            count += other.count;
+            sum += other.sum;
+            if (other.min < min) min = other.min;
+            if (other.max > max) max = other.max;
+            return *this;
+        }
+    };
+
     struct Node {
         bool leaf;
+        // Whether agg is kept up to date; mirrors the tree's setAggregates
+        bool augmented = false;
+        // Packed leaf, see setLeafCompression: keys is empty and the keys
+        // are offsets from packedBase, packedWidth bits each, in packedKeys.
+        // values is empty when every value is 0, counts when every count is 1.
+        bool packed = false;
+        uint8_t packedWidth = 0;
         int t; 
         std::vector<int> keys;
+        // values[i] belongs to keys[i]. Kept in its own array so searches
+        // only pull key cache lines.
+        std::vector<Value> values;
+        // Occurrences of keys[i]; always 1 unless the tree is a multiset
+        std::vector<uint32_t> counts;
         std::vector<Node*> children;
 
+        // Sampled accesses, see setHeatTracking. Stored as of heatEpoch and
+        // halved for every epoch since, lazily.
+        mutable uint32_t heat = 0;
+        mutable uint32_t heatEpoch = 0;
+
+        uint16_t packedSize = 0;
+        int packedBase = 0;
+        std::unique_ptr<uint32_t[]> packedKeys;
+
+        // The subtree's keys, while augmented
+        Aggregate agg;
+        // Recomputes agg from the node's keys and its children's agg, O(t)
+        void sumSubtree();
+
         Node(int _t, bool _leaf);
         ~Node();
 
         void traverse(const std::function<void(Node*, int, int)>& cb, int depth = 0);
         Node* search(int k);
 
-        
-        void insertNonFull(int k);
-        void splitChild(int idx, Node* y);
+        // Slot access for packed and unpacked nodes alike
+        size_t keyCount() const { return packed ? packedSize : keys.size(); }
+        int keyAt(size_t i) const { return packed ? packedKey(i) : keys[i]; }
+        uint32_t countAt(size_t i) const { return counts.empty() ? 1 : counts[i]; }
+        Value valueAt(size_t i) const { return values.empty() ? 0 : values[i]; }
+        // Index of the first key >= k
+        size_t lowerBound(int k) const;
+
+        // Leaf packing. Keys use a frame of reference (offsets from the
+        // smallest key, just wide enough for the largest) stored vertically:
+        // slot i sits in lane i % 4, so four offsets decode at once with
+        // the same shifts and compare against k in one SIMD step.
+        void pack();
+        void unpack();
+        int packedKey(size_t i) const;
+        size_t packedWords() const;
+        size_t packedLowerBound(int k) const;
+
+        // Bytes held by the node and its arrays, counting unused capacity
+        size_t memoryBytes() const;
+
+        // Records [offset, offset + bytes) of a part if an access log is installed
+        void touch(NodePart part, size_t offset, size_t bytes) const {
+            if (accessLog) logAccess(part, offset, bytes);
+        }
+        void logAccess(NodePart part, size_t offset, size_t bytes) const;
+
+        // level is the height above the leaves (0 for a leaf); both keep
+        // stats in step with what they change
+        void insertNonFull(int k, Value v, uint32_t count, Stats& stats, int level);
+        void splitChild(int idx, Node* y, Stats& stats, int childLevel);
+    };
+
+    // Shape of the tree, updated by every insert, split, merge and erase so
+    // reading it costs nothing
+    struct Stats {
+        size_t keys = 0;          // distinct keys, one slot each
+        size_t occurrences = 0;   // keys counted with multiplicity
+        size_t nodes = 0;
+        size_t leaves = 0;
+        size_t nodeBytes = 0;     // Node::memoryBytes summed over the tree
+        std::vector<size_t> levelNodes;   // nodes per level, leaves first
+
+        int height() const { return (int)levelNodes.size(); }
     };
 
     // Animation structures
@@ -50,6 +167,10 @@ public:
         Node* targetNode;
         int targetIndex;
         bool needsRecalculation; // Recalculate end position based on tree state
+        // For a rotation (operation BalanceTree): the slot the key left.
+        // Views place both ends from their own layout.
+        Node* sourceNode = nullptr;
+        int sourceIndex = -1;
         
         // For NodeSplitting/NodeOperation
         Node* operationNode;
@@ -64,10 +185,15 @@ public:
             DeleteKey,
             SplitNode,
             MergeNode,
-            BalanceTree
-        } operation;
+            BalanceTree,  // Root promotion, or KeyMoving through a parent under B*
+            SearchKey,    // KeyHighlight along a search path, see searchAnimated
+            SplitTree,    // KeyHighlight along the cut of a split
+            JoinTree,     // KeyHighlight along the seam of a join
+            EraseRange    // NodeOperation removing keysToAnimate.front()..back()
+        } operation = None;
         
         int operationKey; // The key involved in the operation
+        Value operationValue = 0; // Value inserted with it
         
         // For highlighting
         Node* highlightNode;
@@ -75,16 +201,135 @@ public:
         Color highlightColor;
     };
 
-    BTree(int t = 2);
+    // Where the keys equal to k are. Equal keys share one slot, so the run
+    // is that slot and its occurrence count (0 and no node when absent).
+    struct EqualRange {
+        Node* node = nullptr;
+        int index = -1;
+        uint32_t count = 0;
+    };
+
+    // A multiset stores each distinct key once with an occurrence count, so
+    // memory grows with distinct keys rather than with inserts
+    explicit BTree(int t = 2, bool multiset = false);
     ~BTree();
 
-    void insert(int k);
+    bool isMultiset() const { return multiset; }
+
+    // Inserting a key that is already present adds an occurrence in a
+    // multiset and does nothing otherwise. Both return whether the key is new.
+    bool insert(int k);
+    // Map operations. insert leaves an existing key's value alone and returns
+    // false; upsert overwrites it and returns whether the key was new.
+    bool insert(int k, Value v);
+    bool upsert(int k, Value v);
+    // Pointer to the key's value, or nullptr. Valid until the next change.
+    Value* find(int k);
+    const Value* find(int k) const;
     bool contains(int k) const;
+    // Batched lookups of keys[0..n): found[i] / values[i] answer keys[i] and
+    // are resized to n. Up to BatchWidth searches run interleaved, each
+    // prefetching its next node while the others work, so a tree much larger
+    // than the cache waits on memory once per round rather than once per
+    // level of every key.
+    static constexpr int BatchWidth = 16;
+    void containsBatch(const int* keys, size_t n, std::vector<bool>& found) const;
+    void findBatch(const int* keys, size_t n, std::vector<Value*>& values);
+    void findBatch(const int* keys, size_t n, std::vector<const Value*>& values) const;
+    uint32_t count(int k) const;
+    EqualRange equal_range(int k) const;
+    // Read-only copy of the keys in a pointer-free layout for fast lookups
+    // (frozen_btree.hpp); FrozenBTree::refresh rebuilds it after changes
+    FrozenBTree freeze() const;
+    // Removes one occurrence of k; the key goes once none are left.
+    // O(t log n) in the tree, plus O(n) to drop it from the insertion order.
     void erase(int k); 
+    // Removes every key in [lo, hi] with all its occurrences. The tree is
+    // split at lo and hi, the middle dropped whole and the outer parts
+    // joined, so only the two boundary paths are restructured: O(t log n)
+    // plus the nodes removed, and one pass over the insertion order.
+    // Returns the number of keys removed.
+    size_t eraseRange(int lo, int hi);
+    // Removes the listed keys with all their occurrences. Listed keys that
+    // are neighbours in the tree go together as one range. Returns the
+    // number of keys removed.
+    size_t eraseBatch(std::vector<int> keys);
+
+    // Moves every key >= pivot into right, which is cleared first and takes
+    // this tree's degree and mode. Only the nodes on pivot's search path are
+    // cut and reglued; every subtree hanging off that path changes owner as
+    // it is. O(t log n) in the tree; splitting the stats walks the smaller
+    // half, and the insertion order takes one pass.
+    void split(int pivot, BTree& right);
+    // Appends right's keys, which must all be greater than this tree's, and
+    // leaves right empty. The shorter tree is grafted into the taller one's
+    // spine at its own height, reusing every node of both: O(t log n), plus
+    // appending right's insertion order. Returns false, changing nothing, if
+    // the degrees or modes differ or the key ranges overlap.
+    bool join(BTree& right);
+    // Smallest and largest key; false when empty
+    bool minKey(int& key) const;
+    bool maxKey(int& key) const;
 
     void clear();
     
     void clearAll();
+
+    // Replaces the contents with keys (any order, duplicates dropped),
+    // building the tree bottom-up with every node evenly filled. O(n log n)
+    // for the sort, O(n) for the build.
+    void bulkLoad(std::vector<int> keys);
+    // Same with a value per key; the first value wins for duplicate keys,
+    // which a multiset counts
+    void bulkLoad(std::vector<int> keys, std::vector<Value> values);
+    // Same result, built across pool: a sample sort over (key, position)
+    // pairs, deduplication per key range, then every level of nodes split
+    // between the threads. Inputs under 64Ki keys take the serial path.
+    void bulkLoad(std::vector<int> keys, std::vector<Value> values, ThreadPool& pool);
+    // Changes the minimum degree and rebuilds the current keys with bulkLoad
+    void setDegree(int newT);
+
+    // Subtree aggregates. While on, every node keeps the count, sum, min
+    // and max of its subtree's keys through inserts, splits, erases, merges,
+    // borrows, bulk loads, split and join, at O(1) per level on insert and
+    // O(t) per changed node otherwise. Turning them on is one O(n) pass;
+    // off, nodes skip the upkeep.
+    void setAggregates(bool enabled);
+    bool hasAggregates() const { return aggregates; }
+    // Order statistics over occurrences: the key at 0-based position k in
+    // sorted order (false when k >= size), and how many occurrences are
+    // below key. O(t log n) with aggregates on; a full walk without.
+    bool select(uint64_t k, int& key) const;
+    uint64_t rank(int key) const;
+    // Aggregate over the keys in [lo, hi]. Subtrees entirely inside the
+    // range are taken whole from their agg, so only the two boundary paths
+    // are visited: O(t log n) with aggregates on, a full walk without.
+    Aggregate rangeAggregate(int lo, int hi) const;
+
+    // Leaf compression for large trees that are mostly searched. Turning it
+    // on packs every leaf (see Node::pack): keys shrink to their offset
+    // width, and all-zero values and all-one counts are dropped. Lookups,
+    // count, equal_range, order statistics and minKey/maxKey read packed
+    // leaves in place. insert, upsert and erase unpack only the leaves they
+    // change and pack them again before returning; find unpacks its leaf
+    // until the next change. Everything else that edits or hands out nodes
+    // (traverse, findBatch, split, join, range erase, the animations)
+    // unpacks every leaf first, and compressLeaves() packs them again.
+    void setLeafCompression(bool enabled);
+    bool hasLeafCompression() const { return leafCompression; }
+    void compressLeaves();
+    size_t packedLeafCount() const { return packedLeaves; }
+
+    // B* insertion. A full child met on the way down first shifts keys
+    // through the parent into an adjacent sibling with room, evening the
+    // pair out. Only when its neighbours are (nearly) full too are two
+    // nodes split into three, each about two thirds full. A full root still
+    // splits in two. Nodes stay fuller than the half-full halves of a plain
+    // split, so the tree is smaller and often shorter, for a sibling read
+    // per full child. Erase, bulk load, split and join are unchanged.
+    void setBStar(bool enabled) { bStar = enabled; }
+    bool isBStar() const { return bStar; }
+    int getDegree() const { return t; }
     
     int getLastInsertedKey() const { return all_keys.empty() ? -1 : all_keys.back(); }
     bool hasKeys() const { return !all_keys.empty(); }
@@ -94,6 +339,36 @@ public:
 
     Node* getRoot() const { return root; }
     
+    // Bumped on every change to the tree so views can cache derived data
+    uint64_t getVersion() const { return version; }
+
+    const Stats& getStats() const { return stats; }
+
+    // Access heat. When enabled, every sampleEvery-th lookup (contains,
+    // find, count, equal_range) and insert adds one to each node on its
+    // root-to-key path. Counters halve every halfLife samples, so the heat
+    // follows the recent workload. Off by default; when off the only cost
+    // is a branch per operation.
+    struct HotNode {
+        const Node* node;
+        int depth;
+        size_t position;    // left-to-right index among the nodes at depth
+        uint32_t heat;
+    };
+    void setHeatTracking(bool enabled, uint32_t sampleEvery = 1, uint32_t halfLife = 4096);
+    bool heatTracking() const { return heatState.enabled; }
+    uint64_t heatSamples() const { return heatState.samples; }
+    // Current, decayed heat of a node
+    uint32_t heatOf(const Node* node) const;
+    // The `limit` hottest nodes, hottest first. Walks the tree.
+    std::vector<HotNode> hotNodes(size_t limit) const;
+    // Keys over key slots in all nodes, 2t - 1 each
+    double fillFactor() const;
+    // Everything the tree holds on the heap and inline: nodes with their
+    // vector slack, the insertion-order list and the key position table
+    size_t memoryBytes() const;
+    double bytesPerKey() const;
+    
     // Animation methods
     void updateAnimation(float deltaTime);
     bool isAnimating() const { return !animationQueue.empty() || !currentAnimations.empty(); }
@@ -107,15 +382,59 @@ public:
     
     // Node position tracking
     std::unordered_map<Node*, std::vector<Vector2>> nodeKeyPositions;
+    void clearKeyPositions();
+    size_t keyPositionBytes() const;
     
     // Animated insert/delete
-    void insertAnimated(int k);
+    void insertAnimated(int k, Value v = 0);
     void eraseAnimated(int k);
+    // The keys in [lo, hi] fade out together, then go with one eraseRange
+    void eraseRangeAnimated(int lo, int hi);
+    // Highlights each node on k's search path in turn, then k itself (green)
+    // or, if absent, the leaf where the search ended (red). Changes nothing.
+    void searchAnimated(int k);
+    // Highlights pivot's search path, where split(pivot) cuts. Changes nothing.
+    void splitPathAnimated(int pivot);
+    // Highlights the path to the seam a join left: key, the smallest key
+    // that came from the right tree
+    void joinSeamAnimated(int key);
 
 private:
     Node* root;
     int t;
+    bool multiset;
     std::vector<int> all_keys;
+    uint64_t version = 0;
+    Stats stats;
+    bool aggregates = false;
+    bool leafCompression = false;
+    bool bStar = false;
+    size_t packedLeaves = 0;
+    // Leaves unpacked during the current change, packed again by settle
+    std::vector<Node*> thawed;
+    size_t keyPositionArrays = 0;   // bytes in nodeKeyPositions' vectors
+    static thread_local std::vector<NodeAccess>* accessLog;
+
+    struct HeatState {
+        bool enabled = false;
+        uint32_t sampleEvery = 1;
+        uint32_t halfLife = 4096;
+        uint32_t skipped = 0;       // operations since the last sample
+        uint32_t epoch = 0;
+        uint32_t inEpoch = 0;       // samples in the current epoch
+        uint64_t samples = 0;
+    };
+    mutable HeatState heatState;
+    // Samples the path to k if heat tracking is on and this op is due
+    void sampleHeat(int k) const {
+        if (heatState.enabled && ++heatState.skipped >= heatState.sampleEvery) touchPath(k);
+    }
+    void touchPath(int k) const;
+
+    // Runs the interleaved searches behind the batch lookups and calls
+    // done(i, node, index) for keys[i], with a null node when it is absent
+    template <typename Done>
+    void searchBatch(const int* keys, size_t n, Done&& done) const;
     
     // Animation state
     std::queue<AnimationStep> animationQueue;
@@ -124,11 +443,95 @@ private:
     
     void addAnimationStep(const AnimationStep& step);
     void processNextAnimation();
+    // Queues a whole-node highlight for each node on k's search path and
+    // returns the last one, with k's index in it or -1
+    Node* highlightPath(int k, AnimationStep::Operation operation, Color color, int& index);
     
     // Internal methods for actual operations (called after animation)
-    void insertInternal(int k);
-    void insertNonFullWithAnimation(Node* node, int k);
+    void insertInternal(int k, Value v);
+    void insertNonFullWithAnimation(Node* node, int k, Value v, int level);
+    void insertEntry(int k, Value v, uint32_t count);
+    // B* insertion below x, which is not full; level is x's
+    void insertBStar(Node* x, int k, Value v, uint32_t count, int level);
+    // Makes room in x's full child i by a shift or a 2-to-3 split, queueing
+    // its animation if animate; returns the index of the child k goes to
+    int makeRoom(Node* x, int i, int k, int childLevel, bool animate);
+    // Moves n entries across x's separator i: from child i + 1 to child i
+    // when n > 0, from child i to child i + 1 when n < 0
+    void shiftEntries(Node* x, int i, int n);
+    // Splits x's children i and i + 1, full or one short, into three
+    void splitThree(Node* x, int i, int childLevel);
+    // Leaf compression. thaw unpacks a leaf and queues it for settle, which
+    // packs the queue and the leaves beside k's when compression is on.
+    // forget drops a leaf about to be deleted from the queue.
+    void thaw(Node* leaf);
+    void packLeaf(Node* leaf);
+    void forget(Node* node);
+    void settle(int k);
+    void unpackAll();
+    void packAll(Node* x);
+    void unpackAll(Node* x);
+    // Accounts for a new root above the current one
+    void growRoot(Node* newRoot);
+    // Adds an occurrence to a present key; false when k is absent
+    bool addOccurrence(int k);
+    // Keys in order with their values and counts
+    void collect(std::vector<int>& keys, std::vector<Value>& values, std::vector<uint32_t>& counts) const;
+    // Builds the tree bottom-up from sorted distinct keys and the stats
+    // with it; each level's nodes are independent, so pool (if any) splits
+    // them between its threads
+    void build(const std::vector<int>& keys, const std::vector<Value>& values, const std::vector<uint32_t>& counts,
+               ThreadPool* pool = nullptr);
+
+    // Deletion. eraseFrom removes k's slot from the subtree at x, making
+    // sure every node it descends into has at least t keys first.
+    void eraseFrom(Node* x, int k, int level);
+    void mergeChildren(Node* x, int i, int childLevel);
+    void borrowFromLeft(Node* x, int i);
+    void borrowFromRight(Node* x, int i);
+    void removeSlot(Node* x, int i);
     void eraseInternal(int k);
+
+    // Split and join work on pieces: subtrees with a height in levels (0
+    // when empty) whose root may hold any number of keys. A node's level is
+    // its height above the leaves, which cutting and gluing never change,
+    // so stats stay exact throughout.
+    struct Piece {
+        Node* root = nullptr;
+        int height = 0;
+    };
+    struct Entry {
+        int key;
+        Value value;
+        uint32_t count;
+    };
+    Node* makeNode(bool leaf, int level);
+    // Frees the node alone; its children are left to the caller
+    void freeNode(Node* node, int level);
+    // Frees a whole subtree; returns the keys it held
+    size_t dropSubtree(Node* node, int level);
+    // Strips roots left without keys
+    Piece normalize(Piece p);
+    // Cuts p into keys < k and keys > k; k's own slot goes to mid if present
+    void splitPiece(Piece p, int k, Piece& left, Entry& mid, bool& found, Piece& right);
+    // a's keys, then sep, then b's
+    Piece joinPieces(Piece a, const Entry& sep, Piece b);
+    // Without a separator b's smallest entry is cut out to act as one
+    Piece joinPieces(Piece a, Piece b);
+    // Tops up children i and i + 1 of x, one of which may be a former root
+    void balancePair(Node* x, int i, int childLevel);
+    // Tree and stats side of eraseRange; all_keys is left to the caller
+    size_t eraseRangeFromTree(int lo, int hi);
+    // Smallest key >= k
+    bool firstKeyFrom(int k, int& key) const;
+    // Sets augmented on the subtree at x and recomputes its aggregates
+    void markAggregates(Node* x, bool enabled);
+    // Adds delta occurrences of present key k to the aggregates on its path
+    void adjustPathCount(int k, int64_t delta);
+    void rangeAggregate(const Node* x, int lo, int hi, Aggregate& out) const;
+    // Counts the stats of whichever of a and b has fewer nodes, walking
+    // both in step so the cost is bounded by the smaller; true if it was a
+    static bool countSmaller(Piece a, Piece b, Stats& counted);
     Node* findInsertionNode(int k, std::vector<Node*>& path);
 };
 
@@ -0,0 +1,222 @@
+#include "cache_sim.hpp"
+#include <algorithm>
+#include <cstdio>
+#include "trace.hpp"
+#include "tuning.hpp"
+
+namespace {
+
+const int Sweep[] = {2, 3, 4, 6, 8, 12, 16, 32, 64};
+const NodeLayout Layouts[] = {NodeLayout::Heap, NodeLayout::Inline, NodeLayout::HotCold};
+constexpr int LayoutCount = 3;
+
+// Modeled nodes start with a leaf flag and key count
+constexpr uint64_t HeaderBytes = 16;
+// Pool bases for modeled layouts, far apart so pools never overlap
+constexpr uint64_t HotPool = 1ull << 40;
+constexpr uint64_t ColdPool = 1ull << 44;
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+double perOp(uint64_t count, uint64_t ops) {
+    return ops ? (double)count / (double)ops : 0.0;
+}
+
+} // namespace
+
+SetAssociativeCache::SetAssociativeCache(const CacheShape& shape)
+    : geometry(shape), sets(shape.blocks / shape.ways),
+      tags(shape.blocks, 0), lastUse(shape.blocks, 0) {
+    while (((size_t)1 << blockShift) < shape.blockBytes) ++blockShift;
+}
+
+bool SetAssociativeCache::access(uint64_t address) {
+    uint64_t block = address >> blockShift;
+    size_t base = (size_t)(block % sets) * geometry.ways;
+    ++clock;
+    size_t victim = base;
+    for (size_t way = base; way < base + geometry.ways; ++way) {
+        if (tags[way] == block + 1) {
+            lastUse[way] = clock;
+            return true;
+        }
+        if (lastUse[way] < lastUse[victim]) victim = way;
+    }
+    // Empty ways have never been used, so they go first
+    tags[victim] = block + 1;
+    lastUse[victim] = clock;
+    return false;
+}
+
+const char* layoutName(NodeLayout layout) {
+    switch (layout) {
+    case NodeLayout::Heap: return "heap";
+    case NodeLayout::Inline: return "inline";
+    case NodeLayout::HotCold: return "hot/cold";
+    }
+    return "?";
+}
+
+MissCounts& MissCounts::operator+=(const MissCounts& other) {
+    ops += other.ops;
+    lines += other.lines;
+    cacheMisses += other.cacheMisses;
+    tlbMisses += other.tlbMisses;
+    return *this;
+}
+
+MemorySim::MemorySim(NodeLayout layout, int t, const CacheShape& cacheShape, const CacheShape& tlbShape)
+    : nodeLayout(layout), cache(cacheShape), tlb(tlbShape) {
+    using Part = BTree::NodePart;
+    uint64_t maxKeys = (uint64_t)(2 * t - 1);
+    uint64_t line = cacheShape.blockBytes;
+    uint64_t* off = partOffset;
+    if (layout == NodeLayout::Inline) {
+        off[(int)Part::Keys] = HeaderBytes;
+        off[(int)Part::Values] = alignUp(HeaderBytes + maxKeys * sizeof(int), sizeof(BTree::Value));
+        off[(int)Part::Counts] = off[(int)Part::Values] + maxKeys * sizeof(BTree::Value);
+        off[(int)Part::Children] = alignUp(off[(int)Part::Counts] + maxKeys * sizeof(uint32_t), sizeof(void*));
+        hotSlotBytes = alignUp(off[(int)Part::Children] + (maxKeys + 1) * sizeof(void*), line);
+    } else if (layout == NodeLayout::HotCold) {
+        off[(int)Part::Keys] = HeaderBytes;
+        off[(int)Part::Children] = alignUp(HeaderBytes + maxKeys * sizeof(int), sizeof(void*));
+        hotSlotBytes = alignUp(off[(int)Part::Children] + (maxKeys + 1) * sizeof(void*), line);
+        off[(int)Part::Values] = 0;
+        off[(int)Part::Counts] = maxKeys * sizeof(BTree::Value);
+        coldSlotBytes = alignUp(off[(int)Part::Counts] + maxKeys * sizeof(uint32_t), line);
+    }
+}
+
+uint64_t MemorySim::address(const BTree::NodeAccess& access) {
+    if (nodeLayout == NodeLayout::Heap) return access.address;
+    uint64_t slot = slots.emplace(access.node, slots.size()).first->second;
+    bool cold = nodeLayout == NodeLayout::HotCold &&
+                (access.part == BTree::NodePart::Values || access.part == BTree::NodePart::Counts);
+    uint64_t base = cold ? ColdPool + slot * coldSlotBytes : HotPool + slot * hotSlotBytes;
+    // The modeled header is always the first HeaderBytes of the slot
+    uint64_t offset = access.part == BTree::NodePart::Header ? 0 : access.offset;
+    return base + partOffset[(int)access.part] + offset;
+}
+
+MissCounts MemorySim::run(const std::vector<BTree::NodeAccess>& accesses, std::vector<NodeMisses>* missed) {
+    MissCounts op;
+    op.ops = 1;
+    uint64_t lineBytes = cache.shape().blockBytes;
+    for (const auto& access : accesses) {
+        uint64_t begin = address(access);
+        uint64_t bytes = nodeLayout != NodeLayout::Heap && access.part == BTree::NodePart::Header ? HeaderBytes : access.bytes;
+        uint32_t cacheMisses = 0, tlbMisses = 0;
+        for (uint64_t line = begin / lineBytes; line <= (begin + bytes - 1) / lineBytes; ++line) {
+            ++op.lines;
+            if (!tlb.access(line * lineBytes)) ++tlbMisses;
+            if (!cache.access(line * lineBytes)) ++cacheMisses;
+        }
+        op.cacheMisses += cacheMisses;
+        op.tlbMisses += tlbMisses;
+        if (!missed || (cacheMisses == 0 && tlbMisses == 0)) continue;
+        auto it = std::find_if(missed->begin(), missed->end(),
+                               [&](const NodeMisses& m) { return m.node == access.node; });
+        if (it == missed->end()) {
+            missed->push_back(NodeMisses{access.node, cacheMisses, tlbMisses});
+        } else {
+            it->cacheMisses += cacheMisses;
+            it->tlbMisses += tlbMisses;
+        }
+    }
+    totals += op;
+    return op;
+}
+
+CacheShape sweepCacheShape(const CacheShape& given) {
+    if (given.blocks) return given;
+    CacheInfo info = readCacheInfo();
+    CacheShape shape;
+    shape.ways = 16;
+    shape.blockBytes = info.lineSize;
+    shape.blocks = std::max<size_t>(info.l2 / info.lineSize / shape.ways, 1) * shape.ways;
+    return shape;
+}
+
+CacheShape sweepTlbShape(const CacheShape& given) {
+    return given.blocks ? given : CacheShape{64, 4, 4096};
+}
+
+CacheShape visualizerCacheShape(const CacheShape& given) {
+    return given.blocks ? given : CacheShape{64, 4, 64};
+}
+
+CacheShape visualizerTlbShape(const CacheShape& given) {
+    return given.blocks ? given : CacheShape{8, 8, 4096};
+}
+
+int runCacheSim(const AppOptions& options) {
+    CacheShape cacheShape = sweepCacheShape(options.simCache);
+    CacheShape tlbShape = sweepTlbShape(options.simTlb);
+    std::printf("[cachesim] cache %zu KiB, %zu-way, %zu B lines; TLB %zu entries, %zu-way, %zu KiB pages\n",
+                cacheShape.blocks * cacheShape.blockBytes / 1024, cacheShape.ways, cacheShape.blockBytes,
+                tlbShape.blocks, tlbShape.ways, tlbShape.blockBytes / 1024);
+
+    // Simulation costs far more per operation than the real thing, so the
+    // synthetic workload is smaller than the tuning sweep's
+    std::vector<TraceOp> ops;
+    if (!loadWorkload(options, options.tuneKeys ? options.tuneKeys : 1 << 17, "cachesim", ops)) return 1;
+
+    struct Row {
+        int t;
+        NodeLayout layout;
+        MissCounts all;
+        MissCounts byType[3];
+    };
+    std::vector<Row> rows;
+    std::printf("[cachesim] %4s %9s %9s %9s %9s %11s %11s %11s\n",
+                "t", "layout", "lines/op", "miss/op", "TLB/op", "insert miss", "lookup miss", "erase miss");
+
+    std::vector<BTree::NodeAccess> log;
+    BTree::setAccessLog(&log);
+    for (int t : Sweep) {
+        BTree tree(t, options.multiset);
+        tree.setBStar(options.bStar);
+        std::vector<MemorySim> sims;
+        for (NodeLayout layout : Layouts) sims.emplace_back(layout, t, cacheShape, tlbShape);
+        MissCounts byType[LayoutCount][3];
+
+        for (const TraceOp& op : ops) {
+            log.clear();
+            switch (op.type) {
+            case TraceOp::Insert: tree.insert(op.key); break;
+            case TraceOp::Erase: tree.erase(op.key); break;
+            case TraceOp::Lookup: tree.contains(op.key); break;
+            }
+            for (int l = 0; l < LayoutCount; ++l) byType[l][op.type] += sims[l].run(log);
+        }
+
+        for (int l = 0; l < LayoutCount; ++l) {
+            Row row{t, Layouts[l], sims[l].counts(), {byType[l][0], byType[l][1], byType[l][2]}};
+            const MissCounts& all = row.all;
+            std::printf("[cachesim] %4d %9s %9.2f %9.3f %9.3f %11.3f %11.3f %11.3f\n",
+                        t, layoutName(row.layout), perOp(all.lines, all.ops), perOp(all.cacheMisses, all.ops),
+                        perOp(all.tlbMisses, all.ops),
+                        perOp(row.byType[TraceOp::Insert].cacheMisses, row.byType[TraceOp::Insert].ops),
+                        perOp(row.byType[TraceOp::Lookup].cacheMisses, row.byType[TraceOp::Lookup].ops),
+                        perOp(row.byType[TraceOp::Erase].cacheMisses, row.byType[TraceOp::Erase].ops));
+            rows.push_back(row);
+        }
+        std::fflush(stdout);
+    }
+    BTree::setAccessLog(nullptr);
+
+    auto fewest = [&](uint64_t MissCounts::*field) {
+        return &*std::min_element(rows.begin(), rows.end(), [&](const Row& a, const Row& b) {
+            return perOp(a.all.*field, a.all.ops) < perOp(b.all.*field, b.all.ops);
+        });
+    };
+    const Row* cacheBest = fewest(&MissCounts::cacheMisses);
+    const Row* tlbBest = fewest(&MissCounts::tlbMisses);
+    std::printf("[cachesim] fewest cache misses: %s nodes at t = %d (%.3f per op); "
+                "fewest TLB misses: %s nodes at t = %d (%.3f per op)\n",
+                layoutName(cacheBest->layout), cacheBest->t, perOp(cacheBest->all.cacheMisses, cacheBest->all.ops),
+                layoutName(tlbBest->layout), tlbBest->t, perOp(tlbBest->all.tlbMisses, tlbBest->all.ops));
+    return 0;
+}
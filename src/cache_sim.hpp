@@ -0,0 +1,98 @@
+#ifndef CACHE_SIM_HPP
+#define CACHE_SIM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "btree.hpp"
+#include "options.hpp"
+
+// Set-associative cache with LRU replacement over fixed-size blocks: cache
+// lines for a data cache, pages for a TLB.
+class SetAssociativeCache {
+public:
+    explicit SetAssociativeCache(const CacheShape& shape);
+
+    // Looks up the block holding address and makes it the most recent in
+    // its set; true on a hit
+    bool access(uint64_t address);
+    const CacheShape& shape() const { return geometry; }
+
+private:
+    CacheShape geometry;
+    size_t sets;
+    unsigned blockShift = 0;
+    std::vector<uint64_t> tags;      // sets x ways; block number + 1, 0 when empty
+    std::vector<uint64_t> lastUse;   // sets x ways
+    uint64_t clock = 0;
+};
+
+// Where the parts of a node live
+enum class NodeLayout {
+    Heap,      // as the tree allocates them: the node object and four separate
+               // arrays, at the recorded addresses
+    Inline,    // one line-aligned pool slot per node with header, keys,
+               // values, counts and children back to back
+    HotCold    // header, keys and children in one pool slot; values and
+               // counts in a slot of a second pool
+};
+const char* layoutName(NodeLayout layout);
+
+struct MissCounts {
+    uint64_t ops = 0;
+    uint64_t lines = 0;         // cache line accesses, one TLB lookup each
+    uint64_t cacheMisses = 0;
+    uint64_t tlbMisses = 0;
+
+    MissCounts& operator+=(const MissCounts& other);
+};
+
+// Misses caused by one node during one operation
+struct NodeMisses {
+    const BTree::Node* node;
+    uint32_t cacheMisses;
+    uint32_t tlbMisses;
+};
+
+// Replays node accesses recorded with BTree::setAccessLog through a cache
+// and a TLB as if the nodes had the given layout. Pool slots are handed out
+// in the order nodes are first seen, like a bump allocator; modeled layouts
+// reserve room for 2t - 1 keys. Erase is only seen through its search.
+class MemorySim {
+public:
+    MemorySim(NodeLayout layout, int t, const CacheShape& cache, const CacheShape& tlb);
+
+    // Runs one operation's accesses and returns its counts; nodes that
+    // missed are added to missed if given
+    MissCounts run(const std::vector<BTree::NodeAccess>& accesses, std::vector<NodeMisses>* missed = nullptr);
+    const MissCounts& counts() const { return totals; }
+    NodeLayout layout() const { return nodeLayout; }
+
+private:
+    NodeLayout nodeLayout;
+    SetAssociativeCache cache, tlb;
+    MissCounts totals;
+
+    uint64_t partOffset[5] = {};     // by BTree::NodePart, within its slot
+    uint64_t hotSlotBytes = 0, coldSlotBytes = 0;
+    std::unordered_map<const BTree::Node*, uint64_t> slots;
+
+    uint64_t address(const BTree::NodeAccess& access);
+};
+
+// Shapes used when none were given: the host's L2 with 16 ways and a
+// 64-entry 4-way TLB of 4 KiB pages for the sweep, and a small 4 KiB cache
+// with an 8-entry TLB for the visualizer, whose trees fit any real cache
+CacheShape sweepCacheShape(const CacheShape& given);
+CacheShape sweepTlbShape(const CacheShape& given);
+CacheShape visualizerCacheShape(const CacheShape& given);
+CacheShape visualizerTlbShape(const CacheShape& given);
+
+// Runs the workload (the --replay trace if given, otherwise random inserts
+// and lookups) against trees of a sweep of minimum degrees, feeds every
+// operation's node accesses to each layout's cache and TLB, and prints
+// lines touched and misses per operation. Returns the process exit code.
+int runCacheSim(const AppOptions& options);
+
+#endif
@@ -0,0 +1,109 @@
+#include "frame_writer.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+FrameWriter::~FrameWriter() {
+    std::string ignored;
+    finish(ignored);
+}
+
+bool FrameWriter::open(const std::string& path, Format fmt, unsigned threads, std::string& error) {
+    std::error_code ec;
+    std::filesystem::create_directories(path, ec);
+    if (ec) {
+        error = "cannot create " + path + ": " + ec.message();
+        return false;
+    }
+    dir = path;
+    format = fmt;
+    next = 0;
+    failure.clear();
+    stopping = false;
+    if (format == Format::Raw) {
+        std::string file = dir + "/frames.rgba";
+        raw = std::fopen(file.c_str(), "wb");
+        if (!raw) {
+            error = "cannot write " + file;
+            return false;
+        }
+        threads = 1;
+    }
+#if FRAME_WRITER_THREADED
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    maxQueued = MaxQueued * threads;
+    for (unsigned i = 0; i < threads; ++i) workers.emplace_back(&FrameWriter::work, this);
+#else
+    (void)threads;
+#endif
+    return true;
+}
+
+void FrameWriter::write(Image frame) {
+    Job job{next++, frame};
+#if FRAME_WRITER_THREADED
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        room.wait(lock, [&] { return queue.size() < maxQueued; });
+        queue.push_back(job);
+    }
+    ready.notify_one();
+#else
+    if (!encode(job) && failure.empty()) failure = "cannot write frame " + std::to_string(job.index);
+#endif
+}
+
+bool FrameWriter::finish(std::string& error) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (auto& worker : workers) worker.join();
+    workers.clear();
+    if (raw) {
+        if (std::fclose(raw) != 0 && failure.empty()) failure = "cannot write " + dir + "/frames.rgba";
+        raw = nullptr;
+    }
+    error = failure;
+    return failure.empty();
+}
+
+void FrameWriter::work() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [&] { return stopping || !queue.empty(); });
+            // Stopping still drains whatever was queued before
+            if (queue.empty()) return;
+            job = queue.front();
+            queue.pop_front();
+        }
+        room.notify_one();
+        if (!encode(job)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (failure.empty()) failure = "cannot write frame " + std::to_string(job.index);
+        }
+    }
+}
+
+bool FrameWriter::encode(Job& job) {
+    bool ok;
+    if (format == Format::Png) {
+        ImageFlipVertical(&job.image);
+        char name[32];
+        std::snprintf(name, sizeof(name), "/frame_%06llu.png", (unsigned long long)job.index);
+        ok = ExportImage(job.image, (dir + name).c_str());
+    } else {
+        // Bottom row first in memory, so rows go out in reverse
+        size_t rowBytes = (size_t)job.image.width * 4;
+        const unsigned char* pixels = static_cast<const unsigned char*>(job.image.data);
+        ok = true;
+        for (int y = job.image.height; y-- > 0 && ok;) {
+            ok = std::fwrite(pixels + y * rowBytes, 1, rowBytes, raw) == rowBytes;
+        }
+    }
+    UnloadImage(job.image);
+    return ok;
+}
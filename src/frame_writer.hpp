@@ -0,0 +1,79 @@
+#ifndef FRAME_WRITER_HPP
+#define FRAME_WRITER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <raylib.h>
+
+// Web builds without pthreads encode each frame on the calling thread
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define FRAME_WRITER_THREADED 0
+#else
+#define FRAME_WRITER_THREADED 1
+#endif
+
+// Writes numbered frames to disk on background threads, so encoding
+// overlaps rendering. Frames are RGBA images read back from a render
+// texture, bottom row first, and come out top row first.
+//
+// Png writes dir/frame_000000.png, dir/frame_000001.png, ... on several
+// threads. Raw appends every frame to dir/frames.rgba for
+// `ffmpeg -f rawvideo -pix_fmt rgba -s WxH`; there is nothing to encode,
+// so a single writer keeps the frames in order.
+//
+// write() blocks while MaxQueued frames per writer are waiting, which bounds
+// memory when the disk or the encoder is slower than rendering.
+class FrameWriter {
+public:
+    enum class Format { Png, Raw };
+    static constexpr size_t MaxQueued = 2;
+
+    FrameWriter() = default;
+    ~FrameWriter();
+    FrameWriter(const FrameWriter&) = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+
+    // Creates dir if needed and starts the writers; threads 0 uses every
+    // hardware thread. False with a message in error on failure.
+    bool open(const std::string& dir, Format format, unsigned threads, std::string& error);
+    // Queues the next frame and takes ownership of its pixels
+    void write(Image frame);
+    // Waits for every queued frame and stops the writers; false with the
+    // first failure in error if any frame could not be written
+    bool finish(std::string& error);
+
+    uint64_t frames() const { return next; }
+    const std::string& path() const { return dir; }
+
+private:
+    struct Job {
+        uint64_t index;
+        Image image;
+    };
+
+    std::string dir;
+    Format format = Format::Png;
+    FILE* raw = nullptr;
+    uint64_t next = 0;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable ready;   // a job was queued, or stopping
+    std::condition_variable room;    // a job was taken off the queue
+    std::deque<Job> queue;
+    size_t maxQueued = MaxQueued;
+    bool stopping = false;
+    std::string failure;
+
+    void work();
+    // Encodes and writes one frame, then frees it; false on an I/O error
+    bool encode(Job& job);
+};
+
+#endif
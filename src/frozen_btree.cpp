@@ -0,0 +1,129 @@
+#include "frozen_btree.hpp"
+#include <climits>
+#include "simd_search.hpp"
+
+namespace {
+
+inline void prefetchBlock(const void* p) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p, 0, 3);
+#elif defined(SIMD_SEARCH_SSE2)
+    _mm_prefetch((const char*)p, _MM_HINT_T0);
+#else
+    (void)p;
+#endif
+}
+
+// Keys below k in a full block. Blocks are padded, so unlike
+// simdLowerBound this compares all B keys without an early exit and the
+// only branch per level is the loop itself.
+inline size_t blockRank(const int* keys, int k) {
+#if defined(SIMD_SEARCH_SSE2)
+    const __m128i needle = _mm_set1_epi32(k);
+    const __m128i* v = reinterpret_cast<const __m128i*>(keys);
+    __m128i lo = _mm_packs_epi32(_mm_cmplt_epi32(v[0], needle), _mm_cmplt_epi32(v[1], needle));
+    __m128i hi = _mm_packs_epi32(_mm_cmplt_epi32(v[2], needle), _mm_cmplt_epi32(v[3], needle));
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_packs_epi16(lo, hi));
+#if defined(__GNUC__) || defined(__clang__)
+    return (size_t)__builtin_popcount(mask);
+#else
+    size_t below = 0;
+    for (; mask; mask &= mask - 1) ++below;
+    return below;
+#endif
+#else
+    size_t below = 0;
+    for (int i = 0; i < FrozenBTree::B; ++i) below += keys[i] < k ? 1 : 0;
+    return below;
+#endif
+}
+
+} // namespace
+
+void FrozenBTree::rebuild(const BTree& tree) {
+    std::vector<int> keys;
+    keys.reserve(tree.getStats().keys);
+    if (tree.getRoot()) tree.getRoot()->traverse([&](BTree::Node* node, int, int i) { keys.push_back(node->keyAt(i)); });
+
+    count = keys.size();
+    hasMax = !keys.empty() && keys.back() == INT_MAX;
+    blocks.assign((count + B - 1) / B, Block{});
+    // In-order walk of the implicit tree hands out the sorted keys, so every
+    // key is greater than all keys in the subtrees to its left
+    size_t next = 0;
+    auto fill = [&](auto& self, size_t k) -> void {
+        if (k >= blocks.size()) return;
+        for (size_t i = 0; i < (size_t)B; ++i) {
+            self(self, child(k, i));
+            blocks[k].keys[i] = next < count ? keys[next++] : INT_MAX;
+        }
+        self(self, child(k, B));
+    };
+    fill(fill, 0);
+    version = tree.getVersion();
+    built = true;
+}
+
+bool FrozenBTree::refresh(const BTree& tree) {
+    if (!stale(tree)) return false;
+    rebuild(tree);
+    return true;
+}
+
+size_t FrozenBTree::search(int k) const {
+    size_t found = SIZE_MAX;
+    for (size_t block = 0; block < blocks.size();) {
+        size_t i = blockRank(blocks[block].keys, k);
+        if (i < (size_t)B) found = block * B + i;
+        block = child(block, i);
+    }
+    // Padding answers for keys above the largest one
+    if (found != SIZE_MAX && blocks[found / B].keys[found % B] == INT_MAX && !hasMax) return SIZE_MAX;
+    return found;
+}
+
+bool FrozenBTree::contains(int k) const {
+    size_t slot = search(k);
+    return slot != SIZE_MAX && blocks[slot / B].keys[slot % B] == k;
+}
+
+bool FrozenBTree::lowerBound(int k, int& key) const {
+    size_t slot = search(k);
+    if (slot == SIZE_MAX) return false;
+    key = blocks[slot / B].keys[slot % B];
+    return true;
+}
+
+// Same interleaving as BTree::searchBatch, with one step per level since a
+// block's keys are the block itself
+void FrozenBTree::containsBatch(const int* keys, size_t n, std::vector<bool>& found) const {
+    found.assign(n, false);
+    if (blocks.empty()) return;
+    struct Lookup {
+        size_t block;
+        size_t key;
+        size_t slot;
+    };
+    Lookup slots[BatchWidth];
+    int active = 0;
+    size_t next = 0;
+    while (active < BatchWidth && next < n) slots[active++] = Lookup{0, next++, SIZE_MAX};
+
+    while (active > 0) {
+        for (int s = 0; s < active;) {
+            Lookup& l = slots[s];
+            int k = keys[l.key];
+            size_t i = blockRank(blocks[l.block].keys, k);
+            if (i < (size_t)B) l.slot = l.block * B + i;
+            l.block = child(l.block, i);
+            if (l.block < blocks.size()) {
+                prefetchBlock(&blocks[l.block]);
+                ++s;
+                continue;
+            }
+            found[l.key] = l.slot != SIZE_MAX && blocks[l.slot / B].keys[l.slot % B] == k && (k != INT_MAX || hasMax);
+            if (next < n) l = Lookup{0, next++, SIZE_MAX};
+            else l = slots[--active];
+        }
+    }
+}
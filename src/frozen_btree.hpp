@@ -0,0 +1,59 @@
+#ifndef FROZEN_BTREE_HPP
+#define FROZEN_BTREE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "btree.hpp"
+
+// Read-only copy of a BTree's keys, laid out for lookups.
+//
+// The keys sit in one contiguous array of cache-line blocks of B keys that
+// form an implicit (B + 1)-ary search tree: block k's children are blocks
+// k * (B + 1) + 1 through k * (B + 1) + B + 1, the B-ary form of the
+// Eytzinger layout. A lookup reads one line per level and computes the next
+// block's index instead of loading a pointer, and the top levels share a
+// handful of lines that stay cached. Slots past the last key hold INT_MAX.
+//
+// A snapshot remembers the tree version it was taken at; refresh() rebuilds
+// it in O(n) only when the tree has changed since.
+class FrozenBTree {
+public:
+    static constexpr int B = 16;   // keys per block: 64 bytes
+    static constexpr int BatchWidth = 16;
+
+    FrozenBTree() = default;
+    explicit FrozenBTree(const BTree& tree) { rebuild(tree); }
+
+    void rebuild(const BTree& tree);
+    // Rebuilds if the tree changed since the last build; true if it did
+    bool refresh(const BTree& tree);
+    bool stale(const BTree& tree) const { return !built || version != tree.getVersion(); }
+
+    bool contains(int k) const;
+    // Smallest key >= k; false when there is none
+    bool lowerBound(int k, int& key) const;
+    // found[i] = contains(keys[i]), with up to BatchWidth lookups in flight
+    // and each one's next block prefetched
+    void containsBatch(const int* keys, size_t n, std::vector<bool>& found) const;
+
+    size_t size() const { return count; }
+    size_t memoryBytes() const { return sizeof(*this) + blocks.capacity() * sizeof(Block); }
+
+private:
+    struct alignas(64) Block {
+        int keys[B];
+    };
+
+    std::vector<Block> blocks;
+    size_t count = 0;
+    bool hasMax = false;      // INT_MAX is a real key, not only padding
+    bool built = false;
+    uint64_t version = 0;
+
+    static size_t child(size_t k, size_t i) { return k * (B + 1) + i + 1; }
+    // Slot index of the first key >= k, as block * B + slot; SIZE_MAX if none
+    size_t search(int k) const;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include "label_cache.hpp"
+#include <charconv>
+
+LabelCache::LabelCache(float _spacing) : spacing(_spacing) {
+    for (auto& g : glyphForChar) g = 0;
+}
+
+void LabelCache::setFont(const Font& f) {
+    if (f.texture.id == font.texture.id && f.baseSize == bucket) return;
+    font = f;
+    bucket = f.baseSize;
+    labels.clear();
+    buildGlyphTable();
+}
+
+void LabelCache::buildGlyphTable() {
+    // GetGlyphIndex scans the whole glyph array; labels only ever contain
+    // ASCII digits and '-', so resolve them once per font.
+    for (int c = 0; c < 128; ++c) {
+        glyphForChar[c] = (short)(font.glyphCount > 0 ? GetGlyphIndex(font, c) : 0);
+    }
+}
+
+const LabelCache::Label& LabelCache::get(int key) {
+    auto it = labels.find(key);
+    if (it != labels.end()) return it->second;
+
+    if (labels.size() >= MaxEntries) labels.clear();
+
+    char text[MaxLabelLength];
+    auto res = std::to_chars(text, text + MaxLabelLength, key);
+    Label label;
+    label.length = (int)(res.ptr - text);
+    label.width = 0.0f;
+    for (int i = 0; i < label.length; ++i) {
+        short g = glyphForChar[(unsigned char)text[i] & 0x7f];
+        label.glyphs[i] = g;
+        if (font.glyphs == nullptr) continue;
+        // Same advance rule as MeasureTextEx
+        if (font.glyphs[g].advanceX != 0) label.width += (float)font.glyphs[g].advanceX;
+        else label.width += font.recs[g].width + (float)font.glyphs[g].offsetX;
+    }
+    return labels.emplace(key, label).first->second;
+}
+
+Vector2 LabelCache::measure(const Label& label, float fontSize) const {
+    if (bucket == 0 || label.length == 0) return {0.0f, fontSize};
+    float scale = fontSize / (float)bucket;
+    return {label.width * scale + (float)(label.length - 1) * spacing, fontSize};
+}
+
+void LabelCache::draw(const Label& label, Vector2 pos, float fontSize, Color tint) const {
+    if (bucket == 0 || font.glyphs == nullptr) return;
+    float scale = fontSize / (float)bucket;
+    float pad = (float)font.glyphPadding;
+    float x = pos.x;
+    for (int i = 0; i < label.length; ++i) {
+        int g = label.glyphs[i];
+        const GlyphInfo& glyph = font.glyphs[g];
+        const Rectangle& rec = font.recs[g];
+        // Mirrors DrawTextCodepoint without its per-glyph index lookup
+        Rectangle src = {rec.x - pad, rec.y - pad, rec.width + 2.0f * pad, rec.height + 2.0f * pad};
+        Rectangle dst = {x + ((float)glyph.offsetX - pad) * scale,
+                         pos.y + ((float)glyph.offsetY - pad) * scale,
+                         src.width * scale, src.height * scale};
+        DrawTexturePro(font.texture, src, dst, {0.0f, 0.0f}, 0.0f, tint);
+        float advance = glyph.advanceX != 0 ? (float)glyph.advanceX : rec.width;
+        x += advance * scale + spacing;
+    }
+}
+
+void LabelCache::drawCentered(int key, Vector2 center, float fontSize, Color tint) {
+    const Label& label = get(key);
+    Vector2 size = measure(label, fontSize);
+    draw(label, {center.x - size.x / 2.0f, center.y - size.y / 2.0f}, fontSize, tint);
+}
@@ -0,0 +1,57 @@
+#ifndef LABEL_CACHE_HPP
+#define LABEL_CACHE_HPP
+
+#include <cstddef>
+#include <unordered_map>
+#include <raylib.h>
+
+// Caches the glyph run and unscaled width of every key label that has been
+// drawn, so steady-state frames neither format nor measure text.
+//
+// Entries are stored at the font's rasterized size (its size bucket) and
+// scaled arithmetically to whatever size a caller asks for, matching what
+// MeasureTextEx/DrawTextEx would produce. The cache is only invalidated when
+// the font, and therefore the bucket, changes.
+class LabelCache {
+public:
+    static constexpr int MaxLabelLength = 12; // "-2147483648" plus slack
+
+    struct Label {
+        short glyphs[MaxLabelLength]; // glyph indices into the font
+        int length;
+        float width;                  // sum of advances at font.baseSize
+    };
+
+    explicit LabelCache(float spacing = 1.0f);
+
+    void setFont(const Font& font);
+
+    // Returns the cached label for a key, building it on first use.
+    const Label& get(int key);
+
+    Vector2 measure(int key, float fontSize) { return measure(get(key), fontSize); }
+    Vector2 measure(const Label& label, float fontSize) const;
+
+    // Draws the label with its top-left corner at pos
+    void draw(const Label& label, Vector2 pos, float fontSize, Color tint) const;
+    // Draws the label centred on center
+    void drawCentered(int key, Vector2 center, float fontSize, Color tint);
+
+    void clear() { labels.clear(); }
+    size_t size() const { return labels.size(); }
+
+private:
+    Font font{};
+    float spacing;
+    int bucket = 0;
+    short glyphForChar[128];
+    std::unordered_map<int, Label> labels;
+
+    // Keeps the cache bounded however many distinct keys are typed or
+    // inserted; past the cap it is cleared and refilled on demand
+    static constexpr size_t MaxEntries = 1 << 16;
+
+    void buildGlyphTable();
+};
+
+#endif
@@ -1,52 +1,165 @@
 
 #include <raylib.h>
 #include <string>
-#include <sstream>
 #include <cmath>
 #include <algorithm>
 #include <unordered_map>
 #include <cfloat>
 #include <random>
+#include <cstdint>
+#include <charconv>
+#include <cstdio>
+#include <memory>
 #include "btree.hpp"
-#include "embedded_font.h"
+#include "label_cache.hpp"
+#include "node_batch.hpp"
+#include "tile_cache.hpp"
+#include "tree_worker.hpp"
+#include "options.hpp"
+#include "replay.hpp"
+#include "tuning.hpp"
+#include "cache_sim.hpp"
+#include "sdf_font.hpp"
+#include "embedded_font_atlas.h"
+#include "frame_writer.hpp"
+#include <chrono>
 
+#if defined(__EMSCRIPTEN__)
+#include <emscripten/emscripten.h>
+#endif
 // Helper function to ease animations
 float easeInOutCubic(float t) {
     return t < 0.5f ? 4.0f * t * t * t : 1.0f - pow(-2.0f * t + 2.0f, 3.0f) / 2.0f;
 }
 
-int main() {
-	int screenWidth = 1400;
-	int screenHeight = 900;
-	SetConfigFlags(FLAG_WINDOW_RESIZABLE);
-	SetTraceLogLevel(LOG_NONE); // Disable all raylib logs
-	InitWindow(screenWidth, screenHeight, "B-Tree Visualizer");
-	SetTargetFPS(60);
+static const uint64_t FNV_OFFSET = 1469598103934665603ull;
 
-	// Initialize random number generator with a proper seed
-	std::random_device rd;
-	std::mt19937 rng(rd());
-	std::uniform_int_distribution<int> dist(10, 99);
+static uint64_t hashBytes(uint64_t h, const void* data, size_t len) {
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t i = 0; i < len; ++i) { h ^= p[i]; h *= 1099511628211ull; }
+	return h;
+}
 
-	BTree tree(3);
-	
-	// Insert 8 unique random keys
-	for (int i = 0; i < 8; ++i) {
-		int val = dist(rng);
-		while (tree.contains(val)) {
-			val = dist(rng);
-		}
-		tree.insert(val);
-	}
+// Node rectangle grown to cover its shadow and child pointer dots
+static Rectangle staticNodeBounds(const TreeLayout::NodeBox& sn) {
+	return { sn.rect.x - 16.0f, sn.rect.y - 2.0f, sn.rect.width + 32.0f, sn.rect.height + 10.0f };
+}
+
+// Node fill for the occupancy overlay: red when nearly empty, amber at
+// half, green when full
+static Color occupancyColor(float fill) {
+	const Color low = {239, 68, 68, 255}, mid = {245, 158, 11, 255}, high = {34, 197, 94, 255};
+	fill = std::min(std::max(fill, 0.0f), 1.0f);
+	Color a = fill < 0.5f ? low : mid, b = fill < 0.5f ? mid : high;
+	float f = fill < 0.5f ? fill * 2.0f : (fill - 0.5f) * 2.0f;
+	return Color{ (unsigned char)(a.r + (b.r - a.r) * f), (unsigned char)(a.g + (b.g - a.g) * f),
+		(unsigned char)(a.b + (b.b - a.b) * f), 255 };
+}
+
+// Access heat from cold blue to hot red
+static Color heatColor(float heat) {
+	heat = std::min(std::max(heat, 0.0f), 1.0f);
+	return Color{ (unsigned char)(59 + (239 - 59) * heat), (unsigned char)(130 - (130 - 68) * heat),
+		(unsigned char)(246 - (246 - 68) * heat), 255 };
+}
+
+static Rectangle staticEdgeBounds(const TreeLayout::Edge& e) {
+	float x0 = std::min(e.from.x, e.to.x), x1 = std::max(e.from.x, e.to.x);
+	float y0 = std::min(e.from.y, e.to.y), y1 = std::max(e.from.y, e.to.y);
+	return { x0 - 2.0f, y0 - 2.0f, x1 - x0 + 4.0f, y1 - y0 + 4.0f };
+}
+
+// Everything the visualizer keeps between frames. The frame body lives in
+// frame() so it can be driven by a desktop loop or by the browser's
+// animation callback without main() ever blocking.
+struct App {
+	int screenWidth;
+	int screenHeight;
+
+	// One tree on screen: the worker that owns the tree, its layout and
+	// all mutations on a thread of its own, and what drawing it keeps
+	// between frames. --compare shows several side by side.
+	struct TreeView {
+		TreeWorker worker;
+		Rectangle viewport{};           // screen area the tree is drawn in
+
+		// Static layer: the idle tree is cached in world-space tiles and
+		// only regions whose content changed get re-rendered.
+		TileCache tileCache;
+		std::unordered_map<uint64_t, Rectangle> previousStatic, currentStatic;
+		uint64_t seenLayoutVersion = 0;
+
+		// Level of detail per entry of the snapshot's nodes, see LodState
+		std::vector<uint8_t> lod;
+
+		TreeView(const ComparedTree& tree, int initialKeys, bool multiset, uint32_t seed)
+			: worker(tree.t, initialKeys, multiset, tree.bStar, seed) {}
+	};
+	// The frame loop only posts commands and draws the latest snapshots.
+	// Trees start with the same 8 random keys, or empty when replaying.
+	std::vector<std::unique_ptr<TreeView>> views;
+	std::vector<TreeWorker*> workers;
+	// The first tree; its snapshot drives the controls and status lines
+	TreeWorker& worker;
+	static std::vector<std::unique_ptr<TreeView>> makeViews(const AppOptions& options);
+	bool comparing() const { return views.size() > 1; }
+	// Every command goes to every tree, which apply it in parallel
+	void post(const TreeWorker::Command& cmd);
+	bool workersIdle() const;
+	// Splits the screen into one column per tree
+	void layoutViews();
+	// Index of the view whose viewport holds a screen point
+	size_t viewAt(Vector2 screen) const;
+	Camera2D viewCamera(const TreeView& view) const;
+	Rectangle visibleWorld(const TreeView& view) const;
+
+	// Trace replay through the animation system (--replay)
+	ReplayFeed replay;
 
 	Vector2 pan = {0, 0};
 	float zoom = 1.0f;
 	bool dragging = false;
 	Vector2 lastMouse = {0, 0};
+	bool selecting = false;             // Shift+drag: box of keys to delete
+	Vector2 selectStart = {0, 0};
 
-	int nextRandom = 100;
 	int hoveredKey = -1;
+	// View, node and key index under the cursor, in that view's snapshot
+	struct HoverTarget {
+		int view = -1;
+		int node = -1;
+		int index = -1;
+		bool operator==(const HoverTarget& o) const { return view == o.view && node == o.node && index == o.index; }
+	} hover;
+	HoverTarget hoverAt(const TreeView& view, int index, Vector2 world) const;
+
+	// Idle mode: while nothing animates and no command is in flight, frames
+	// wait for input events, and one is only drawn when the screen would
+	// differ from the last drawn frame
+	bool idleWait;
+	bool sleeping = false;              // event waiting is on
+	double lastFrameStart = 0.0;
+	bool drawnOnce = false;
+	Vector2 drawnPan = {0, 0};
+	float drawnZoom = 0.0f;
+	HoverTarget drawnHover;
+	bool drawnFocused = false;          // uncovered windows may need repainting
+
+	// Animation time summed over frames; drives the pulsing badges so
+	// exported frames come out the same on every run
+	double animationClock = 0.0;
+
+	// Offline export (--export): every frame advances a fixed step and is
+	// drawn into exportTarget instead of the window
+	bool exporting = false;
+	float exportStep = 0.0f;
+	RenderTexture2D exportTarget{};
+	bool occupancyOverlay = false;      // O: color nodes by fill
+	bool heatOverlay = false;           // T: color nodes and edges by access heat
+	bool missOverlay = false;           // C: outline nodes that missed the simulated cache
 	bool shouldFitViewAfterAnimation = false;
+	bool fitViewOnNextLayout = false;   // instant fit once a posted reset shows up
+	uint64_t seenCompletedAnimations = 0;   // summed over all trees
 	
 	// Camera animation state
 	bool cameraAnimating = false;
@@ -57,624 +170,1077 @@ int main() {
 	float cameraStartZoom = 1.0f;
 	float cameraTargetZoom = 1.0f;
 	
-	enum class TypingMode { None, Insert, Multi };
+	enum class TypingMode { None, Insert, Multi, Search, Split };
 	TypingMode typingMode = TypingMode::None;
 	bool typing = false;
 	std::string typed = "";
 
-	auto fitView = [&](const std::vector<float>& xs, const std::vector<float>& ys, bool animate = true){
-		if (xs.empty() || ys.empty()) return;
-		float minx = *std::min_element(xs.begin(), xs.end());
-		float maxx = *std::max_element(xs.begin(), xs.end());
-		float miny = *std::min_element(ys.begin(), ys.end());
-		float maxy = *std::max_element(ys.begin(), ys.end());
-		float margin = 80.0f;
-		float width = maxx - minx + margin*2;
-		float height = maxy - miny + margin*2;
-		float zx = (screenWidth) / width;
-		float zy = (screenHeight) / height;
-		float targetZoom = std::min(std::max(std::min(zx, zy), 0.1f), 4.0f);
-		Vector2 targetPan;
-		targetPan.x = -(minx + maxx)/2 + screenWidth/(2*targetZoom);
-		targetPan.y = -(miny + maxy)/2 + screenHeight/(2*targetZoom);
-		
-		if (animate) {
-			// Start camera animation
-			cameraAnimating = true;
-			cameraAnimProgress = 0.0f;
-			cameraStartPan = pan;
-			cameraStartZoom = zoom;
-			cameraTargetPan = targetPan;
-			cameraTargetZoom = targetZoom;
-		} else {
-			// Instant update
-			zoom = targetZoom;
-			pan = targetPan;
-		}
-	};
+	// One distance-field font for every size, see sdf_font.hpp
+	SdfFont textFont;
 
-	auto fitViewToTree = [&](bool animate = true){
-		std::vector<float> xs, ys;
-		int cursor = 0;
-		int yStart = 50, levelHeight = 80, xSpacing = 40;
-		tree.traverse([&](BTree::Node* node, int depth, int index){ 
-			xs.push_back(cursor * xSpacing + 100); 
-			ys.push_back(yStart + depth * levelHeight); 
-			cursor += 2; 
-		});
-		fitView(xs, ys, animate);
-	};
+	// Key labels are formatted and measured once per key, not per frame
+	LabelCache keyLabels;
 
-	
-	// Load embedded fonts with higher resolution for better quality
-	Font titleFont = LoadFontFromMemory(".ttf", embedded_font_data, embedded_font_data_size, 56, 0, 0);
-	SetTextureFilter(titleFont.texture, TEXTURE_FILTER_BILINEAR);
-	Font uiFont = LoadFontFromMemory(".ttf", embedded_font_data, embedded_font_data_size, 36, 0, 0);
-	SetTextureFilter(uiFont.texture, TEXTURE_FILTER_BILINEAR);
-	Font keyFont = LoadFontFromMemory(".ttf", embedded_font_data, embedded_font_data_size, 40, 0, 0);
-	SetTextureFilter(keyFont.texture, TEXTURE_FILTER_BILINEAR);
-	bool uiFontLoaded = true;
+	// Level of detail per entry of the snapshot's nodes. Far out, a subtree
+	// narrower than LodMinSpan pixels is drawn as one block labelled with
+	// its key count, and the nodes inside it are skipped.
+	enum LodState : uint8_t { LodShown, LodCollapsed, LodHidden };
+	static constexpr float LodScale = 0.25f;     // tile zoom at which labels stop being legible
+	static constexpr float LodMinSpan = 120.0f;
+	void updateLod(TreeView& view);
+
+	// Per-frame draw lists, kept across frames so they stop allocating
+	NodeBatch nodeBatch;
+	struct KeyText { LabelCache::Label label; Vector2 pos; float fontSize; Color color; };
+	std::vector<KeyText> keyTexts;
+	struct NodeBadge { Rectangle nodeRect; const char* text; Color color; };
+	std::vector<NodeBadge> nodeBadges;
+
+	App(int width, int height, const AppOptions& options);
+	~App();
+	void fitView(Rectangle bounds, bool animate = true);
+	void fitViewToTree(bool animate = true);
+	bool drawStaticTile(TreeView& view, Rectangle tileWorld);
+	// Marks tiles under changed geometry dirty and refreshes the level of
+	// detail; true if the layout changed since the last call
+	bool updateStatic(TreeView& view);
+	// Cached tiles, overlays and animations of one tree, in world space
+	void drawView(TreeView& view, int index, const Camera2D& camera, Rectangle visibleWorld);
+	// Shape and last operation time of each compared tree
+	void drawViewHeaders();
+	// Erases every key from the smallest to the largest one centered in
+	// the screen-space box from a to b, as one animation
+	void eraseKeysInBox(Vector2 a, Vector2 b);
+	void frame();
+	// Plays the open replay to the end at options.exportFps without showing
+	// it and writes every frame to options.exportDir; returns the exit code
+	int exportFrames(const AppOptions& options);
+};
+
+App::App(int width, int height, const AppOptions& options)
+	: screenWidth(width), screenHeight(height), views(makeViews(options)), worker(views[0]->worker),
+	  idleWait(!options.alwaysRedraw) {
+#if defined(__EMSCRIPTEN__)
+	// The browser paces frames; there is no event loop to wait on
+	idleWait = false;
+#endif
+	lastFrameStart = GetTime();
+	for (auto& view : views) {
+		workers.push_back(&view->worker);
+		view->worker.setCacheShapes(options.simCache, options.simTlb);
+		view->worker.start();
+	}
+	layoutViews();
 
+	// Glyphs were rendered at build time; this only uploads the atlas
+	textFont.load(embedded_font_atlas, embedded_font_atlas_size);
+	keyLabels.setFont(textFont.font());
 
 	// Fit to screen at start
 	fitViewToTree();
+}
 
-	while (!WindowShouldClose()) {
-		float deltaTime = GetFrameTime();
-		
-		// Update camera animation
-		if (cameraAnimating) {
-			cameraAnimProgress += deltaTime / cameraAnimDuration;
-			if (cameraAnimProgress >= 1.0f) {
-				cameraAnimProgress = 1.0f;
-				cameraAnimating = false;
-			}
-			
-			// Apply easing
-			float t = easeInOutCubic(cameraAnimProgress);
-			
-			// Interpolate zoom and pan
-			zoom = cameraStartZoom + (cameraTargetZoom - cameraStartZoom) * t;
-			pan.x = cameraStartPan.x + (cameraTargetPan.x - cameraStartPan.x) * t;
-			pan.y = cameraStartPan.y + (cameraTargetPan.y - cameraStartPan.y) * t;
-		}
-		
-		// Update screen dimensions if window was resized
-		int newWidth = GetScreenWidth();
-		int newHeight = GetScreenHeight();
-		bool windowResized = (newWidth != screenWidth || newHeight != screenHeight);
-		screenWidth = newWidth;
-		screenHeight = newHeight;
-		
-		// Update animations
-		tree.updateAnimation(deltaTime);
-		
-		// Fit view after each animation step completes
-		if (tree.hasAnimationJustCompleted() && shouldFitViewAfterAnimation) {
-			fitViewToTree();
-			tree.clearAnimationCompletedFlag();
-		}
-		
-		// Clear the flag when all animations are done
-		if (!tree.isAnimating() && shouldFitViewAfterAnimation) {
-			shouldFitViewAfterAnimation = false;
-		}
-		
-		// Auto-fit on window resize
-		if (windowResized && !tree.isAnimating()) {
-			fitViewToTree();
-		}
-		
-		if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
-			dragging = true;
-			lastMouse = GetMousePosition();
-			cameraAnimating = false; // Stop camera animation when user starts dragging
-		}
-		if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT)) dragging = false;
-		if (dragging) {
-			Vector2 m = GetMousePosition();
-			pan.x += (m.x - lastMouse.x) / zoom;
-			pan.y += (m.y - lastMouse.y) / zoom;
-			lastMouse = m;
-		}
+App::~App() {
+	for (auto& view : views) view->worker.stop();
+}
 
-		float wheel = GetMouseWheelMove();
-		if (wheel != 0) {
-			cameraAnimating = false; // Stop camera animation when user zooms manually
-			float oldZoom = zoom;
-			zoom *= (1.0f + wheel * 0.1f);
-			if (zoom < 0.1f) zoom = 0.1f;
-			if (zoom > 4.0f) zoom = 4.0f;
-			
-			Vector2 m = GetMousePosition();
-			pan.x = (pan.x - m.x / oldZoom) * (zoom / oldZoom) + m.x / zoom;
-			pan.y = (pan.y - m.y / oldZoom) * (zoom / oldZoom) + m.y / zoom;
-		}
+std::vector<std::unique_ptr<App::TreeView>> App::makeViews(const AppOptions& options) {
+	std::vector<ComparedTree> trees = options.compareTrees;
+	if (trees.empty()) trees.push_back(ComparedTree{3, options.bStar});
+	// One seed for all, so compared trees draw the same random keys
+	uint32_t seed = std::random_device{}();
+	int initialKeys = options.replayPath.empty() ? 8 : 0;
+	std::vector<std::unique_ptr<TreeView>> made;
+	for (const ComparedTree& tree : trees) made.push_back(std::make_unique<TreeView>(tree, initialKeys, options.multiset, seed));
+	return made;
+}
 
-		
-		// Input handling - only allow when not animating
-		bool canInput = !tree.isAnimating();
-		
-		if (canInput && IsKeyPressed(KEY_A)) { 
-			int val = dist(rng);
-			// Ensure unique values
-			while (tree.contains(val)) {
-				val = dist(rng);
-			}
-			tree.insertAnimated(val);
-			shouldFitViewAfterAnimation = true;
+void App::post(const TreeWorker::Command& cmd) {
+	for (TreeWorker* w : workers) w->post(cmd);
+}
+
+bool App::workersIdle() const {
+	for (const TreeWorker* w : workers) {
+		if (!w->idle()) return false;
+	}
+	return true;
+}
+
+void App::layoutViews() {
+	float width = (float)screenWidth / (float)views.size();
+	for (size_t i = 0; i < views.size(); ++i) {
+		views[i]->viewport = Rectangle{width * i, 0.0f, width, (float)screenHeight};
+	}
+}
+
+size_t App::viewAt(Vector2 screen) const {
+	for (size_t i = 0; i < views.size(); ++i) {
+		if (CheckCollisionPointRec(screen, views[i]->viewport)) return i;
+	}
+	return 0;
+}
+
+Camera2D App::viewCamera(const TreeView& view) const {
+	Camera2D camera;
+	camera.offset = {view.viewport.x, view.viewport.y};
+	camera.target = {-pan.x, -pan.y};
+	camera.rotation = 0.0f;
+	camera.zoom = zoom;
+	return camera;
+}
+
+Rectangle App::visibleWorld(const TreeView& view) const {
+	Camera2D camera = viewCamera(view);
+	const Rectangle& vp = view.viewport;
+	Vector2 topLeft = GetScreenToWorld2D({vp.x, vp.y}, camera);
+	Vector2 bottomRight = GetScreenToWorld2D({vp.x + vp.width, vp.y + vp.height}, camera);
+	return { topLeft.x, topLeft.y, bottomRight.x - topLeft.x, bottomRight.y - topLeft.y };
+}
+
+void App::fitView(Rectangle bounds, bool animate) {
+	if (bounds.width <= 0 || bounds.height <= 0) return;
+	float margin = 60.0f;
+	float width = bounds.width + margin*2;
+	float height = bounds.height + margin*2;
+	// Every view is the same size, and they share the camera
+	float viewWidth = views[0]->viewport.width;
+	float viewHeight = views[0]->viewport.height;
+	float zx = (viewWidth) / width;
+	float zy = (viewHeight) / height;
+	float targetZoom = std::min(std::max(std::min(zx, zy), 0.1f), 4.0f);
+	Vector2 targetPan;
+	targetPan.x = -(bounds.x + bounds.width/2) + viewWidth/(2*targetZoom);
+	targetPan.y = -(bounds.y + bounds.height/2) + viewHeight/(2*targetZoom);
+	
+	if (animate) {
+		// Start camera animation
+		cameraAnimating = true;
+		cameraAnimProgress = 0.0f;
+		cameraStartPan = pan;
+		cameraStartZoom = zoom;
+		cameraTargetPan = targetPan;
+		cameraTargetZoom = targetZoom;
+	} else {
+		// Instant update
+		zoom = targetZoom;
+		pan = targetPan;
+	}
+}
+
+void App::fitViewToTree(bool animate) {
+	// Compared trees differ in shape; fit the largest extent of them all
+	Rectangle bounds{};
+	bool any = false;
+	for (auto& view : views) {
+		const RenderSnapshot& snap = view->worker.snapshot();
+		if (snap.empty) continue;
+		if (!any) {
+			bounds = snap.bounds;
+			any = true;
+			continue;
 		}
-		if (canInput && IsKeyPressed(KEY_M)) { 
-			typing = true; typed = ""; typingMode = TypingMode::Multi;
+		float x1 = std::max(bounds.x + bounds.width, snap.bounds.x + snap.bounds.width);
+		float y1 = std::max(bounds.y + bounds.height, snap.bounds.y + snap.bounds.height);
+		bounds.x = std::min(bounds.x, snap.bounds.x);
+		bounds.y = std::min(bounds.y, snap.bounds.y);
+		bounds.width = x1 - bounds.x;
+		bounds.height = y1 - bounds.y;
+	}
+	if (any) fitView(bounds, animate);
+}
+
+void App::eraseKeysInBox(Vector2 a, Vector2 b) {
+	// Compared trees hold the same keys, so the box's view decides
+	const TreeView& view = *views[viewAt(a)];
+	const RenderSnapshot& snap = view.worker.snapshot();
+	Rectangle box = {(std::min(a.x, b.x) - view.viewport.x) / zoom - pan.x, (std::min(a.y, b.y) - view.viewport.y) / zoom - pan.y,
+	                 std::fabs(b.x - a.x) / zoom, std::fabs(b.y - a.y) / zoom};
+	int lo = 0, hi = 0;
+	bool any = false;
+	for (auto &sn : snap.nodes) {
+		if (!CheckCollisionRecs(sn.rect, box)) continue;
+		const float* keyXs = &snap.pointerXs[sn.firstPtr];
+		for (size_t i = 0; i < sn.keyCount; ++i) {
+			Vector2 center = {(keyXs[i] + keyXs[i + 1]) * 0.5f, sn.cy};
+			if (!CheckCollisionPointRec(center, box)) continue;
+			int key = snap.values[sn.firstValue + i];
+			lo = any ? std::min(lo, key) : key;
+			hi = any ? std::max(hi, key) : key;
+			any = true;
 		}
-		if (canInput && IsKeyPressed(KEY_I)) { 
-			typing = true; typed = ""; typingMode = TypingMode::Insert;
+	}
+	if (!any) return;
+	post({TreeWorker::Command::EraseRange, lo, hi});
+	shouldFitViewAfterAnimation = true;
+}
+
+void App::updateLod(TreeView& view) {
+	const RenderSnapshot& snap = view.worker.snapshot();
+	std::vector<uint8_t>& lod = view.lod;
+	lod.assign(snap.nodes.size(), LodShown);
+	float scale = view.tileCache.zoomScale();
+	if (scale > LodScale || snap.subtreeKeys.size() != snap.nodes.size()) return;
+	for (size_t n = 0; n < snap.nodes.size();) {
+		const TreeLayout::NodeBox& sn = snap.nodes[n];
+		if (sn.depth == 0 || sn.span.width * scale >= LodMinSpan) {
+			++n;
+			continue;
 		}
-		if (canInput && IsKeyPressed(KEY_D)) {
-			// Delete last added key
-			if (tree.hasKeys()) {
-				int lastKey = tree.getLastInsertedKey();
-				tree.eraseAnimated(lastKey);
-				shouldFitViewAfterAnimation = true;
-			}
+		lod[n] = LodCollapsed;
+		std::fill(lod.begin() + n + 1, lod.begin() + sn.subtreeEnd, (uint8_t)LodHidden);
+		n = sn.subtreeEnd;
+	}
+}
+
+App::HoverTarget App::hoverAt(const TreeView& view, int index, Vector2 world) const {
+	const RenderSnapshot& snap = view.worker.snapshot();
+	const std::vector<uint8_t>& lod = view.lod;
+	// The 44 px square the hover ring is drawn in; where neighbours
+	// overlap the later key wins, as it is drawn on top
+	HoverTarget found;
+	for (size_t n = 0; n < snap.nodes.size(); ++n) {
+		const TreeLayout::NodeBox& sn = snap.nodes[n];
+		if (n < lod.size() && lod[n] != LodShown) continue;
+		if (std::fabs(world.y - sn.cy) > 22.0f || world.x < sn.rect.x - 22.0f || world.x > sn.rect.x + sn.rect.width + 22.0f) continue;
+		const float* keyXs = &snap.pointerXs[sn.firstPtr];
+		for (size_t i = 0; i < sn.keyCount; ++i) {
+			float tx = (keyXs[i] + keyXs[i + 1]) * 0.5f;
+			if (CheckCollisionPointRec(world, Rectangle{tx - 22, sn.cy - 22, 44, 44})) found = HoverTarget{index, (int)n, (int)i};
 		}
-		if (canInput && IsKeyPressed(KEY_X)) { 
-			tree.clearAll();
-			nextRandom = 100;
+	}
+	return found;
+}
+
+bool App::drawStaticTile(TreeView& view, Rectangle tileWorld) {
+	const float nodeH = TreeLayout::NodeHeight;
+	const int fontSize = 20;
+	const RenderSnapshot& snap = view.worker.snapshot();
+	const std::vector<uint8_t>& lod = view.lod;
+	const auto& staticPtrXs = snap.pointerXs;
+	const auto& staticValues = snap.values;
+	nodeBatch.clear();
+	keyTexts.clear();
+	for (auto &e : snap.edges) {
+		if (lod[e.child] == LodHidden || !CheckCollisionRecs(staticEdgeBounds(e), tileWorld)) continue;
+		nodeBatch.line(e.from, e.to, 2.0f, DARKGRAY);
+	}
+	for (size_t n = 0; n < snap.nodes.size(); ++n) {
+		const TreeLayout::NodeBox& sn = snap.nodes[n];
+		if (lod[n] == LodHidden) continue;
+		if (lod[n] == LodCollapsed) {
+			// The whole subtree as one block with its key count
+			if (!CheckCollisionRecs(sn.span, tileWorld)) continue;
+			nodeBatch.roundedRect(Rectangle{sn.span.x + 4, sn.span.y + 4, sn.span.width, sn.span.height}, 0.2f, Fade(BLACK, 0.12f));
+			nodeBatch.roundedRect(sn.span, 0.2f, Color{226, 232, 240, 255});
+			nodeBatch.roundedRectLines(sn.span, 0.2f, 2.0f, Color{100, 120, 150, 255});
+			float countSize = 16.0f / view.tileCache.zoomScale();
+			const LabelCache::Label& label = keyLabels.get((int)std::min<uint64_t>(snap.subtreeKeys[n], INT_MAX));
+			Vector2 textSize = keyLabels.measure(label, countSize);
+			keyTexts.push_back(KeyText{label, { sn.span.x + (sn.span.width - textSize.x) / 2.0f,
+				sn.span.y + (sn.span.height - textSize.y) / 2.0f }, countSize, Color{55, 65, 81, 255}});
+			continue;
 		}
-		if (canInput && IsKeyPressed(KEY_H)) { 
-			if (hoveredKey != -1) {
-				tree.eraseAnimated(hoveredKey);
-				shouldFitViewAfterAnimation = true;
-			}
+		if (!CheckCollisionRecs(staticNodeBounds(sn), tileWorld)) continue;
+		const float* keyXs = &staticPtrXs[sn.firstPtr];
+		const Rectangle& r = sn.rect;
+		// Shadow, background and border
+		nodeBatch.roundedRect(Rectangle{r.x + 2, r.y + 2, r.width, r.height}, 0.25f, Fade(BLACK, 0.12f));
+		Color background = Color{255, 255, 255, 255};
+		if (occupancyOverlay) {
+			float fill = (float)sn.keyCount / (float)(2 * snap.degree - 1);
+			// Tinted but opaque, so edges stay hidden behind nodes
+			Color c = occupancyColor(fill);
+			background = Color{ (unsigned char)(255 - (255 - c.r) * 0.45f), (unsigned char)(255 - (255 - c.g) * 0.45f),
+				(unsigned char)(255 - (255 - c.b) * 0.45f), 255 };
 		}
-		if (canInput && IsKeyPressed(KEY_Z)) { 
-			fitViewToTree();
+		nodeBatch.roundedRect(r, 0.25f, background);
+		nodeBatch.roundedRectLines(r, 0.25f, 1.0f, Color{100, 120, 150, 255});
+		// Cell dividers and child pointers
+		for (size_t i = 0; i <= sn.keyCount; ++i) {
+			float px = keyXs[i];
+			nodeBatch.line({px, sn.cy - nodeH/2.0f + 4}, {px, sn.cy + nodeH/2.0f - 4}, 1.5f,
+				Fade(Color{180, 190, 200, 255}, 0.5f));
+			nodeBatch.circle({px, sn.cy + 18.0f}, 4, Color{100, 120, 150, 255});
+			nodeBatch.circle({px, sn.cy + 18.0f}, 2, Color{180, 190, 200, 255});
 		}
-		if (canInput && IsKeyPressed(KEY_R)) { 
-			tree.clearAll(); nextRandom = 100;
-			
-			// Insert 8 unique random keys
-			for (int i = 0; i < 8; i++) { 
-				int val = dist(rng);
-				while (tree.contains(val)) {
-					val = dist(rng);
-				}
-				tree.insert(val);
+		for (size_t i = 0; i < sn.keyCount; ++i) {
+			float tx = (keyXs[i] + keyXs[i+1]) * 0.5f;
+			const LabelCache::Label& label = keyLabels.get(staticValues[sn.firstValue + i]);
+			Vector2 textSize = keyLabels.measure(label, fontSize);
+			keyTexts.push_back(KeyText{label, { tx - textSize.x/2.0f, sn.cy - textSize.y/2.0f },
+				(float)fontSize, Color{40, 50, 65, 255}});
+			// Occurrence count of a duplicated multiset key
+			uint32_t count = snap.counts[sn.firstValue + i];
+			if (count > 1) {
+				const LabelCache::Label& countLabel = keyLabels.get((int)count);
+				Vector2 countSize = keyLabels.measure(countLabel, 11);
+				Vector2 badge = { keyXs[i+1] - 9.0f, sn.cy - nodeH/2.0f + 9.0f };
+				nodeBatch.circle(badge, std::max(7.0f, countSize.x/2.0f + 3.0f), Color{99, 102, 241, 255});
+				keyTexts.push_back(KeyText{countLabel, { badge.x - countSize.x/2.0f, badge.y - countSize.y/2.0f },
+					11.0f, WHITE});
 			}
-			
-			// Fit view immediately for reset (no animation)
-			fitViewToTree();
 		}
+	}
+	if (nodeBatch.vertexCount() == 0) return false;
+	nodeBatch.draw();
+	textFont.begin();
+	for (const auto& kt : keyTexts) keyLabels.draw(kt.label, kt.pos, kt.fontSize, kt.color);
+	textFont.end();
+	return true;
+}
 
-		
-		int ch = GetCharPressed();
-		while (ch > 0) {
-			if (typing) {
-				char c = (char)ch;
-				if ((c >= '0' && c <= '9') || c=='-' ) typed.push_back(c);
-			}
-			ch = GetCharPressed();
+bool App::updateStatic(TreeView& view) {
+	const RenderSnapshot& snap = view.worker.snapshot();
+	const auto& staticPtrXs = snap.pointerXs;
+	const auto& staticValues = snap.values;
+	bool relaidOut = snap.layoutVersion != view.seenLayoutVersion;
+	view.seenLayoutVersion = snap.layoutVersion;
+
+	// Anything whose geometry or labels changed since the last layout
+	// dirties the tiles under both its old and new bounds.
+	bool zoomBucketChanged = view.tileCache.setZoom(zoom);
+	if (relaidOut) {
+		view.currentStatic.clear();
+		for (auto &sn : snap.nodes) {
+			uint64_t h = hashBytes(FNV_OFFSET, &sn.rect, sizeof(sn.rect));
+			h = hashBytes(h, &staticPtrXs[sn.firstPtr], sizeof(float) * (sn.keyCount + 1));
+			h = hashBytes(h, &staticValues[sn.firstValue], sizeof(int) * sn.keyCount);
+			h = hashBytes(h, &snap.counts[sn.firstValue], sizeof(uint32_t) * sn.keyCount);
+			view.currentStatic[h] = staticNodeBounds(sn);
 		}
-		if (typing) {
-			if (IsKeyPressed(KEY_BACKSPACE) && !typed.empty()) typed.pop_back();
-			if (IsKeyPressed(KEY_ESCAPE)) { typing = false; typed.clear(); typingMode = TypingMode::None; }
-			if (IsKeyPressed(KEY_ENTER) || IsKeyPressed(KEY_KP_ENTER)) {
-				if (!typed.empty()) {
-					try {
-						int v = std::stoi(typed);
-						if (typingMode == TypingMode::Insert) {
-							// Check for duplicates before inserting
-							if (!tree.contains(v)) {
-								tree.insertAnimated(v);
-							}
-						} else if (typingMode == TypingMode::Multi) {
-							int count = std::max(0, v);
-							for (int i = 0; i < count; i++) { 
-								int val = dist(rng);
-								while (tree.contains(val)) {
-									val = dist(rng);
-								}
-								tree.insertAnimated(val);
-								fitViewToTree();
-							}
-						}
-					} catch(...) {}
-				}
-				typing = false; typed.clear(); typingMode = TypingMode::None;
-				shouldFitViewAfterAnimation = true;
-			}
+		for (auto &e : snap.edges) {
+			uint64_t h = hashBytes(FNV_OFFSET ^ 1, &e, sizeof(e));
+			view.currentStatic[h] = staticEdgeBounds(e);
 		}
-		if (IsKeyPressed(KEY_KP_ADD) || IsKeyPressed(KEY_EQUAL)) {
-			cameraAnimating = false; // Stop camera animation
-			zoom = std::min(zoom * 1.1f, 4.0f);
+		if (!zoomBucketChanged) {
+			for (auto &kv : view.currentStatic) if (!view.previousStatic.count(kv.first)) view.tileCache.markDirty(kv.second);
+			for (auto &kv : view.previousStatic) if (!view.currentStatic.count(kv.first)) view.tileCache.markDirty(kv.second);
 		}
-		if (IsKeyPressed(KEY_KP_SUBTRACT) || IsKeyPressed(KEY_MINUS)) {
-			cameraAnimating = false; // Stop camera animation
-			zoom = std::max(zoom * 0.9f, 0.1f);
+		std::swap(view.previousStatic, view.currentStatic);
+	}
+	if (relaidOut || zoomBucketChanged || view.lod.size() != snap.nodes.size()) {
+		bool wasCollapsed = std::find(view.lod.begin(), view.lod.end(), (uint8_t)LodCollapsed) != view.lod.end();
+		updateLod(view);
+		// Collapsed blocks span whole subtrees, wider than the nodes whose
+		// changes dirtied tiles above
+		if (!zoomBucketChanged && (wasCollapsed || std::find(view.lod.begin(), view.lod.end(), (uint8_t)LodCollapsed) != view.lod.end())) {
+			view.tileCache.invalidateAll();
 		}
+	}
+	return relaidOut;
+}
 
-		
-	BeginDrawing();
-	// Modern gradient background
-	ClearBackground(Color{245, 247, 250, 255});
-	DrawRectangleGradientV(0, 0, screenWidth, screenHeight/3, 
-		Color{240, 242, 245, 255}, Color{245, 247, 250, 255});	Camera2D camera;
-	camera.offset = {0.0f, 0.0f};
-	camera.target = {-pan.x, -pan.y};
-	camera.rotation = 0.0f;
-	camera.zoom = zoom;
-	BeginMode2D(camera);
-
-		int yStart = 50;
-		int levelHeight = 80;
-		int xSpacing = 40;
-
-		struct DrawCtx { int yStart; int levelHeight; int xSpacing; Vector2 mouseWorld; int hoveredKey; } ctx;
-		ctx.yStart = yStart; ctx.levelHeight = levelHeight; ctx.xSpacing = xSpacing;
-		Vector2 mp = GetMousePosition();
-		
-		ctx.mouseWorld = GetScreenToWorld2D(mp, camera);
-		ctx.hoveredKey = -1;
+void App::drawView(TreeView& view, int index, const Camera2D& camera, Rectangle visibleWorld) {
+	const RenderSnapshot& snap = view.worker.snapshot();
+	const float nodeH = TreeLayout::NodeHeight;
+	const auto& staticPtrXs = snap.pointerXs;
+	const auto& staticValues = snap.values;
+	const std::vector<uint8_t>& lod = view.lod;
+	view.tileCache.draw(visibleWorld);
 
-		
-		struct KeyPos { BTree::Node* node; int depth; int idx; float x; float y; int value; };
-		std::vector<KeyPos> keyPositions;
-		int cursorX = 0;
-		tree.traverse([&](BTree::Node* node, int depth, int index) {
-			float x = cursorX * ctx.xSpacing + 100;
-			float y = ctx.yStart + depth * ctx.levelHeight;
-			int v = node->keys[index];
-			keyPositions.push_back(KeyPos{node, depth, index, x, y, v});
-			cursorX += 2;
-		});
+	// Overlay: only nodes and keys whose look differs from the cached
+	// idle style (animations, hover) are drawn every frame.
+	nodeBatch.clear();
+	keyTexts.clear();
+	nodeBadges.clear();
 
-		
-		std::unordered_map<BTree::Node*, std::vector<KeyPos>> nodeMap;
-		std::vector<BTree::Node*> nodeOrder; nodeOrder.reserve(64);
-		for (auto &kp : keyPositions) {
-			if (nodeMap.find(kp.node) == nodeMap.end()) nodeOrder.push_back(kp.node);
-			nodeMap[kp.node].push_back(kp);
+	// Heat overlay: edges as wide as their share of traversals, nodes
+	// tinted blue (cold) to red (hot). Changes with every lookup, so it is
+	// drawn here rather than into the tiles.
+	if (heatOverlay && snap.heat.size() == snap.nodes.size()) {
+		for (auto &e : snap.edges) {
+			float h = snap.heat[e.child];
+			if (h <= 0.0f || !CheckCollisionRecs(staticEdgeBounds(e), visibleWorld)) continue;
+			nodeBatch.line(e.from, e.to, 1.0f + 9.0f * h, Fade(heatColor(h), 0.8f));
 		}
-
-		
-		struct NodeLayout { float minx, maxx, cx, cy; int depth; };
-		std::unordered_map<BTree::Node*, NodeLayout> layouts;
-		
-		for (auto *n : nodeOrder) {
-			auto &vec = nodeMap[n];
-			float minx = FLT_MAX, maxx = -FLT_MAX; int depth = vec.empty() ? 0 : vec[0].depth;
-			for (auto &kp : vec) { minx = std::min(minx, kp.x); maxx = std::max(maxx, kp.x); }
-			if (minx==FLT_MAX) { minx = 0; maxx = 0; }
-			float cx = (minx + maxx) * 0.5f;
-			float cy = ctx.yStart + depth * ctx.levelHeight;
-			layouts[n] = NodeLayout{minx, maxx, cx, cy, depth};
+		for (size_t n = 0; n < snap.nodes.size(); ++n) {
+			float h = snap.heat[n];
+			if (h <= 0.0f) continue;
+			nodeBatch.roundedRect(snap.nodes[n].rect, 0.25f, Fade(heatColor(h), 0.15f + 0.35f * h));
 		}
+	}
 
-		
+	// Miss overlay: nodes whose lines missed the simulated cache during the
+	// last operation get a red outline, TLB misses a purple ring around it
+	if (missOverlay && snap.missed.size() == snap.nodes.size()) {
+		for (size_t n = 0; n < snap.nodes.size(); ++n) {
+			Rectangle r = snap.nodes[n].rect;
+			if (snap.missed[n] & 1) nodeBatch.roundedRectLines(r, 0.25f, 3.0f, Color{220, 38, 38, 255});
+			if (snap.missed[n] & 2) {
+				nodeBatch.roundedRectLines({r.x - 5, r.y - 5, r.width + 10, r.height + 10}, 0.25f, 2.0f, Color{147, 51, 234, 255});
+			}
+		}
+	}
 
+	for (auto &sn : snap.nodes) {
+		// Nodes inside collapsed subtrees have no keys on screen
+		if (lod[&sn - snap.nodes.data()] != LodShown) continue;
+		BTree::Node* node = sn.node;
+		Rectangle nodeRect = sn.rect;
+		float cy = sn.cy;
+		const float* keyXs = &staticPtrXs[sn.firstPtr];
+		const int* values = &staticValues[sn.firstValue];
 		
+		// Check if this node is being split or highlighted for violation
+		bool isSplitting = false;
+		bool isViolation = false;
+		bool isSearched = false;
+		Color violationColor = RED;
+		float splitProgress = 0.0f;
 		
-		std::unordered_map<BTree::Node*, std::vector<float>> nodePointerXs;
-		for (auto &kv : nodeMap) {
-			BTree::Node* node = kv.first;
-			auto vec = kv.second; 
-			std::sort(vec.begin(), vec.end(), [](const KeyPos &a, const KeyPos &b){ return a.x < b.x; });
-			std::vector<float> keyXs;
-			for (auto &kp : vec) keyXs.push_back(kp.x);
-			float leftEdge = keyXs.front() - 30.0f;
-			float rightEdge = keyXs.back() + 30.0f;
-			std::vector<float> ptrXs;
-			ptrXs.reserve(keyXs.size() + 1);
-			ptrXs.push_back(leftEdge);
-			for (size_t i = 1; i < keyXs.size(); ++i) ptrXs.push_back((keyXs[i-1] + keyXs[i]) * 0.5f);
-			ptrXs.push_back(rightEdge);
-			nodePointerXs[node] = ptrXs;
+		for (const auto& anim : snap.animations) {
+			if (anim.type == BTree::AnimationType::NodeSplitting && anim.operationNode == node) {
+				isSplitting = true;
+				splitProgress = easeInOutCubic(anim.progress);
+				break;
+			}
+			if (anim.type == BTree::AnimationType::KeyHighlight && anim.highlightNode == node && anim.highlightKeyIndex == -1) {
+				// Search paths highlight whole nodes too, without the alarm
+				isSearched = anim.operation == BTree::AnimationStep::SearchKey ||
+				             anim.operation == BTree::AnimationStep::SplitTree ||
+				             anim.operation == BTree::AnimationStep::JoinTree;
+				isViolation = !isSearched;
+				violationColor = anim.highlightColor;
+				break;
+			}
 		}
-
 		
-		for (auto &kv : nodeMap) {
-			BTree::Node* node = kv.first;
-			auto vec = kv.second;
-			std::sort(vec.begin(), vec.end(), [](const KeyPos &a, const KeyPos &b){ return a.x < b.x; });
-			auto L = layouts[node];
-			auto &keyXs = nodePointerXs[node];
+		if (isSplitting) {
+			// Draw splitting animation with modern styling
+			Color splitBg = Color{255, 200, 100, 255};
+			Color splitBorder = Color{255, 140, 0, 255};
+			
+			nodeBatch.roundedRect(nodeRect, 0.25f, Fade(splitBg, 0.3f + 0.4f * sin(splitProgress * 3.14159f)));
+			nodeBatch.roundedRectLines(nodeRect, 0.25f, 1.0f, Fade(splitBorder, 0.9f));
+			// Badge explaining the split, drawn after the batch
+			nodeBadges.push_back(NodeBadge{nodeRect, "SPLITTING NODE...", splitBorder});
+		} else if (isViolation) {
+			// Draw violation with modern styling
+			float pulse = 0.5f + 0.5f * sin(animationClock * 10.0f);
+			Color violationBg = Color{255, 80, 80, 255};
 			
-			float left = keyXs.front() - 18.0f;
-			float right = keyXs.back() + 18.0f;
-			float nodeH = 36.0f;
-			Rectangle nodeRect = { left, L.cy - nodeH/2.0f, right - left, nodeH };
+			nodeBatch.roundedRect(nodeRect, 0.25f, Fade(violationBg, 0.2f * pulse));
+			nodeBatch.roundedRectLines(nodeRect, 0.25f, 1.0f, Fade(violationColor, 0.9f));
+			// Badge explaining the violation, drawn after the batch
+			nodeBadges.push_back(NodeBadge{nodeRect, "TOO MANY KEYS!", violationColor});
+		} else if (isSearched) {
+			// Node on the search path; red once the search ends here empty-handed
+			nodeBatch.roundedRect(nodeRect, 0.25f, Fade(violationColor, 0.18f));
+			nodeBatch.roundedRectLines(nodeRect, 0.25f, 3.0f, violationColor);
+		}
+
+		int fontSize = 20;
+		for (size_t i = 0; i < sn.keyCount; ++i) {
+			float leftCell = keyXs[i];
+			float rightCell = keyXs[i+1];
+			float tx = (leftCell + rightCell) * 0.5f;
 			
-			// Check if this node is being split or highlighted for violation
-			bool isSplitting = false;
-			bool isViolation = false;
-			Color violationColor = RED;
-			float splitProgress = 0.0f;
+			// Check if this key is being deleted (fading out)
+			bool isFadingOut = false;
+			float fadeProgress = 0.0f;
 			
-			for (const auto& anim : tree.getCurrentAnimations()) {
-				if (anim.type == BTree::AnimationType::NodeSplitting && anim.operationNode == node) {
-					isSplitting = true;
-					splitProgress = easeInOutCubic(anim.progress);
+			// Check if this key is being highlighted or deleted
+			bool isHighlighted = false;
+			bool isLanding = false;
+			Color highlightColor = RED;
+			for (const auto& anim : snap.animations) {
+				if (anim.type == BTree::AnimationType::KeyHighlight && 
+				    anim.highlightNode == node && anim.highlightKeyIndex == (int)i) {
+					isHighlighted = true;
+					highlightColor = anim.highlightColor;
 					break;
 				}
-				if (anim.type == BTree::AnimationType::KeyHighlight && anim.highlightNode == node && anim.highlightKeyIndex == -1) {
-					isViolation = true;
-					violationColor = anim.highlightColor;
+				// Check for deletion fade animation
+				if (anim.type == BTree::AnimationType::KeyMoving && 
+				    anim.targetNode == node && anim.targetIndex == (int)i && 
+				    anim.operation == BTree::AnimationStep::None) {
+					isFadingOut = true;
+					fadeProgress = anim.progress;
+					break;
+				}
+				// A rotated key is drawn in flight until it lands here
+				if (anim.type == BTree::AnimationType::KeyMoving && anim.operation == BTree::AnimationStep::BalanceTree &&
+				    anim.targetNode == node && values[i] == anim.movingKey) {
+					isLanding = true;
+					break;
+				}
+				// Range erase fades every key in range at once
+				if (anim.operation == BTree::AnimationStep::EraseRange && !anim.keysToAnimate.empty() &&
+				    values[i] >= anim.keysToAnimate.front() && values[i] <= anim.keysToAnimate.back()) {
+					isFadingOut = true;
+					fadeProgress = anim.progress;
 					break;
 				}
-			}
-			
-			if (isSplitting) {
-				// Draw splitting animation with modern styling
-				Color splitBg = Color{255, 200, 100, 255};
-				Color splitBorder = Color{255, 140, 0, 255};
-				
-				// Rounded rectangle with shadow
-				DrawRectangleRounded(Rectangle{nodeRect.x + 3, nodeRect.y + 3, nodeRect.width, nodeRect.height}, 
-					0.25f, 8, Fade(BLACK, 0.15f));
-			DrawRectangleRounded(nodeRect, 0.25f, 8, Fade(splitBg, 0.3f + 0.4f * sin(splitProgress * 3.14159f)));
-			DrawRectangleRoundedLines(nodeRect, 0.25f, 8, Fade(splitBorder, 0.9f));				// Draw text to explain the split with background badge
-				const char* splitText = "SPLITTING NODE...";
-				Vector2 textSize = MeasureTextEx(uiFont, splitText, 13, 1);
-				Vector2 textPos = { nodeRect.x + nodeRect.width/2 - textSize.x/2, nodeRect.y - 30 };
-				Rectangle badgeRect = {textPos.x - 8, textPos.y - 4, textSize.x + 16, textSize.y + 8};
-				DrawRectangleRounded(badgeRect, 0.3f, 6, splitBorder);
-				DrawTextEx(uiFont, splitText, textPos, 13, 1, WHITE);
-			} else if (isViolation) {
-				// Draw violation with modern styling
-				float pulse = 0.5f + 0.5f * sin(GetTime() * 10.0f);
-				Color violationBg = Color{255, 80, 80, 255};
-				
-				// Rounded rectangle with shadow
-				DrawRectangleRounded(Rectangle{nodeRect.x + 3, nodeRect.y + 3, nodeRect.width, nodeRect.height}, 
-					0.25f, 8, Fade(BLACK, 0.15f));
-			DrawRectangleRounded(nodeRect, 0.25f, 8, Fade(violationBg, 0.2f * pulse));
-			DrawRectangleRoundedLines(nodeRect, 0.25f, 8, Fade(violationColor, 0.9f));				// Draw text to explain the violation with background badge
-				const char* violationText = "TOO MANY KEYS!";
-				Vector2 textSize = MeasureTextEx(uiFont, violationText, 13, 1);
-				Vector2 textPos = { nodeRect.x + nodeRect.width/2 - textSize.x/2, nodeRect.y - 30 };
-				Rectangle badgeRect = {textPos.x - 8, textPos.y - 4, textSize.x + 16, textSize.y + 8};
-				DrawRectangleRounded(badgeRect, 0.3f, 6, violationColor);
-				DrawTextEx(uiFont, violationText, textPos, 13, 1, WHITE);
-			} else {
-				// Normal node with modern styling - rounded corners and shadow
-				Color nodeBg = Color{255, 255, 255, 255};
-				Color nodeBorder = Color{100, 120, 150, 255};
-				
-				// Shadow
-				DrawRectangleRounded(Rectangle{nodeRect.x + 2, nodeRect.y + 2, nodeRect.width, nodeRect.height}, 
-					0.25f, 8, Fade(BLACK, 0.12f));
-			// Node background
-			DrawRectangleRounded(nodeRect, 0.25f, 8, nodeBg);
-			// Border
-			DrawRectangleRoundedLines(nodeRect, 0.25f, 8, nodeBorder);
 			}
 
-			
-		
-		// Draw cell dividers with modern subtle style
-		for (float px : keyXs) {
-			DrawLineEx({px, L.cy - nodeH/2.0f + 4}, {px, L.cy + nodeH/2.0f - 4}, 1.5f, 
-				Fade(Color{180, 190, 200, 255}, 0.5f));
-		}			
-			int fontSize = 20;
-			for (size_t i = 0; i < vec.size(); ++i) {
-				float leftCell = keyXs[i];
-				float rightCell = keyXs[i+1];
-				float tx = (leftCell + rightCell) * 0.5f;
-				std::stringstream ss; ss << vec[i].value;
-				std::string s = ss.str();
-				Vector2 textSize = MeasureTextEx(keyFont, s.c_str(), fontSize, 1);
-				Vector2 pos = { tx - textSize.x/2.0f, L.cy - textSize.y/2.0f };
-				
-				// Store key position for animation system
-				tree.setKeyPosition(node, i, {tx, L.cy});
-				
-				// Check if this key is being deleted (fading out)
-				bool isFadingOut = false;
-				float fadeProgress = 0.0f;
+			if (isLanding) {
+				nodeBatch.roundedRect({leftCell + 2, cy - nodeH/2.0f + 4, rightCell - leftCell - 4, nodeH - 8}, 0.25f, WHITE);
+			} else if (isFadingOut || isHighlighted) {
+				const LabelCache::Label& label = keyLabels.get(values[i]);
+				Vector2 textSize = keyLabels.measure(label, fontSize);
+				Vector2 pos = { tx - textSize.x/2.0f, cy - textSize.y/2.0f };
+				// Cover the cached label so only the animated one shows
+				nodeBatch.roundedRect({leftCell + 2, cy - nodeH/2.0f + 4, rightCell - leftCell - 4, nodeH - 8}, 0.25f, WHITE);
 				
-				// Check if this key is being highlighted or deleted
-				bool isHighlighted = false;
-				Color highlightColor = RED;
-				for (const auto& anim : tree.getCurrentAnimations()) {
-					if (anim.type == BTree::AnimationType::KeyHighlight && 
-					    anim.highlightNode == node && anim.highlightKeyIndex == (int)i) {
-						isHighlighted = true;
-						highlightColor = anim.highlightColor;
-						break;
-					}
-					// Check for deletion fade animation
-					if (anim.type == BTree::AnimationType::KeyMoving && 
-					    anim.targetNode == node && anim.targetIndex == (int)i && 
-					    anim.operation == BTree::AnimationStep::None) {
-						isFadingOut = true;
-						fadeProgress = anim.progress;
-						break;
-					}
-				}
-				
-			if (isFadingOut) {
-				// Draw fading out key with modern effect
-				float alpha = 1.0f - fadeProgress;
-				float scale = 1.0f - fadeProgress * 0.5f;
-				int fadeFontSize = (int)(fontSize * scale);
-				Color fadeColor = Color{255, 80, 80, (unsigned char)(255 * alpha)};
-					DrawTextEx(keyFont, s.c_str(), pos, fadeFontSize, 1, fadeColor);
+				if (isFadingOut) {
+					// Draw fading out key with modern effect
+					float alpha = 1.0f - fadeProgress;
+					float scale = 1.0f - fadeProgress * 0.5f;
+					int fadeFontSize = (int)(fontSize * scale);
+					Color fadeColor = Color{255, 80, 80, (unsigned char)(255 * alpha)};
+					keyTexts.push_back(KeyText{label, pos, (float)fadeFontSize, fadeColor});
 					
 					float circleRadius = 22.0f * scale;
-					DrawCircleV({tx, L.cy}, circleRadius + 2, Fade(fadeColor, alpha * 0.3f));
-					DrawCircleLinesV({tx, L.cy}, circleRadius, Fade(fadeColor, alpha * 0.9f));
-				} else if (isHighlighted) {
+					nodeBatch.circle({tx, cy}, circleRadius + 2, Fade(fadeColor, alpha * 0.3f));
+					nodeBatch.circleLines({tx, cy}, circleRadius, 1.0f, Fade(fadeColor, alpha * 0.9f));
+				} else {
 					// Highlighted key with glow effect
 					Color glowColor = highlightColor;
-					DrawCircleV({tx, L.cy}, 26, Fade(glowColor, 0.2f));
-					DrawCircleV({tx, L.cy}, 22, Fade(glowColor, 0.4f));
-					DrawTextEx(keyFont, s.c_str(), pos, fontSize, 1, glowColor);
-					DrawCircleLinesV({tx, L.cy}, 22, glowColor);
-				} else {
-					// Normal key with better styling
-					DrawTextEx(keyFont, s.c_str(), pos, fontSize, 1, Color{40, 50, 65, 255});
-				}
-				
-				// Hover effect with modern circle
-				Rectangle keyRect = { tx - 22, L.cy - 22, 44, 44 };
-				if (CheckCollisionPointRec(ctx.mouseWorld, keyRect)) {
-					Color hoverColor = Color{255, 180, 0, 255};
-					DrawCircleV({tx, L.cy}, 24, Fade(hoverColor, 0.15f));
-					DrawCircleLinesV({tx, L.cy}, 24, hoverColor);
-					ctx.hoveredKey = vec[i].value;
+					nodeBatch.circle({tx, cy}, 26, Fade(glowColor, 0.2f));
+					nodeBatch.circle({tx, cy}, 22, Fade(glowColor, 0.4f));
+					nodeBatch.circleLines({tx, cy}, 22, 1.0f, glowColor);
+					keyTexts.push_back(KeyText{label, pos, (float)fontSize, glowColor});
 				}
 			}
 			
-			// Draw child pointers with modern styling
-			auto &ptrs = nodePointerXs[node];
-			float pointerH = 8.0f;
-			for (float px : ptrs) {
-				float py = L.cy + 18.0f;
-				DrawCircle(px, py, 4, Color{100, 120, 150, 255});
-				DrawCircle(px, py, 2, Color{180, 190, 200, 255});
+			// Hover effect with modern circle
+			if (hover.view == index && hover.node == (int)(&sn - snap.nodes.data()) && hover.index == (int)i) {
+				Color hoverColor = Color{255, 180, 0, 255};
+				nodeBatch.circle({tx, cy}, 24, Fade(hoverColor, 0.15f));
+				nodeBatch.circleLines({tx, cy}, 24, 1.0f, hoverColor);
 			}
 		}
+	}
 
-		
-		for (auto &kv : nodeMap) {
-			BTree::Node* node = kv.first;
-			auto &ptrs = nodePointerXs[node];
-			for (size_t i = 0; i < node->children.size(); ++i) {
-				BTree::Node* child = node->children[i];
-				if (nodePointerXs.find(child) == nodePointerXs.end()) continue;
-				float fromX = (i < ptrs.size()) ? ptrs[i] : ptrs.back();
-				auto &childPtrs = nodePointerXs[child];
-				
-				float bestX = childPtrs.front(); float bestD = fabs(bestX - fromX);
-				for (float cx : childPtrs) { float d = fabs(cx - fromX); if (d < bestD) { bestD = d; bestX = cx; } }
-				float nodeH = 36.0f;
-				
-				float parentPtrY = layouts[node].cy + nodeH/2.0f + 6 + (8.0f/2.0f);
-				
-				float childCenterY = layouts[child].cy;
-				DrawLineEx({fromX, parentPtrY}, {bestX, childCenterY}, 2.0f, DARKGRAY);
-			}
-		}
-		
-		// Draw animated keys moving with enhanced visuals
-		for (const auto& anim : tree.getCurrentAnimations()) {
-			if (anim.type == BTree::AnimationType::KeyMoving) {
-				float t = easeInOutCubic(anim.progress);
-				
-				// Check if this is a deletion animation
-				bool isDeletion = (anim.operation == BTree::AnimationStep::DeleteKey);
-				
-				Vector2 startWorld, targetPos, currentPos;
-				
-				if (isDeletion) {
-					// For deletion: get current position from node and move UP and fade out
-					if (anim.targetNode && tree.nodeKeyPositions.find(anim.targetNode) != tree.nodeKeyPositions.end() &&
-					    anim.targetIndex < (int)tree.nodeKeyPositions[anim.targetNode].size()) {
-						startWorld = tree.nodeKeyPositions[anim.targetNode][anim.targetIndex];
-						// Move key upward and slightly to the side
-						targetPos = {startWorld.x + 50.0f, startWorld.y - 200.0f};
-					} else {
-						continue; // Skip if we can't find the position
-					}
-					currentPos.x = startWorld.x + (targetPos.x - startWorld.x) * t;
-					currentPos.y = startWorld.y + (targetPos.y - startWorld.y) * t;
+	nodeBatch.draw();
+	textFont.begin();
+	for (const auto& kt : keyTexts) keyLabels.draw(kt.label, kt.pos, kt.fontSize, kt.color);
+	textFont.end();
+	for (const auto& badge : nodeBadges) {
+		Vector2 textSize = textFont.measure(badge.text, 13, 1);
+		Vector2 textPos = { badge.nodeRect.x + badge.nodeRect.width/2 - textSize.x/2, badge.nodeRect.y - 30 };
+		Rectangle badgeRect = {textPos.x - 8, textPos.y - 4, textSize.x + 16, textSize.y + 8};
+		DrawRectangleRounded(badgeRect, 0.3f, 6, badge.color);
+		textFont.draw(badge.text, textPos, 13, 1, WHITE);
+	}
+	
+	// Draw animated keys moving with enhanced visuals
+	for (size_t ai = 0; ai < snap.animations.size(); ++ai) {
+		const auto& anim = snap.animations[ai];
+		if (anim.type == BTree::AnimationType::KeyMoving) {
+			float t = easeInOutCubic(anim.progress);
+			
+			// Check if this is a deletion animation
+			bool isDeletion = (anim.operation == BTree::AnimationStep::DeleteKey);
+			// B* rotation: from a child up into its parent, or down
+			bool isRotation = (anim.operation == BTree::AnimationStep::BalanceTree);
+			
+			Vector2 startWorld, targetPos, currentPos;
+			
+			if (isDeletion) {
+				// For deletion: get current position from node and move UP and fade out
+				if (!std::isnan(snap.animationAnchors[ai].x)) {
+					startWorld = snap.animationAnchors[ai];
+					// Move key upward and slightly to the side
+					targetPos = {startWorld.x + 50.0f, startWorld.y - 200.0f};
 				} else {
-					// For insertion: normal behavior
-					targetPos = anim.endPos;
-					startWorld = GetScreenToWorld2D(anim.startPos, camera);
-					currentPos.x = startWorld.x + (targetPos.x - startWorld.x) * t;
-					currentPos.y = startWorld.y + (targetPos.y - startWorld.y) * t;
+					continue; // Skip if we can't find the position
 				}
-				
-				// Draw the moving key with modern styling
-				float alpha = isDeletion ? (1.0f - t) : 1.0f; // Fade out for deletion
-				float scale = isDeletion ? (1.0f - t * 0.3f) : (1.0f + 0.2f * sin(anim.progress * 3.14159f));
-				int fontSize = (int)(24 * scale);
-				std::stringstream ss; ss << anim.movingKey;
-				std::string s = ss.str();
-				Vector2 textSize = MeasureTextEx(keyFont, s.c_str(), fontSize, 1);
-				
-			// Draw glowing effect with multiple circles
-			float radius = 28.0f * scale;
-			Color glowColor1 = isDeletion ? Color{255, 80, 80, 255} : Color{100, 180, 255, 255};
-			Color glowColor2 = isDeletion ? Color{255, 120, 120, 255} : Color{255, 200, 80, 255};				DrawCircleV(currentPos, radius + 12, Fade(glowColor1, 0.15f * alpha));
-				DrawCircleV(currentPos, radius + 6, Fade(glowColor1, 0.25f * alpha));
-				DrawCircleV(currentPos, radius + 3, Fade(glowColor2, 0.4f * alpha));
-				DrawCircleV(currentPos, radius, Fade(WHITE, alpha));
-				DrawCircleLinesV(currentPos, radius, Fade(glowColor2, alpha));
-				DrawCircleLinesV(currentPos, radius - 2, Fade(glowColor2, 0.5f * alpha));
-				
+				currentPos.x = startWorld.x + (targetPos.x - startWorld.x) * t;
+				currentPos.y = startWorld.y + (targetPos.y - startWorld.y) * t;
+			} else if (isRotation) {
+				// Both ends come from the layout, already in world space
+				if (std::isnan(snap.animationAnchors[ai].x)) continue;
+				startWorld = snap.animationAnchors[ai];
+				targetPos = anim.endPos;
+				currentPos.x = startWorld.x + (targetPos.x - startWorld.x) * t;
+				currentPos.y = startWorld.y + (targetPos.y - startWorld.y) * t;
+			} else {
+				// For insertion: normal behavior
+				targetPos = anim.endPos;
+				startWorld = GetScreenToWorld2D(anim.startPos, camera);
+				currentPos.x = startWorld.x + (targetPos.x - startWorld.x) * t;
+				currentPos.y = startWorld.y + (targetPos.y - startWorld.y) * t;
+			}
 			
-			// Draw the key value
-			Vector2 textPos = { currentPos.x - textSize.x/2.0f, currentPos.y - textSize.y/2.0f };
-			DrawTextEx(keyFont, s.c_str(), textPos, fontSize, 1, Fade(Color{40, 50, 65, 255}, alpha));				// Draw enhanced trail effect (only for insertion)
-				if (!isDeletion) {
-					for (int i = 1; i <= 5; ++i) {
-						float trailT = std::max(0.0f, t - i * 0.08f);
-						Vector2 trailPos;
-						trailPos.x = startWorld.x + (targetPos.x - startWorld.x) * trailT;
-						trailPos.y = startWorld.y + (targetPos.y - startWorld.y) * trailT;
-						float trailAlpha = 0.4f * (1.0f - i * 0.18f);
-						float trailScale = 1.0f - i * 0.12f;
-						DrawCircleV(trailPos, radius * trailScale * 0.7f, Fade(glowColor2, trailAlpha));
-					}
+			// Draw the moving key with modern styling
+			float alpha = isDeletion ? (1.0f - t) : 1.0f; // Fade out for deletion
+			float scale = isDeletion ? (1.0f - t * 0.3f) : (1.0f + 0.2f * sin(anim.progress * 3.14159f));
+			int fontSize = (int)(24 * scale);
+			const LabelCache::Label& label = keyLabels.get(anim.movingKey);
+			Vector2 textSize = keyLabels.measure(label, fontSize);
+			
+		// Draw glowing effect with multiple circles
+		float radius = 28.0f * scale;
+		Color glowColor1 = isDeletion ? Color{255, 80, 80, 255} : Color{100, 180, 255, 255};
+		Color glowColor2 = isDeletion ? Color{255, 120, 120, 255} : Color{255, 200, 80, 255};				DrawCircleV(currentPos, radius + 12, Fade(glowColor1, 0.15f * alpha));
+			DrawCircleV(currentPos, radius + 6, Fade(glowColor1, 0.25f * alpha));
+			DrawCircleV(currentPos, radius + 3, Fade(glowColor2, 0.4f * alpha));
+			DrawCircleV(currentPos, radius, Fade(WHITE, alpha));
+			DrawCircleLinesV(currentPos, radius, Fade(glowColor2, alpha));
+			DrawCircleLinesV(currentPos, radius - 2, Fade(glowColor2, 0.5f * alpha));
+			
+		
+		// Draw the key value
+		Vector2 textPos = { currentPos.x - textSize.x/2.0f, currentPos.y - textSize.y/2.0f };
+		textFont.begin();
+		keyLabels.draw(label, textPos, fontSize, Fade(Color{40, 50, 65, 255}, alpha));
+		textFont.end();				// Draw enhanced trail effect (only for insertion)
+			if (!isDeletion) {
+				for (int i = 1; i <= 5; ++i) {
+					float trailT = std::max(0.0f, t - i * 0.08f);
+					Vector2 trailPos;
+					trailPos.x = startWorld.x + (targetPos.x - startWorld.x) * trailT;
+					trailPos.y = startWorld.y + (targetPos.y - startWorld.y) * trailT;
+					float trailAlpha = 0.4f * (1.0f - i * 0.18f);
+					float trailScale = 1.0f - i * 0.12f;
+					DrawCircleV(trailPos, radius * trailScale * 0.7f, Fade(glowColor2, trailAlpha));
 				}
 			}
 		}
+	}
+}
+
+void App::drawViewHeaders() {
+	for (size_t i = 0; i < views.size(); ++i) {
+		const Rectangle& vp = views[i]->viewport;
+		const RenderSnapshot& s = views[i]->worker.snapshot();
+		if (i > 0) DrawLineEx({vp.x, vp.y}, {vp.x, vp.y + vp.height}, 2.0f, Color{200, 210, 220, 255});
+		char lines[2][96];
+		snprintf(lines[0], sizeof(lines[0]), "t = %d%s   height %d   nodes %zu", s.degree, s.bStar ? " B*" : "", s.stats.height(), s.stats.nodes);
+		snprintf(lines[1], sizeof(lines[1]), "%.1f KiB   last op %.3f ms", (double)s.memoryBytes / 1024.0, s.operationSeconds * 1000.0);
+		float w = std::max(textFont.measure(lines[0], 16, 1).x, textFont.measure(lines[1], 16, 1).x);
+		Rectangle box = {vp.x + 12.0f, vp.y + 72.0f, w + 20.0f, 52.0f};
+		DrawRectangleRounded(box, 0.2f, 6, Fade(WHITE, 0.92f));
+		DrawRectangleRoundedLines(box, 0.2f, 6, Color{200, 210, 220, 255});
+		for (int l = 0; l < 2; ++l) {
+			textFont.draw(lines[l], {box.x + 10.0f, box.y + 6.0f + l * 22.0f}, 16, 1, Color{55, 65, 81, 255});
+		}
+	}
+}
+
+void App::frame() {
+	// Time spent asleep waiting for input is not animation time
+	double frameStart = GetTime();
+	float deltaTime = exporting ? exportStep : sleeping ? 0.0f : (float)(frameStart - lastFrameStart);
+	lastFrameStart = frameStart;
+	animationClock += deltaTime;
+	
+	// Update camera animation
+	if (cameraAnimating) {
+		cameraAnimProgress += deltaTime / cameraAnimDuration;
+		if (cameraAnimProgress >= 1.0f) {
+			cameraAnimProgress = 1.0f;
+			cameraAnimating = false;
+		}
 		
-	EndMode2D();
+		// Apply easing
+		float t = easeInOutCubic(cameraAnimProgress);
+		
+		// Interpolate zoom and pan
+		zoom = cameraStartZoom + (cameraTargetZoom - cameraStartZoom) * t;
+		pan.x = cameraStartPan.x + (cameraTargetPan.x - cameraStartPan.x) * t;
+		pan.y = cameraStartPan.y + (cameraTargetPan.y - cameraStartPan.y) * t;
+	}
 	
-	hoveredKey = ctx.hoveredKey;
+	// Update screen dimensions if window was resized
+	int newWidth = GetScreenWidth();
+	int newHeight = GetScreenHeight();
+	bool windowResized = (newWidth != screenWidth || newHeight != screenHeight);
+	screenWidth = newWidth;
+	screenHeight = newHeight;
+	layoutViews();
+	
+	// Advance animations on the workers and pick up their latest snapshots.
+	// Idle before consume() means nothing can be published after it.
+	bool settled = true, fresh = false, treeBusy = false;
+	uint64_t completedAnimations = 0;
+	for (auto& view : views) {
+		settled = view->worker.idle() && settled;
+		view->worker.tick(deltaTime);
+		view->worker.pump();
+		fresh = view->worker.consume() || fresh;
+		const RenderSnapshot& viewSnap = view->worker.snapshot();
+		treeBusy = treeBusy || viewSnap.animating || !view->worker.idle();
+		completedAnimations += viewSnap.completedAnimations;
+	}
+	const RenderSnapshot& snap = worker.snapshot();
 
-// Modern title bar
-Rectangle titleBar = {0, 0, (float)screenWidth, 60};
-DrawRectangleGradientV(0, 0, screenWidth, 60, 
-	Color{55, 65, 81, 255}, Color{75, 85, 99, 255});	const char* title = "B-Tree Visualizer";
-	Vector2 titleSize = MeasureTextEx(titleFont, title, 28, 1);
-	DrawTextEx(titleFont, title, {20, 16}, 28, 1, WHITE);
+	// A replayed trace releases its next operations once every tree settles
+	if (replay.active()) {
+		replay.feed(deltaTime, !treeBusy, workers, snap);
+		if (!workersIdle()) shouldFitViewAfterAnimation = true;
+	}
+	
+	// Fit view after each animation step completes
+	if (completedAnimations != seenCompletedAnimations) {
+		seenCompletedAnimations = completedAnimations;
+		if (shouldFitViewAfterAnimation) fitViewToTree();
+	}
 	
-	// Subtitle
-	const char* subtitle = "Interactive Animation & Exploration";
-	DrawTextEx(uiFont, subtitle, {22, 44}, 14, 1, Fade(WHITE, 0.7f));
+	// Clear the flag when all animations are done
+	if (!treeBusy && shouldFitViewAfterAnimation) {
+		shouldFitViewAfterAnimation = false;
+	}
 
+	if (fitViewOnNextLayout && workersIdle() && snap.layoutVersion != views[0]->seenLayoutVersion) {
+		fitViewToTree(false);
+		fitViewOnNextLayout = false;
+	}
 	
-	int hudFontSize = 16;
-	std::vector<std::string> legend = {
-		"A  Add random key",
-		"M  Add multiple keys",
-		"I  Insert typed value",
-		"D  Delete last added",
-		"H  Delete hovered key",
-		"X  Clear all keys",
-		"Z  Zoom to fit",
-		"R  Reset with samples",
-		"",
-		"Drag  Pan view",
-		"Wheel  Zoom",
-	};
+	// Auto-fit on window resize
+	if (windowResized && !snap.animating) {
+		fitViewToTree();
+	}
+	
+	if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+		if (!treeBusy && !typing && (IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT))) {
+			selecting = true;
+			selectStart = GetMousePosition();
+		} else {
+			dragging = true;
+			lastMouse = GetMousePosition();
+			cameraAnimating = false; // Stop camera animation when user starts dragging
+		}
+	}
+	if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT)) {
+		dragging = false;
+		if (selecting) {
+			selecting = false;
+			eraseKeysInBox(selectStart, GetMousePosition());
+		}
+	}
+	if (dragging) {
+		Vector2 m = GetMousePosition();
+		pan.x += (m.x - lastMouse.x) / zoom;
+		pan.y += (m.y - lastMouse.y) / zoom;
+		lastMouse = m;
+	}
+
+	float wheel = GetMouseWheelMove();
+	if (wheel != 0) {
+		cameraAnimating = false; // Stop camera animation when user zooms manually
+		float oldZoom = zoom;
+		zoom *= (1.0f + wheel * 0.1f);
+		if (zoom < 0.1f) zoom = 0.1f;
+		if (zoom > 4.0f) zoom = 4.0f;
+		
+		// Keeps the point under the cursor in place within its view
+		Vector2 m = GetMousePosition();
+		const Rectangle& vp = views[viewAt(m)]->viewport;
+		m.x -= vp.x;
+		m.y -= vp.y;
+		pan.x = (pan.x - m.x / oldZoom) * (zoom / oldZoom) + m.x / zoom;
+		pan.y = (pan.y - m.y / oldZoom) * (zoom / oldZoom) + m.y / zoom;
+	}
+
+	
+	// Input handling - only allow when not animating
+	bool canInput = !treeBusy;
+	
+	if (canInput && IsKeyPressed(KEY_A)) { 
+		// Worker picks a key that is not in the tree yet
+		post({TreeWorker::Command::AddRandom});
+		shouldFitViewAfterAnimation = true;
+	}
+	if (canInput && IsKeyPressed(KEY_M)) { 
+		typing = true; typed = ""; typingMode = TypingMode::Multi;
+	}
+	if (canInput && IsKeyPressed(KEY_I)) { 
+		typing = true; typed = ""; typingMode = TypingMode::Insert;
+	}
+	if (canInput && IsKeyPressed(KEY_S)) {
+		typing = true; typed = ""; typingMode = TypingMode::Search;
+	}
+	if (canInput && IsKeyPressed(KEY_P) && !snap.split) {
+		typing = true; typed = ""; typingMode = TypingMode::Split;
+	}
+	if (canInput && IsKeyPressed(KEY_J) && snap.split) {
+		post({TreeWorker::Command::JoinSplit});
+		shouldFitViewAfterAnimation = true;
+	}
+	if (canInput && IsKeyPressed(KEY_D)) {
+		// Delete last added key
+		if (snap.hasKeys) {
+			post({TreeWorker::Command::EraseLast});
+			shouldFitViewAfterAnimation = true;
+		}
+	}
+	if (canInput && IsKeyPressed(KEY_X)) { 
+		post({TreeWorker::Command::Clear});
+	}
+	if (canInput && IsKeyPressed(KEY_H)) { 
+		if (hoveredKey != -1) {
+			post({TreeWorker::Command::EraseKey, hoveredKey});
+			shouldFitViewAfterAnimation = true;
+		}
+	}
+	if (canInput && IsKeyPressed(KEY_Z)) { 
+		fitViewToTree();
+	}
+	if (IsKeyPressed(KEY_O) && !typing) {
+		occupancyOverlay = !occupancyOverlay;
+		for (auto& view : views) view->tileCache.invalidateAll();
+	}
+	if (IsKeyPressed(KEY_T) && !typing) {
+		// Heat is only collected while the overlay is shown
+		heatOverlay = !heatOverlay;
+		post({TreeWorker::Command::SetHeat, 0, heatOverlay ? 1 : 0});
+	}
+	if (IsKeyPressed(KEY_C) && !typing) {
+		// The simulated cache starts cold each time it is turned on
+		missOverlay = !missOverlay;
+		post({TreeWorker::Command::SetCacheSim, 0, missOverlay ? 1 : 0});
+	}
+	if (canInput && (IsKeyPressed(KEY_LEFT_BRACKET) || IsKeyPressed(KEY_RIGHT_BRACKET))) {
+		// Rebuild with the next smaller/larger minimum degree; compared
+		// trees each step from their own
+		int step = IsKeyPressed(KEY_RIGHT_BRACKET) ? 1 : -1;
+		for (auto& view : views) {
+			int t = view->worker.snapshot().degree + step;
+			if (t < 2 || (t > 32 && step > 0)) continue;
+			view->worker.post({TreeWorker::Command::SetDegree, 0, t});
+			fitViewOnNextLayout = true;
+		}
+	}
+	if (canInput && IsKeyPressed(KEY_B)) {
+		// Later inserts only; the keys already in place stay where they are
+		for (auto& view : views) {
+			view->worker.post({TreeWorker::Command::SetBStar, 0, view->worker.snapshot().bStar ? 0 : 1});
+		}
+	}
+	if (canInput && IsKeyPressed(KEY_R)) { 
+		// Insert 8 unique random keys
+		post({TreeWorker::Command::Reset, 0, 8});
+		
+		// Fit view immediately for reset (no animation)
+		fitViewOnNextLayout = true;
+	}
+
 	
-	float padding = 16.0f;
-	float lineSpacing = 8.0f;
-	float maxW = 0;
-	for (auto &s : legend) {
-		if (!s.empty()) {
-			maxW = std::max(maxW, MeasureTextEx(uiFont, s.c_str(), hudFontSize, 1).x);
+	int ch = GetCharPressed();
+	while (ch > 0) {
+		if (typing) {
+			char c = (char)ch;
+			if ((c >= '0' && c <= '9') || c=='-' ) typed.push_back(c);
+			// "key=value" sets a value, Insert prompt only
+			if (c == '=' && typingMode == TypingMode::Insert && typed.find('=') == std::string::npos) typed.push_back(c);
+		}
+		ch = GetCharPressed();
+	}
+	if (typing) {
+		if (IsKeyPressed(KEY_BACKSPACE) && !typed.empty()) typed.pop_back();
+		if (IsKeyPressed(KEY_ESCAPE)) { typing = false; typed.clear(); typingMode = TypingMode::None; }
+		if (IsKeyPressed(KEY_ENTER) || IsKeyPressed(KEY_KP_ENTER)) {
+			if (!typed.empty()) {
+				int v = 0;
+				const char* typedEnd = typed.data() + typed.size();
+				auto res = std::from_chars(typed.data(), typedEnd, v);
+				if (res.ec == std::errc() && res.ptr == typedEnd) {
+					if (typingMode == TypingMode::Insert) {
+						// Worker skips keys that are already present
+						post({TreeWorker::Command::InsertKey, v});
+					} else if (typingMode == TypingMode::Multi) {
+						int count = std::max(0, v);
+						post({TreeWorker::Command::AddRandomMany, 0, count});
+					} else if (typingMode == TypingMode::Search) {
+						post({TreeWorker::Command::SearchKey, v});
+					} else if (typingMode == TypingMode::Split) {
+						post({TreeWorker::Command::SplitAt, v});
+					}
+				} else if (res.ec == std::errc() && *res.ptr == '=' && typingMode == TypingMode::Insert) {
+					long long value = 0;
+					auto vres = std::from_chars(res.ptr + 1, typedEnd, value);
+					if (vres.ec == std::errc() && vres.ptr == typedEnd) {
+						post({TreeWorker::Command::UpsertKey, v, 0, (BTree::Value)value});
+					}
+				}
+			}
+			typing = false; typed.clear(); typingMode = TypingMode::None;
+			shouldFitViewAfterAnimation = true;
 		}
 	}
-	float boxW = maxW + padding*2 + 40; // Extra padding to prevent overflow
-	float lineH = MeasureTextEx(uiFont, "Tg", hudFontSize, 1).y;
-	// Count non-empty lines for proper height calculation
-	int nonEmptyLines = 0;
-	for (auto &s : legend) {
-		if (!s.empty()) nonEmptyLines++;
+	if (IsKeyPressed(KEY_KP_ADD) || IsKeyPressed(KEY_EQUAL)) {
+		cameraAnimating = false; // Stop camera animation
+		zoom = std::min(zoom * 1.1f, 4.0f);
+	}
+	if (IsKeyPressed(KEY_KP_SUBTRACT) || IsKeyPressed(KEY_MINUS)) {
+		cameraAnimating = false; // Stop camera animation
+		zoom = std::max(zoom * 0.9f, 0.1f);
 	}
-	float boxH = (lineH + lineSpacing) * nonEmptyLines + padding*2 + 36; // +36 for title and separator
-	float bx = screenWidth - boxW - 20.0f;
-	float by = 80.0f;
 
 	
+	// Anything whose geometry or labels changed since the last layout
+	// dirties the tiles under both its old and new bounds, per tree
+	bool relaidOut = false;
+	for (auto& view : views) relaidOut = updateStatic(*view) || relaidOut;
+
+	struct DrawCtx { Vector2 mouseWorld; int hoveredKey; BTree::Value hoveredValue; uint32_t hoveredCount; } ctx;
+	Vector2 mp = GetMousePosition();
+	size_t hoverView = viewAt(mp);
+	ctx.mouseWorld = GetScreenToWorld2D(mp, viewCamera(*views[hoverView]));
+	// Nothing is hovered in an export; there is no cursor over it
+	hover = exporting ? HoverTarget{} : hoverAt(*views[hoverView], (int)hoverView, ctx.mouseWorld);
+	ctx.hoveredKey = -1;
+	ctx.hoveredValue = 0;
+	ctx.hoveredCount = 0;
+	if (hover.node >= 0) {
+		const RenderSnapshot& hovered = views[hover.view]->worker.snapshot();
+		size_t v = hovered.nodes[hover.node].firstValue + hover.index;
+		ctx.hoveredKey = hovered.values[v];
+		ctx.hoveredValue = hovered.payloads[v];
+		ctx.hoveredCount = hovered.counts[v];
+	}
+	hoveredKey = ctx.hoveredKey;
+
+	// With nothing moving the next frame may sleep until input arrives, and
+	// this one is skipped unless it would look different from the last
+	bool active = treeBusy || !settled || !workersIdle() || cameraAnimating || dragging || selecting || replay.active();
+	bool wait = idleWait && !active;
+	if (wait != sleeping) {
+		if (wait) EnableEventWaiting();
+		else DisableEventWaiting();
+		sleeping = wait;
+	}
+	bool keyed = false;
+	while (GetKeyPressed() != 0) keyed = true;
+	Vector2 mouseDelta = GetMouseDelta();
+	bool mouseMoved = mouseDelta.x != 0.0f || mouseDelta.y != 0.0f;
+	bool changed = !drawnOnce || fresh || relaidOut || windowResized || keyed ||
+		IsMouseButtonPressed(MOUSE_BUTTON_LEFT) || IsMouseButtonReleased(MOUSE_BUTTON_LEFT) ||
+		pan.x != drawnPan.x || pan.y != drawnPan.y || zoom != drawnZoom ||
+		!(hover == drawnHover) || (hover.node >= 0 && mouseMoved) || IsWindowFocused() != drawnFocused;
+	if (wait && !changed) {
+		PollInputEvents();
+		return;
+	}
+	drawnOnce = true;
+	drawnPan = pan;
+	drawnZoom = zoom;
+	drawnHover = hover;
+	drawnFocused = IsWindowFocused();
+
+	// Tiles render into their own textures, so before the frame's target
+	// is bound
+	for (auto& view : views) {
+		TreeView* v = view.get();
+		view->tileCache.update(visibleWorld(*view), [this, v](Rectangle tileWorld) { return drawStaticTile(*v, tileWorld); });
+	}
+
+if (exporting) BeginTextureMode(exportTarget);
+else BeginDrawing();
+// Modern gradient background
+ClearBackground(Color{245, 247, 250, 255});
+DrawRectangleGradientV(0, 0, screenWidth, screenHeight/3, 
+	Color{240, 242, 245, 255}, Color{245, 247, 250, 255});
+
+	// Each tree in its own viewport under the shared pan and zoom
+	for (size_t i = 0; i < views.size(); ++i) {
+		TreeView& view = *views[i];
+		const RenderSnapshot& viewSnap = view.worker.snapshot();
+		Camera2D camera = viewCamera(view);
+		const Rectangle& vp = view.viewport;
+		if (comparing()) BeginScissorMode((int)vp.x, (int)vp.y, (int)vp.width, (int)vp.height);
+		BeginMode2D(camera);
+		drawView(view, (int)i, camera, visibleWorld(view));
+		EndMode2D();
+
+		// Caption over the right half of a split
+		if (viewSnap.split) {
+			char caption[64];
+			snprintf(caption, sizeof(caption), "keys >= %d  (J to join)", viewSnap.splitPivot);
+			Vector2 captionSize = textFont.measure(caption, 16, 1);
+			Vector2 top = GetWorldToScreen2D({viewSnap.splitBounds.x + viewSnap.splitBounds.width / 2, viewSnap.splitBounds.y}, camera);
+			textFont.draw(caption, {top.x - captionSize.x / 2, top.y - captionSize.y - 12}, 16, 1, Color{249, 115, 22, 255});
+		}
+		if (comparing()) EndScissorMode();
+	}
+	if (comparing()) drawViewHeaders();
+
+// Rubber band of a Shift+drag selection
+if (selecting) {
+	Rectangle band = {std::min(selectStart.x, mp.x), std::min(selectStart.y, mp.y),
+	                  std::fabs(mp.x - selectStart.x), std::fabs(mp.y - selectStart.y)};
+	DrawRectangleRec(band, Fade(Color{239, 68, 68, 255}, 0.12f));
+	DrawRectangleLinesEx(band, 1.5f, Color{239, 68, 68, 255});
+}
+
+// Value of the hovered key, next to the cursor
+if (hoveredKey != -1) {
+	char tip[96];
+	if (ctx.hoveredCount > 1) {
+		snprintf(tip, sizeof(tip), "key %d x%u  value %lld", hoveredKey, (unsigned)ctx.hoveredCount, (long long)ctx.hoveredValue);
+	} else {
+		snprintf(tip, sizeof(tip), "key %d  value %lld", hoveredKey, (long long)ctx.hoveredValue);
+	}
+	Vector2 tipSize = textFont.measure(tip, 16, 1);
+	Rectangle tipRect = {mp.x + 16.0f, mp.y + 16.0f, tipSize.x + 16.0f, tipSize.y + 10.0f};
+	DrawRectangleRounded(tipRect, 0.3f, 6, Fade(Color{31, 41, 55, 255}, 0.92f));
+	textFont.draw(tip, {tipRect.x + 8.0f, tipRect.y + 5.0f}, 16, 1, WHITE);
+}
+
+// Modern title bar
+Rectangle titleBar = {0, 0, (float)screenWidth, 60};
+DrawRectangleGradientV(0, 0, screenWidth, 60, 
+Color{55, 65, 81, 255}, Color{75, 85, 99, 255});	const char* title = "B-Tree Visualizer";
+Vector2 titleSize = textFont.measure(title, 28, 1);
+textFont.draw(title, {20, 16}, 28, 1, WHITE);
+
+// Subtitle
+const char* subtitle = "Interactive Animation & Exploration";
+textFont.draw(subtitle, {22, 44}, 14, 1, Fade(WHITE, 0.7f));
+
+// Current order, changed with [ and ]
+char orderText[64];
+if (comparing()) snprintf(orderText, sizeof(orderText), "%zu trees, same operations", views.size());
+else snprintf(orderText, sizeof(orderText), "t = %d  (%d-%d keys per node)%s", snap.degree, snap.degree - 1, 2 * snap.degree - 1, snap.bStar ? "  B*" : "");
+Vector2 orderSize = textFont.measure(orderText, 16, 1);
+textFont.draw(orderText, {(float)screenWidth - orderSize.x - 20.0f, 22}, 16, 1, Fade(WHITE, 0.85f));
+
+
+int hudFontSize = 16;
+std::vector<std::string> legend = {
+	"A  Add random key",
+	"M  Add multiple keys",
+	"I  Insert typed value",
+	"S  Search for a key",
+	"P  Split at a pivot key",
+	"J  Join split trees",
+	"D  Delete last added",
+	"H  Delete hovered key",
+	"X  Clear all keys",
+	"Z  Zoom to fit",
+	"R  Reset with samples",
+	"O  Occupancy overlay",
+	"T  Access heat overlay",
+	"C  Cache miss overlay",
+	"B  B* inserts on/off",
+	"",
+	"Drag  Pan view",
+	"Shift+Drag  Delete keys in box",
+	"Wheel  Zoom",
+};
+
+float padding = 16.0f;
+float lineSpacing = 8.0f;
+float maxW = 0;
+for (auto &s : legend) {
+	if (!s.empty()) {
+		maxW = std::max(maxW, textFont.measure(s.c_str(), hudFontSize, 1).x);
+	}
+}
+float boxW = maxW + padding*2 + 40; // Extra padding to prevent overflow
+float lineH = textFont.measure("Tg", hudFontSize, 1).y;
+// Count non-empty lines for proper height calculation
+int nonEmptyLines = 0;
+for (auto &s : legend) {
+	if (!s.empty()) nonEmptyLines++;
+}
+float boxH = (lineH + lineSpacing) * nonEmptyLines + padding*2 + 36; // +36 for title and separator
+float bx = screenWidth - boxW - 20.0f;
+float by = 80.0f;
+
+
 
 Rectangle legendRect = { bx, by, boxW, boxH };
 // Shadow
@@ -682,108 +1248,269 @@ DrawRectangleRounded(Rectangle{bx + 3, by + 3, boxW, boxH}, 0.15f, 8, Fade(BLACK
 // Background
 DrawRectangleRounded(legendRect, 0.15f, 8, Fade(Color{255, 255, 255, 255}, 0.96f));
 DrawRectangleRoundedLines(legendRect, 0.15f, 8, Color{200, 210, 220, 255});	// Legend title
-	const char* legendTitle = "Controls";
-	Vector2 legendTitleSize = MeasureTextEx(uiFont, legendTitle, 18, 1);
-	DrawTextEx(uiFont, legendTitle, {bx + padding, by + padding - 2}, 18, 1, Color{55, 65, 81, 255});
-	
-	// Separator line
-	DrawLineEx({bx + padding, by + padding + 22}, 
-		{bx + boxW - padding, by + padding + 22}, 2, Fade(Color{200, 210, 220, 255}, 0.5f));
+const char* legendTitle = "Controls";
+Vector2 legendTitleSize = textFont.measure(legendTitle, 18, 1);
+textFont.draw(legendTitle, {bx + padding, by + padding - 2}, 18, 1, Color{55, 65, 81, 255});
+
+// Separator line
+DrawLineEx({bx + padding, by + padding + 22}, 
+	{bx + boxW - padding, by + padding + 22}, 2, Fade(Color{200, 210, 220, 255}, 0.5f));
 
+
+for (size_t i = 0; i < legend.size(); ++i) {
+	if (legend[i].empty()) continue; // Skip empty lines
+	
+	float tx = bx + padding + 28;
+	float ty = by + padding + 32 + i * (lineH + lineSpacing);
 	
-	for (size_t i = 0; i < legend.size(); ++i) {
-		if (legend[i].empty()) continue; // Skip empty lines
+	// Check if this is a keyboard shortcut (starts with single letter)
+	bool isKeyShortcut = legend[i].length() > 2 && legend[i][1] == ' ';
+	
+	if (isKeyShortcut) {
+		// Draw key icon
+		char keyChar[2] = {legend[i][0], '\0'};
+		Rectangle keyIcon = { bx + padding, ty - 2, 20, 20 };
+		DrawRectangleRounded(keyIcon, 0.25f, 4, Color{100, 180, 255, 255});
+		DrawRectangleRoundedLines(keyIcon, 0.25f, 4, Color{70, 140, 220, 255});
 		
-		float tx = bx + padding + 28;
-		float ty = by + padding + 32 + i * (lineH + lineSpacing);
+		Vector2 keyTextSize = textFont.measure(keyChar, 14, 1);
+		textFont.draw(keyChar, 
+			{keyIcon.x + 10 - keyTextSize.x/2, keyIcon.y + 10 - keyTextSize.y/2}, 
+			14, 1, WHITE);
 		
-		// Check if this is a keyboard shortcut (starts with single letter)
-		bool isKeyShortcut = legend[i].length() > 2 && legend[i][1] == ' ';
+		// Draw description
+		const char* desc = legend[i].c_str() + 2;
+		textFont.draw(desc, {tx, ty}, hudFontSize, 1, Color{75, 85, 99, 255});
+	} else {
+		// Draw mouse action icon
+		DrawCircle(bx + padding + 8, ty + 8, 6, Color{150, 160, 170, 255});
+		DrawCircle(bx + padding + 8, ty + 8, 4, Color{200, 210, 220, 255});
 		
-		if (isKeyShortcut) {
-			// Draw key icon
-			char keyChar[2] = {legend[i][0], '\0'};
-			Rectangle keyIcon = { bx + padding, ty - 2, 20, 20 };
-			DrawRectangleRounded(keyIcon, 0.25f, 4, Color{100, 180, 255, 255});
-			DrawRectangleRoundedLines(keyIcon, 0.25f, 4, Color{70, 140, 220, 255});
-			
-			Vector2 keyTextSize = MeasureTextEx(uiFont, keyChar, 14, 1);
-			DrawTextEx(uiFont, keyChar, 
-				{keyIcon.x + 10 - keyTextSize.x/2, keyIcon.y + 10 - keyTextSize.y/2}, 
-				14, 1, WHITE);
-			
-			// Draw description
-			const char* desc = legend[i].c_str() + 2;
-			DrawTextEx(uiFont, desc, {tx, ty}, hudFontSize, 1, Color{75, 85, 99, 255});
-		} else {
-			// Draw mouse action icon
-			DrawCircle(bx + padding + 8, ty + 8, 6, Color{150, 160, 170, 255});
-			DrawCircle(bx + padding + 8, ty + 8, 4, Color{200, 210, 220, 255});
-			
-			DrawTextEx(uiFont, legend[i].c_str(), {tx, ty}, hudFontSize, 1, Color{75, 85, 99, 255});
-		}
+		textFont.draw(legend[i].c_str(), {tx, ty}, hudFontSize, 1, Color{75, 85, 99, 255});
 	}
+}
 
-	if (typing) {
-		std::string promptText = typingMode == TypingMode::Multi ? 
-			"Enter number of keys to add: " : "Enter value to insert: ";
-		std::string fullText = promptText + typed + "_";
-		
-		// Modern input box
-		Vector2 textSize = MeasureTextEx(uiFont, fullText.c_str(), 18, 1);
-		float inputBoxW = std::max(300.0f, textSize.x + 40);
-		float inputBoxH = 60;
-		float inputX = (screenWidth - inputBoxW) / 2;
-		float inputY = screenHeight - 100;
-		
-		Rectangle inputBox = {inputX, inputY, inputBoxW, inputBoxH};
-		// Shadow
-		DrawRectangleRounded(Rectangle{inputX + 3, inputY + 3, inputBoxW, inputBoxH}, 
-			0.2f, 8, Fade(BLACK, 0.25f));
-		// Background
-		DrawRectangleRounded(inputBox, 0.2f, 8, Color{255, 255, 255, 255});
-		DrawRectangleRoundedLines(inputBox, 0.2f, 8, Color{100, 180, 255, 255});
-		
-		DrawTextEx(uiFont, fullText.c_str(), 
-			{inputX + 20, inputY + (inputBoxH - textSize.y)/2}, 18, 1, Color{40, 50, 65, 255});
-		
-		// Help text
-		const char* helpText = "Enter to submit • Esc to cancel";
-		Vector2 helpSize = MeasureTextEx(uiFont, helpText, 13, 1);
-		DrawTextEx(uiFont, helpText, 
-			{inputX + (inputBoxW - helpSize.x)/2, inputY - 20}, 13, 1, Color{120, 130, 140, 255});
+if (typing) {
+	std::string promptText = typingMode == TypingMode::Multi ? "Enter number of keys to add: " :
+		typingMode == TypingMode::Search ? "Enter key to search for: " :
+		typingMode == TypingMode::Split ? "Enter pivot key to split at: " : "Enter key (or key=value) to insert: ";
+	std::string fullText = promptText + typed + "_";
+	
+	// Modern input box
+	Vector2 textSize = textFont.measure(fullText.c_str(), 18, 1);
+	float inputBoxW = std::max(300.0f, textSize.x + 40);
+	float inputBoxH = 60;
+	float inputX = (screenWidth - inputBoxW) / 2;
+	float inputY = screenHeight - 100;
+	
+	Rectangle inputBox = {inputX, inputY, inputBoxW, inputBoxH};
+	// Shadow
+	DrawRectangleRounded(Rectangle{inputX + 3, inputY + 3, inputBoxW, inputBoxH}, 
+		0.2f, 8, Fade(BLACK, 0.25f));
+	// Background
+	DrawRectangleRounded(inputBox, 0.2f, 8, Color{255, 255, 255, 255});
+	DrawRectangleRoundedLines(inputBox, 0.2f, 8, Color{100, 180, 255, 255});
+	
+	textFont.draw(fullText.c_str(), 
+		{inputX + 20, inputY + (inputBoxH - textSize.y)/2}, 18, 1, Color{40, 50, 65, 255});
+	
+	// Help text
+	const char* helpText = "Enter to submit • Esc to cancel";
+	Vector2 helpSize = textFont.measure(helpText, 13, 1);
+	textFont.draw(helpText, 
+		{inputX + (inputBoxW - helpSize.x)/2, inputY - 20}, 13, 1, Color{120, 130, 140, 255});
+}
+
+// Tree statistics with the occupancy overlay, above the replay line
+if (occupancyOverlay) {
+	const BTree::Stats& st = snap.stats;
+	char lines[4][160];
+	snprintf(lines[0], sizeof(lines[0]), "height %d   nodes %zu (%zu leaves)   keys %zu",
+		st.height(), st.nodes, st.leaves, st.keys);
+	snprintf(lines[1], sizeof(lines[1]), "fill %.0f%% of %d slots   %.1f KiB   %.1f B/key",
+		snap.fill * 100.0, 2 * snap.degree - 1, (double)snap.memoryBytes / 1024.0,
+		st.keys ? (double)snap.memoryBytes / (double)st.keys : 0.0);
+	// Nodes per depth, root first
+	int used = snprintf(lines[2], sizeof(lines[2]), "nodes by depth:");
+	for (size_t d = st.levelNodes.size(); d-- > 0 && used < (int)sizeof(lines[2]);) {
+		used += snprintf(lines[2] + used, sizeof(lines[2]) - used, " %zu", st.levelNodes[d]);
+	}
+	snprintf(lines[3], sizeof(lines[3]), "occupancy");
+	float lineY = (float)screenHeight - 60.0f - 4 * 22.0f;
+	for (int i = 0; i < 4; ++i) {
+		textFont.draw(lines[i], {20.0f, lineY + i * 22.0f}, 16, 1, Color{75, 85, 99, 255});
+	}
+	// Color key for the overlay next to the last line
+	float keyX = 20.0f + textFont.measure(lines[3], 16, 1).x + 10.0f;
+	for (int i = 0; i < 100; ++i) {
+		DrawRectangle((int)keyX + i * 2, (int)(lineY + 3 * 22.0f + 3.0f), 2, 12, occupancyColor(i / 99.0f));
+	}
+	textFont.draw("empty", {keyX, lineY + 3 * 22.0f + 16.0f}, 12, 1, Color{120, 130, 140, 255});
+	Vector2 fullSize = textFont.measure("full", 12, 1);
+	textFont.draw("full", {keyX + 200.0f - fullSize.x, lineY + 3 * 22.0f + 16.0f}, 12, 1, Color{120, 130, 140, 255});
+}
+
+// Simulated cache and TLB behind the miss overlay, and what the last
+// operation cost in them
+if (missOverlay) {
+	const CacheShape& cs = worker.cacheShape();
+	const CacheShape& ts = worker.tlbShape();
+	const MissCounts& last = snap.lastAccess;
+	char lines[2][160];
+	snprintf(lines[0], sizeof(lines[0]), "last op: %llu lines, %llu cache misses, %llu TLB misses",
+		(unsigned long long)last.lines, (unsigned long long)last.cacheMisses, (unsigned long long)last.tlbMisses);
+	snprintf(lines[1], sizeof(lines[1]), "cache %zu KiB %zu-way %zu B lines, TLB %zu x %zu-way %zu KiB pages",
+		cs.blocks * cs.blockBytes / 1024, cs.ways, cs.blockBytes, ts.blocks, ts.ways, ts.blockBytes / 1024);
+	for (int i = 0; i < 2; ++i) {
+		textFont.draw(lines[i], {20.0f, 130.0f + i * 22.0f}, 16, 1, Color{75, 85, 99, 255});
+	}
+}
+
+// Replay progress along the bottom edge
+if (replay.active() || replay.done()) {
+	char replayText[96];
+	const ReplayMeter& meter = replay.meter();
+	if (replay.done()) {
+		snprintf(replayText, sizeof(replayText), "Replay finished: %llu ops", (unsigned long long)meter.total());
+	} else if (exporting) {
+		// Wall-clock rates would differ from run to run
+		snprintf(replayText, sizeof(replayText), "Replay: %llu ops", (unsigned long long)meter.total());
+	} else {
+		snprintf(replayText, sizeof(replayText), "Replay: %llu ops, %.1f ops/s",
+			(unsigned long long)meter.total(), meter.opsPerSecond());
 	}
+	textFont.draw(replayText, {20.0f, (float)screenHeight - 30.0f}, 16, 1, Color{75, 85, 99, 255});
+}
+
+// Show animation status with modern badge
+if (snap.animating) {
+	std::string animText = "Animating...";
+	Vector2 animTextSize = textFont.measure(animText.c_str(), 16, 1);
+	float animX = 20.0f;
+	float animY = 80.0f;
+	Rectangle animBox = {animX, animY, animTextSize.x + 24, animTextSize.y + 16};
 	
-	// Show animation status with modern badge
-	if (tree.isAnimating()) {
-		std::string animText = "Animating...";
-		Vector2 animTextSize = MeasureTextEx(uiFont, animText.c_str(), 16, 1);
-		float animX = 20.0f;
-		float animY = 80.0f;
-		Rectangle animBox = {animX, animY, animTextSize.x + 24, animTextSize.y + 16};
-		
-		// Pulsing effect
-		float pulse = 0.8f + 0.2f * sin(GetTime() * 4.0f);
-		
-		// Shadow
-		DrawRectangleRounded(Rectangle{animX + 2, animY + 2, animBox.width, animBox.height}, 
-			0.3f, 8, Fade(BLACK, 0.2f));
-		// Background with pulse
-		DrawRectangleRounded(animBox, 0.3f, 8, Fade(Color{255, 160, 50, 255}, pulse));
-		DrawRectangleRoundedLines(animBox, 0.3f, 8, Color{255, 140, 0, 255});
-		
-		// Animated dots
-		int dotCount = ((int)(GetTime() * 3) % 4);
-		std::string dotsText = animText.substr(0, 10);
-		for (int i = 0; i < dotCount; i++) dotsText += ".";
-		
-		DrawTextEx(uiFont, dotsText.c_str(), {animX + 12, animY + 8}, 16, 1, WHITE);
+	// Pulsing effect
+	float pulse = 0.8f + 0.2f * sin(animationClock * 4.0f);
+	
+	// Shadow
+	DrawRectangleRounded(Rectangle{animX + 2, animY + 2, animBox.width, animBox.height}, 
+		0.3f, 8, Fade(BLACK, 0.2f));
+	// Background with pulse
+	DrawRectangleRounded(animBox, 0.3f, 8, Fade(Color{255, 160, 50, 255}, pulse));
+	DrawRectangleRoundedLines(animBox, 0.3f, 8, Color{255, 140, 0, 255});
+	
+	// Animated dots
+	int dotCount = ((int)(animationClock * 3) % 4);
+	std::string dotsText = animText.substr(0, 10);
+	for (int i = 0; i < dotCount; i++) dotsText += ".";
+	
+	textFont.draw(dotsText.c_str(), {animX + 12, animY + 8}, 16, 1, WHITE);
+}
+
+	if (exporting) EndTextureMode();
+	else EndDrawing();
+}
+
+int App::exportFrames(const AppOptions& options) {
+	FrameWriter writer;
+	std::string error;
+	FrameWriter::Format format = options.exportRaw ? FrameWriter::Format::Raw : FrameWriter::Format::Png;
+	if (!writer.open(options.exportDir, format, options.threads, error)) {
+		fprintf(stderr, "export: %s\n", error.c_str());
+		return 1;
 	}
+	// From here the trees are stepped inline, so each frame shows exactly
+	// the work posted before it
+	for (auto& view : views) view->worker.stop();
+	exporting = true;
+	idleWait = false;
+	exportStep = 1.0f / options.exportFps;
+	exportTarget = LoadRenderTexture(screenWidth, screenHeight);
 
-		EndDrawing();
+	auto start = std::chrono::steady_clock::now();
+	// Until the trace is used up and the last animation and camera move
+	// have played out
+	for (;;) {
+		frame();
+		writer.write(LoadImageFromTexture(exportTarget.texture));
+		bool animating = cameraAnimating;
+		for (auto& view : views) animating = animating || view->worker.snapshot().animating;
+		if (!replay.active() && workersIdle() && !animating) break;
 	}
+	UnloadRenderTexture(exportTarget);
+	exporting = false;
+	bool written = writer.finish(error);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (!written) {
+		fprintf(stderr, "export: %s\n", error.c_str());
+		return 1;
+	}
+	double played = (double)writer.frames() * exportStep;
+	printf("[export] %llu frames, %.1f s at %g fps, %dx%d, in %.1f s (%.1fx real time) to %s\n",
+		(unsigned long long)writer.frames(), played, options.exportFps, screenWidth, screenHeight,
+		seconds, seconds > 0.0 ? played / seconds : 0.0, writer.path().c_str());
+	return 0;
+}
 
+#if defined(__EMSCRIPTEN__)
+static void updateDrawFrame(void* app) {
+	static bool firstFrame = true;
+	static_cast<App*>(app)->frame();
+	if (firstFrame) {
+		// Time from navigation start to the first presented frame;
+		// build-web.sh --measure picks this up from the console
+		printf("startup-ms %.1f\n", emscripten_get_now());
+		firstFrame = false;
+	}
+}
+#endif
+
+int main(int argc, char** argv) {
+	AppOptions options;
+	std::string error;
+	if (!parseOptions(argc, argv, options, error)) {
+		if (!error.empty()) fprintf(stderr, "%s\n", error.c_str());
+		printUsage(argv[0]);
+		return error.empty() ? 0 : 1;
+	}
+	// Modes that never open a window
+	if (!options.packInput.empty()) return packTrace(options);
+	if (options.tune) return runTuning(options);
+	if (options.buildBench) return runBuildBench(options);
+	if (options.cacheSim) return runCacheSim(options);
+	if (options.headless) return replayHeadless(options);
+	if (options.selfCheck) return replaySelfCheck();
+
+	// An export only needs the GL context, not a visible window
+	SetConfigFlags(options.exportDir.empty() ? FLAG_WINDOW_RESIZABLE : FLAG_WINDOW_HIDDEN);
+	SetTraceLogLevel(LOG_NONE); // Disable all raylib logs
+	InitWindow(1400, 900, "B-Tree Visualizer");
+
+	// On the web main() returns to the browser while frames keep coming, so
+	// the state must outlive this stack frame
+	App* app = new App(GetScreenWidth(), GetScreenHeight(), options);
+	if (!options.replayPath.empty() && !app->replay.open(options)) {
+		fprintf(stderr, "replay: %s\n", app->replay.error().c_str());
+		delete app;
+		CloseWindow();
+		return 1;
+	}
+	if (!options.exportDir.empty()) {
+		int code = app->exportFrames(options);
+		delete app;
+		CloseWindow();
+		return code;
+	}
+
+#if defined(__EMSCRIPTEN__)
+	// Frames are paced by requestAnimationFrame instead of a blocking loop
+	emscripten_set_main_loop_arg(updateDrawFrame, app, 0, 1);
+#else
+	SetTargetFPS(60);
+	while (!WindowShouldClose()) app->frame();
+	delete app;
 	CloseWindow();
+#endif
 	return 0;
 }
-
@@ -0,0 +1,111 @@
+#include "node_batch.hpp"
+#include <rlgl.h>
+#include <algorithm>
+#include <cmath>
+
+NodeBatch::NodeBatch() {
+    const float halfPi = 1.57079632679f;
+    for (int i = 0; i <= CornerSegments; ++i) {
+        float a = halfPi * (float)i / (float)CornerSegments;
+        quarterArc[i] = {cosf(a), sinf(a)};
+    }
+    for (int i = 0; i <= CircleSegments; ++i) {
+        float a = 4.0f * halfPi * (float)i / (float)CircleSegments;
+        unitCircle[i] = {cosf(a), sinf(a)};
+    }
+    vertices.reserve(1 << 14);
+}
+
+void NodeBatch::triangle(Vector2 a, Vector2 b, Vector2 c, Color color) {
+    // rlgl culls back faces; keep every triangle in raylib's winding so
+    // callers can list corners in whatever order is natural.
+    float cross = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (cross > 0.0f) std::swap(b, c);
+    vertices.push_back({a.x, a.y, color});
+    vertices.push_back({b.x, b.y, color});
+    vertices.push_back({c.x, c.y, color});
+}
+
+void NodeBatch::buildPerimeter(Vector2* out, Rectangle rec, float radius) const {
+    // Corner centres, walked clockwise from the top-left corner
+    float l = rec.x + radius, r = rec.x + rec.width - radius;
+    float t = rec.y + radius, b = rec.y + rec.height - radius;
+    int n = 0;
+    for (int i = 0; i <= CornerSegments; ++i) out[n++] = {l - quarterArc[i].x * radius, t - quarterArc[i].y * radius};
+    for (int i = 0; i <= CornerSegments; ++i) out[n++] = {r + quarterArc[i].y * radius, t - quarterArc[i].x * radius};
+    for (int i = 0; i <= CornerSegments; ++i) out[n++] = {r + quarterArc[i].x * radius, b + quarterArc[i].y * radius};
+    for (int i = 0; i <= CornerSegments; ++i) out[n++] = {l - quarterArc[i].y * radius, b + quarterArc[i].x * radius};
+}
+
+void NodeBatch::roundedRect(Rectangle rec, float roundness, Color color) {
+    if (rec.width <= 0 || rec.height <= 0) return;
+    // Same radius rule as DrawRectangleRounded
+    float radius = std::min(rec.width, rec.height) * roundness / 2.0f;
+    buildPerimeter(perimeter, rec, radius);
+    Vector2 c = {rec.x + rec.width / 2.0f, rec.y + rec.height / 2.0f};
+    for (int i = 0; i < PerimeterPoints; ++i) {
+        triangle(c, perimeter[i], perimeter[(i + 1) % PerimeterPoints], color);
+    }
+}
+
+void NodeBatch::roundedRectLines(Rectangle rec, float roundness, float thick, Color color) {
+    if (rec.width <= 0 || rec.height <= 0) return;
+    float radius = std::min(rec.width, rec.height) * roundness / 2.0f;
+    Rectangle outer = {rec.x - thick, rec.y - thick, rec.width + 2.0f * thick, rec.height + 2.0f * thick};
+    buildPerimeter(perimeter, rec, radius);
+    buildPerimeter(outerPerimeter, outer, radius + thick);
+    for (int i = 0; i < PerimeterPoints; ++i) {
+        int j = (i + 1) % PerimeterPoints;
+        triangle(perimeter[i], outerPerimeter[i], outerPerimeter[j], color);
+        triangle(perimeter[i], outerPerimeter[j], perimeter[j], color);
+    }
+}
+
+void NodeBatch::line(Vector2 a, Vector2 b, float thick, Color color) {
+    float dx = b.x - a.x, dy = b.y - a.y;
+    float len = sqrtf(dx * dx + dy * dy);
+    if (len <= 0.0f) return;
+    float nx = -dy / len * thick / 2.0f, ny = dx / len * thick / 2.0f;
+    Vector2 p0 = {a.x + nx, a.y + ny}, p1 = {a.x - nx, a.y - ny};
+    Vector2 p2 = {b.x - nx, b.y - ny}, p3 = {b.x + nx, b.y + ny};
+    triangle(p0, p1, p2, color);
+    triangle(p0, p2, p3, color);
+}
+
+void NodeBatch::circle(Vector2 center, float radius, Color color) {
+    for (int i = 0; i < CircleSegments; ++i) {
+        Vector2 a = {center.x + unitCircle[i].x * radius, center.y + unitCircle[i].y * radius};
+        Vector2 b = {center.x + unitCircle[i + 1].x * radius, center.y + unitCircle[i + 1].y * radius};
+        triangle(center, a, b, color);
+    }
+}
+
+void NodeBatch::circleLines(Vector2 center, float radius, float thick, Color color) {
+    float r0 = radius - thick / 2.0f, r1 = radius + thick / 2.0f;
+    for (int i = 0; i < CircleSegments; ++i) {
+        Vector2 a0 = {center.x + unitCircle[i].x * r0, center.y + unitCircle[i].y * r0};
+        Vector2 a1 = {center.x + unitCircle[i].x * r1, center.y + unitCircle[i].y * r1};
+        Vector2 b0 = {center.x + unitCircle[i + 1].x * r0, center.y + unitCircle[i + 1].y * r0};
+        Vector2 b1 = {center.x + unitCircle[i + 1].x * r1, center.y + unitCircle[i + 1].y * r1};
+        triangle(a0, a1, b1, color);
+        triangle(a0, b1, b0, color);
+    }
+}
+
+void NodeBatch::draw() const {
+    // Submit in chunks that always fit the active rlgl batch (the web build
+    // uses a much smaller one than desktop), so a flush never splits a
+    // triangle.
+    const size_t chunk = 3 * 512;
+    for (size_t start = 0; start < vertices.size(); start += chunk) {
+        size_t end = std::min(vertices.size(), start + chunk);
+        rlCheckRenderBatchLimit((int)(end - start));
+        rlBegin(RL_TRIANGLES);
+        for (size_t i = start; i < end; ++i) {
+            const Vertex& v = vertices[i];
+            rlColor4ub(v.color.r, v.color.g, v.color.b, v.color.a);
+            rlVertex2f(v.x, v.y);
+        }
+        rlEnd();
+    }
+}
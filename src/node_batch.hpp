@@ -0,0 +1,55 @@
+#ifndef NODE_BATCH_HPP
+#define NODE_BATCH_HPP
+
+#include <cstddef>
+#include <vector>
+#include <raylib.h>
+
+// Collects the flat-coloured geometry of the tree (node bodies, shadows,
+// borders, dividers, child pointers and edges) into one triangle list and
+// submits it to rlgl in a single pass.
+//
+// The raylib shape helpers re-tessellate rounded corners and circles with
+// sinf/cosf on every call and each call opens its own rlBegin/rlEnd block.
+// Here the unit quarter-arc and circle are tessellated once at construction
+// and every shape is just a translated, scaled copy of them. Only plain
+// coloured triangles are emitted (no textures, shaders or instancing), so the
+// batch behaves the same on software GL implementations.
+class NodeBatch {
+public:
+    NodeBatch();
+
+    // Drops the vertices of the previous frame but keeps the capacity
+    void clear() { vertices.clear(); }
+
+    void roundedRect(Rectangle rec, float roundness, Color color);
+    // Outline drawn outside rec, like DrawRectangleRoundedLinesEx
+    void roundedRectLines(Rectangle rec, float roundness, float thick, Color color);
+    void line(Vector2 a, Vector2 b, float thick, Color color);
+    void circle(Vector2 center, float radius, Color color);
+    void circleLines(Vector2 center, float radius, float thick, Color color);
+
+    // Sends everything collected so far to rlgl
+    void draw() const;
+
+    size_t vertexCount() const { return vertices.size(); }
+
+private:
+    struct Vertex { float x, y; Color color; };
+
+    static constexpr int CornerSegments = 8;
+    static constexpr int CircleSegments = 24;
+    static constexpr int PerimeterPoints = 4 * (CornerSegments + 1);
+
+    Vector2 quarterArc[CornerSegments + 1];
+    Vector2 unitCircle[CircleSegments + 1];
+    Vector2 perimeter[PerimeterPoints];     // scratch for the current rect
+    Vector2 outerPerimeter[PerimeterPoints];
+
+    std::vector<Vertex> vertices;
+
+    void triangle(Vector2 a, Vector2 b, Vector2 c, Color color);
+    void buildPerimeter(Vector2* out, Rectangle rec, float radius) const;
+};
+
+#endif
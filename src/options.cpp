@@ -0,0 +1,201 @@
+#include "options.hpp"
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+template <typename T>
+bool parseNumber(const char* text, T& out) {
+    const char* end = text + std::strlen(text);
+    auto res = std::from_chars(text, end, out);
+    return res.ec == std::errc() && res.ptr == end;
+}
+
+// Number with an optional K, M or G suffix
+bool parseSize(const std::string& text, size_t& out) {
+    size_t scale = 1;
+    std::string digits = text;
+    if (!digits.empty()) {
+        char unit = digits.back();
+        if (unit == 'K' || unit == 'k') scale = 1024;
+        else if (unit == 'M' || unit == 'm') scale = 1024 * 1024;
+        else if (unit == 'G' || unit == 'g') scale = 1024 * 1024 * 1024;
+        if (scale != 1) digits.pop_back();
+    }
+    if (!parseNumber(digits.c_str(), out) || out == 0) return false;
+    out *= scale;
+    return true;
+}
+
+// "<first>:<ways>[:<block>]"; first is a byte size for caches and an entry
+// count for TLBs. Block sizes must be powers of two.
+bool parseShape(const char* text, bool firstIsBytes, size_t defaultBlock, CacheShape& shape) {
+    std::string parts[3];
+    int n = 0;
+    for (const char* p = text; *p; ++p) {
+        if (*p == ':') { if (++n > 2) return false; }
+        else parts[n].push_back(*p);
+    }
+    size_t first = 0;
+    if (n < 1 || !parseSize(parts[0], first) || !parseSize(parts[1], shape.ways)) return false;
+    shape.blockBytes = defaultBlock;
+    if (n == 2 && !parseSize(parts[2], shape.blockBytes)) return false;
+    if (shape.blockBytes & (shape.blockBytes - 1)) return false;
+    shape.blocks = firstIsBytes ? first / shape.blockBytes : first;
+    return shape.blocks >= shape.ways && shape.blocks % shape.ways == 0;
+}
+
+// "<t>,<t>,..." with 2 to MaxCompared minimum degrees, each at least 2 and
+// followed by * for B* inserts
+bool parseCompared(const char* text, std::vector<ComparedTree>& out) {
+    constexpr size_t MaxCompared = 8;
+    out.clear();
+    std::string part;
+    for (const char* p = text;; ++p) {
+        if (*p && *p != ',') {
+            part.push_back(*p);
+            continue;
+        }
+        ComparedTree tree;
+        tree.bStar = !part.empty() && part.back() == '*';
+        if (tree.bStar) part.pop_back();
+        if (!parseNumber(part.c_str(), tree.t) || tree.t < 2 || tree.t > 1024) return false;
+        out.push_back(tree);
+        part.clear();
+        if (!*p) break;
+    }
+    return out.size() >= 2 && out.size() <= MaxCompared;
+}
+
+} // namespace
+
+bool parseOptions(int argc, char** argv, AppOptions& options, std::string& error) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&](const char*& out) {
+            if (i + 1 >= argc) { error = arg + " needs a value"; return false; }
+            out = argv[++i];
+            return true;
+        };
+        const char* v = nullptr;
+
+        if (arg == "--replay") {
+            if (!value(v)) return false;
+            options.replayPath = v;
+        } else if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--self-check") {
+            options.selfCheck = true;
+        } else if (arg == "--rate") {
+            if (!value(v)) return false;
+            // from_chars for floats is not available everywhere yet
+            char* end = nullptr;
+            options.replayRate = std::strtof(v, &end);
+            if (end == v || *end != '\0' || !(options.replayRate > 0.0f)) { error = "bad --rate " + std::string(v); return false; }
+        } else if (arg == "--checkpoint") {
+            if (!value(v)) return false;
+            if (!parseNumber(v, options.checkpoint) || options.checkpoint == 0) { error = "bad --checkpoint " + std::string(v); return false; }
+        } else if (arg == "--heat") {
+            if (!value(v)) return false;
+            if (!parseNumber(v, options.heatSample) || options.heatSample == 0) { error = "bad --heat " + std::string(v); return false; }
+        } else if (arg == "--heat-top") {
+            if (!value(v)) return false;
+            if (!parseNumber(v, options.heatTop) || options.heatTop == 0) { error = "bad --heat-top " + std::string(v); return false; }
+        } else if (arg == "--multiset") {
+            options.multiset = true;
+        } else if (arg == "--bstar") {
+            options.bStar = true;
+        } else if (arg == "--compare") {
+            if (!value(v)) return false;
+            if (!parseCompared(v, options.compareTrees)) { error = "bad --compare " + std::string(v); return false; }
+        } else if (arg == "--always-redraw") {
+            options.alwaysRedraw = true;
+        } else if (arg == "--tune") {
+            options.tune = true;
+        } else if (arg == "--tune-keys") {
+            if (!value(v)) return false;
+            if (!parseNumber(v, options.tuneKeys) || options.tuneKeys == 0) { error = "bad --tune-keys " + std::string(v); return false; }
+        } else if (arg == "--build-bench") {
+            options.buildBench = true;
+        } else if (arg == "--threads") {
+            if (!value(v)) return false;
+            if (!parseNumber(v, options.threads) || options.threads == 0) { error = "bad --threads " + std::string(v); return false; }
+        } else if (arg == "--cachesim") {
+            options.cacheSim = true;
+        } else if (arg == "--sim-cache") {
+            if (!value(v)) return false;
+            if (!parseShape(v, true, 64, options.simCache)) { error = "bad --sim-cache " + std::string(v); return false; }
+        } else if (arg == "--sim-tlb") {
+            if (!value(v)) return false;
+            if (!parseShape(v, false, 4096, options.simTlb)) { error = "bad --sim-tlb " + std::string(v); return false; }
+        } else if (arg == "--export") {
+            if (!value(v)) return false;
+            options.exportDir = v;
+        } else if (arg == "--export-fps") {
+            if (!value(v)) return false;
+            char* end = nullptr;
+            options.exportFps = std::strtof(v, &end);
+            if (end == v || *end != '\0' || !(options.exportFps > 0.0f)) { error = "bad --export-fps " + std::string(v); return false; }
+        } else if (arg == "--export-raw") {
+            options.exportRaw = true;
+        } else if (arg == "--pack") {
+            if (i + 2 >= argc) { error = "--pack needs an input and an output"; return false; }
+            options.packInput = argv[++i];
+            options.packOutput = argv[++i];
+        } else if (arg == "--help" || arg == "-h") {
+            error.clear();
+            return false;
+        } else {
+            error = "unknown option " + arg;
+            return false;
+        }
+    }
+    if (options.headless && options.replayPath.empty()) {
+        error = "--headless needs --replay";
+        return false;
+    }
+    if (!options.exportDir.empty() && options.replayPath.empty()) {
+        error = "--export needs --replay";
+        return false;
+    }
+    return true;
+}
+
+void printUsage(const char* program) {
+    std::printf(
+        "Usage: %s [options]\n"
+        "  --replay <trace>     replay an operation trace (text or binary)\n"
+        "  --headless           replay without a window, as fast as possible\n"
+        "  --self-check         replay built-in operations against std::multiset and\n"
+        "                       report any mismatch, without a window\n"
+        "  --rate <ops/s>       animated replay speed limit (default 5)\n"
+        "  --checkpoint <ops>   operations between progress reports\n"
+        "  --multiset           keep duplicate keys as occurrence counts\n"
+        "  --bstar              B* inserts: shift keys into a sibling before splitting,\n"
+        "                       and split two full nodes into three\n"
+        "  --compare <t,t,...>  show 2 to 8 trees with these minimum degrees side by\n"
+        "                       side, all fed the same operations (e.g. 2,3,8,64);\n"
+        "                       t* uses B* inserts (e.g. 3,3*)\n"
+        "  --always-redraw      redraw every frame, even while idle\n"
+        "  --heat <n>           headless: sample every n-th access into node heat\n"
+        "                       and print the hottest nodes at the end\n"
+        "  --heat-top <n>       nodes listed in the heat report (default 20)\n"
+        "  --pack <in> <out>    convert a trace to the packed binary encoding\n"
+        "  --export <dir>       render the animated --replay offline, one fixed step\n"
+        "                       per frame, to dir/frame_000000.png, ...\n"
+        "  --export-fps <n>     frames per second of animation for --export (default 60)\n"
+        "  --export-raw         write dir/frames.rgba (raw RGBA frames) instead of PNGs\n"
+        "  --tune               sweep the minimum degree t on this machine and\n"
+        "                       recommend one (uses --replay as the workload)\n"
+        "  --tune-keys <n>      key count of the synthetic tuning workload\n"
+        "  --build-bench        time the parallel bulk load with 1 to --threads threads\n"
+        "  --threads <n>        most threads for --build-bench, or frame writers for\n"
+        "                       --export (default: all)\n"
+        "  --cachesim           simulate cache and TLB misses per operation for each\n"
+        "                       node layout and t (uses --replay as the workload)\n"
+        "  --sim-cache <s:w:l>  simulated cache size, ways and line (e.g. 1M:16:64);\n"
+        "                       also drives the visualizer's miss highlight (C)\n"
+        "  --sim-tlb <e:w:p>    simulated TLB entries, ways and page (e.g. 64:4:4K)\n",
+        program);
+}
@@ -0,0 +1,82 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Shape of a simulated set-associative cache or TLB: blocks (lines or
+// entries), ways, and block (line or page) size in bytes. Zeros take defaults.
+struct CacheShape {
+    size_t blocks = 0;
+    size_t ways = 0;
+    size_t blockBytes = 0;
+};
+
+// One pane of --compare
+struct ComparedTree {
+    int t = 3;
+    bool bStar = false;             // B* inserts, written "<t>*"
+};
+
+// Command line options. With none given the visualizer starts as usual.
+struct AppOptions {
+    // Trace replay (see trace.hpp)
+    std::string replayPath;
+    bool headless = false;          // replay without a window, as fast as possible
+    float replayRate = 5.0f;        // animated replay, operations per second at most
+    uint64_t checkpoint = 0;        // ops between reports; 0 picks a default per mode
+    bool selfCheck = false;         // run the tree against std::multiset, no window
+
+    // Count duplicate keys instead of ignoring them, in the visualizer and replay
+    bool multiset = false;
+
+    // B* inserts (see BTree::setBStar) in the visualizer, replay and the
+    // cache simulation
+    bool bStar = false;
+
+    // Side-by-side trees with these minimum degrees and insert policies,
+    // all fed the same operations; empty shows the single t = 3 tree
+    std::vector<ComparedTree> compareTrees;
+
+    // Redraw at 60 fps even when nothing changes, instead of sleeping
+    // until input arrives
+    bool alwaysRedraw = false;
+
+    // Headless replay: sample every heatSample-th access into per-node heat
+    // and print a hot-node report at the end; 0 leaves tracking off
+    uint32_t heatSample = 0;
+    size_t heatTop = 20;            // nodes listed in the report
+
+    // Minimum degree sweep (see tuning.hpp); uses the replay trace if given
+    bool tune = false;
+    size_t tuneKeys = 0;            // synthetic workload size; 0 sizes it from the LLC
+
+    // Parallel bulk load scaling benchmark over --tune-keys random keys
+    bool buildBench = false;
+    unsigned threads = 0;           // most threads to try, or frame writers; 0 uses every hardware thread
+
+    // Cache and TLB miss simulation per node layout and t (see cache_sim.hpp);
+    // uses the replay trace if given. The shapes also apply to the
+    // visualizer's miss highlighting.
+    bool cacheSim = false;
+    CacheShape simCache;            // --sim-cache <size>:<ways>[:<line>]
+    CacheShape simTlb;              // --sim-tlb <entries>:<ways>[:<page>]
+
+    // Offline export of the animated replay: frames are stepped by a fixed
+    // 1 / exportFps seconds and written to exportDir instead of shown
+    std::string exportDir;
+    float exportFps = 60.0f;
+    bool exportRaw = false;         // one raw RGBA file instead of PNGs
+
+    // Trace conversion to the packed binary encoding
+    std::string packInput;
+    std::string packOutput;
+};
+
+// Returns false with a message in error on bad usage
+bool parseOptions(int argc, char** argv, AppOptions& options, std::string& error);
+void printUsage(const char* program);
+
+#endif
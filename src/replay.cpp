@@ -0,0 +1,718 @@
+#include "replay.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <string>
+
+namespace {
+
+constexpr size_t ReadBatch = 4096;
+constexpr int ReplayDegree = 3;   // same minimum degree as the visualizer
+
+const char* OpNames[3] = {"insert", "erase", "lookup"};
+
+} // namespace
+
+TreeStats computeTreeStats(const BTree& tree) {
+    const BTree::Stats& s = tree.getStats();
+    TreeStats stats;
+    stats.keys = s.keys;
+    stats.occurrences = s.occurrences;
+    stats.nodes = s.nodes;
+    stats.height = s.height();
+    stats.fill = tree.fillFactor();
+    return stats;
+}
+
+TreeStats computeTreeStats(const RenderSnapshot& snap, int t) {
+    TreeStats stats;
+    if (snap.empty) return stats;
+    stats.nodes = snap.nodes.size();
+    stats.keys = snap.values.size();
+    for (uint32_t count : snap.counts) stats.occurrences += count;
+    for (const auto& nb : snap.nodes) stats.height = std::max(stats.height, nb.depth + 1);
+    stats.fill = (double)stats.keys / ((double)stats.nodes * (2 * t - 1));
+    return stats;
+}
+
+ReplayMeter::ReplayMeter(uint64_t _interval)
+    : start(Clock::now()), last(start), interval(_interval), nextReport(_interval) {}
+
+void ReplayMeter::count(const TraceOp& op) {
+    ++ops;
+    ++byType[op.type];
+}
+
+double ReplayMeter::opsPerSecond() const {
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    return elapsed > 0.0 ? (double)ops / elapsed : 0.0;
+}
+
+void ReplayMeter::report(const TreeStats& stats, bool final) {
+    Clock::time_point now = Clock::now();
+    double elapsed = std::chrono::duration<double>(now - start).count();
+    double window = std::chrono::duration<double>(now - last).count();
+    double rate = elapsed > 0.0 ? (double)ops / elapsed : 0.0;
+    double recent = window > 0.0 ? (double)(ops - lastOps) / window : 0.0;
+
+    std::printf("[replay]%s %llu ops in %.3f s, %.0f ops/s (last %.0f ops/s) | "
+                "%s %llu, %s %llu, %s %llu | keys %zu",
+                final ? " done:" : "", (unsigned long long)ops, elapsed, rate, recent,
+                OpNames[0], (unsigned long long)byType[0], OpNames[1], (unsigned long long)byType[1],
+                OpNames[2], (unsigned long long)byType[2], stats.keys);
+    if (stats.occurrences != stats.keys) std::printf(" (%zu with duplicates)", stats.occurrences);
+    std::printf(", nodes %zu, height %d, fill %.2f\n", stats.nodes, stats.height, stats.fill);
+    std::fflush(stdout);
+
+    last = now;
+    lastOps = ops;
+    while (nextReport <= ops) nextReport += interval;
+}
+
+int replayHeadless(const AppOptions& options) {
+    TraceReader reader;
+    if (!reader.open(options.replayPath)) {
+        std::fprintf(stderr, "replay: %s\n", reader.error().c_str());
+        return 1;
+    }
+
+    BTree tree(ReplayDegree, options.multiset);
+    tree.setBStar(options.bStar);
+    if (options.heatSample) tree.setHeatTracking(true, options.heatSample);
+    ReplayMeter meter(options.checkpoint ? options.checkpoint : 1000000);
+    std::vector<TraceOp> batch;
+    batch.reserve(ReadBatch);
+    size_t lookupHits = 0;
+    std::vector<int> lookupKeys;
+    std::vector<bool> found;
+
+    while (reader.read(batch, ReadBatch) > 0) {
+        for (size_t i = 0; i < batch.size();) {
+            const TraceOp& op = batch[i];
+            if (op.type == TraceOp::Lookup) {
+                // Runs of lookups go through the interleaved batch search
+                size_t end = i;
+                lookupKeys.clear();
+                while (end < batch.size() && batch[end].type == TraceOp::Lookup) lookupKeys.push_back(batch[end++].key);
+                tree.containsBatch(lookupKeys.data(), lookupKeys.size(), found);
+                for (bool hit : found) lookupHits += hit ? 1 : 0;
+                for (; i < end; ++i) meter.count(batch[i]);
+                if (meter.due()) meter.report(computeTreeStats(tree));
+                continue;
+            }
+            if (op.type == TraceOp::Insert) tree.insert(op.key);
+            else tree.erase(op.key);
+            meter.count(op);
+            if (meter.due()) meter.report(computeTreeStats(tree));
+            ++i;
+        }
+        batch.clear();
+    }
+    if (reader.failed()) {
+        std::fprintf(stderr, "replay: %s\n", reader.error().c_str());
+        return 1;
+    }
+    meter.report(computeTreeStats(tree), true);
+    std::printf("[replay] lookup hits %zu\n", lookupHits);
+    if (options.heatSample) printHeatReport(tree, options.heatTop);
+    return 0;
+}
+
+void printHeatReport(const BTree& tree, size_t top) {
+    const BTree::Node* root = tree.getRoot();
+    if (!root || tree.heatSamples() == 0) {
+        std::printf("[heat] no samples\n");
+        return;
+    }
+    // Every sampled path starts at the root, so its heat is the total the
+    // other shares are taken of
+    double total = std::max<uint32_t>(1, tree.heatOf(root));
+    std::vector<BTree::HotNode> hot = tree.hotNodes(top);
+    std::printf("[heat] %llu sampled accesses; hottest %zu nodes:\n",
+                (unsigned long long)tree.heatSamples(), hot.size());
+    std::printf("[heat] %4s %5s %8s %23s %10s %7s\n", "rank", "depth", "position", "keys", "heat", "share");
+    for (size_t i = 0; i < hot.size(); ++i) {
+        const BTree::HotNode& h = hot[i];
+        std::printf("[heat] %4zu %5d %8zu %11d..%-11d %10u %6.1f%%\n", i + 1, h.depth, h.position,
+                    h.node->keyAt(0), h.node->keyAt(h.node->keyCount() - 1), h.heat, 100.0 * h.heat / total);
+    }
+
+    std::printf("[heat] hottest path:");
+    for (const BTree::Node* node = root; node;) {
+        std::printf(" %s[%d..%d] %.0f%%", node == root ? "" : "-> ", node->keyAt(0), node->keyAt(node->keyCount() - 1),
+                    100.0 * tree.heatOf(node) / total);
+        const BTree::Node* next = nullptr;
+        for (const BTree::Node* child : node->children) {
+            if (!next || tree.heatOf(child) > tree.heatOf(next)) next = child;
+        }
+        node = next;
+    }
+    std::printf("\n");
+
+    // Inner nodes always outrank their leaves, so clustering is judged on the
+    // hottest leaves alone: hot leaves next to each other mean hot keys are
+    // clustered in key order
+    int leafDepth = tree.getStats().height() - 1;
+    std::vector<size_t> leaves;
+    for (const auto& h : tree.hotNodes(SIZE_MAX)) {
+        if (h.depth == leafDepth && leaves.size() < top) leaves.push_back(h.position);
+    }
+    std::sort(leaves.begin(), leaves.end());
+    size_t clusters = 0;
+    for (size_t i = 0; i < leaves.size(); ++i) if (i == 0 || leaves[i] != leaves[i - 1] + 1) ++clusters;
+    std::printf("[heat] hottest %zu leaves of %zu lie in %zu runs of adjacent leaves\n",
+                leaves.size(), tree.getStats().leaves, clusters);
+}
+
+namespace {
+
+// What a tree should hold, with occurrences
+using KeyBag = std::multiset<int>;
+
+void bagInsert(KeyBag& bag, int key, bool multiset) {
+    if (multiset || !bag.count(key)) bag.insert(key);
+}
+
+void bagErase(KeyBag& bag, int key) {
+    auto it = bag.find(key);
+    if (it != bag.end()) bag.erase(it);
+}
+
+// Every occurrence in key order; packed leaves are read in place
+void collectKeys(const BTree::Node* node, std::vector<int>& out) {
+    size_t n = node->keyCount();
+    for (size_t i = 0; i <= n; ++i) {
+        if (!node->leaf) collectKeys(node->children[i], out);
+        if (i < n) out.insert(out.end(), node->countAt(i), node->keyAt(i));
+    }
+}
+
+// Node sizes, key order between the parent's separators, one leaf depth,
+// and with aggregates on each node's agg. Adds the node to seen, the stats
+// recounted from scratch, and sets level to its height above the leaves.
+// Returns false with the first problem in why.
+bool checkShape(const BTree::Node* node, int t, bool aggregates, bool isRoot, int64_t lo, int64_t hi, int depth,
+                int& leafDepth, int& level, BTree::Stats& seen, std::string& why) {
+    size_t n = node->keyCount();
+    if (n == 0 || n > size_t(2 * t - 1) || (!isRoot && n < size_t(t - 1))) {
+        why = "node with " + std::to_string(n) + " keys";
+        return false;
+    }
+    BTree::Aggregate agg;
+    for (size_t i = 0; i < n; ++i) {
+        int64_t key = node->keyAt(i);
+        if (key <= lo || key >= hi || (i > 0 && key <= node->keyAt(i - 1))) {
+            why = "key " + std::to_string(key) + " out of order";
+            return false;
+        }
+        agg.add(node->keyAt(i), node->countAt(i));
+        seen.occurrences += node->countAt(i);
+    }
+    seen.keys += n;
+    seen.nodes += 1;
+    seen.nodeBytes += node->memoryBytes();
+
+    level = 0;
+    if (node->leaf) {
+        if (leafDepth < 0) leafDepth = depth;
+        if (depth != leafDepth) {
+            why = "leaves at depths " + std::to_string(leafDepth) + " and " + std::to_string(depth);
+            return false;
+        }
+        seen.leaves += 1;
+    } else {
+        if (node->children.size() != n + 1) {
+            why = "node with " + std::to_string(n) + " keys and " + std::to_string(node->children.size()) +
+                  " children";
+            return false;
+        }
+        for (size_t i = 0; i <= n; ++i) {
+            const BTree::Node* child = node->children[i];
+            if (!checkShape(child, t, aggregates, false, i > 0 ? node->keyAt(i - 1) : lo,
+                            i < n ? node->keyAt(i) : hi, depth + 1, leafDepth, level, seen, why)) return false;
+            agg += child->agg;
+        }
+        ++level;
+    }
+    if (seen.levelNodes.size() <= size_t(level)) seen.levelNodes.resize(level + 1, 0);
+    seen.levelNodes[level] += 1;
+
+    // Children were checked first, so their agg can be summed as is
+    if (aggregates && (!node->augmented || agg.count != node->agg.count || agg.sum != node->agg.sum ||
+                       agg.min != node->agg.min || agg.max != node->agg.max)) {
+        why = "aggregate of the node from key " + std::to_string(node->keyAt(0)) + " is off";
+        return false;
+    }
+    return true;
+}
+
+// The tree holds exactly bag, is a valid B-tree, and every incrementally
+// kept statistic matches a recount
+bool matches(const BTree& tree, const KeyBag& bag, std::string& why) {
+    std::vector<int> keys;
+    BTree::Stats seen;
+    if (const BTree::Node* root = tree.getRoot()) {
+        int leafDepth = -1, level = 0;
+        if (!checkShape(root, tree.getDegree(), tree.hasAggregates(), true, INT64_MIN, INT64_MAX, 0, leafDepth,
+                        level, seen, why)) return false;
+        collectKeys(root, keys);
+    }
+    if (!std::equal(keys.begin(), keys.end(), bag.begin(), bag.end())) {
+        auto diff = std::mismatch(keys.begin(), keys.end(), bag.begin(), bag.end());
+        why = "holds " + std::to_string(keys.size()) + " keys, expected " + std::to_string(bag.size());
+        if (diff.first != keys.end()) why += "; first difference at key " + std::to_string(*diff.first);
+        else if (diff.second != bag.end()) why += "; missing key " + std::to_string(*diff.second);
+        return false;
+    }
+    const BTree::Stats& stats = tree.getStats();
+    auto stat = [&](const char* name, size_t kept, size_t counted) {
+        if (kept == counted) return true;
+        why = std::string("stats keep ") + std::to_string(kept) + " " + name + ", the tree has " +
+              std::to_string(counted);
+        return false;
+    };
+    if (!stat("keys", stats.keys, seen.keys) || !stat("occurrences", stats.occurrences, seen.occurrences) ||
+        !stat("nodes", stats.nodes, seen.nodes) || !stat("leaves", stats.leaves, seen.leaves) ||
+        !stat("node bytes", stats.nodeBytes, seen.nodeBytes)) return false;
+    if (stats.levelNodes != seen.levelNodes) {
+        why = "stats keep different node counts per level (" + std::to_string(stats.height()) +
+              " levels) than the tree (" + std::to_string(seen.height()) + " levels)";
+        return false;
+    }
+    return true;
+}
+
+// Plays the queued animations to the end, as the visualizer would over
+// several frames. False if they never finish.
+bool settle(BTree& tree) {
+    for (int frame = 0; frame < 10000 && tree.isAnimating(); ++frame) tree.updateAnimation(0.25f);
+    return !tree.isAnimating();
+}
+
+// The visualizer's path: every insert and erase is queued as an animation
+// and only takes effect when it plays out. Key 0 is erased on purpose; the
+// deferred erase once took it for "no key" and left it in the tree.
+bool checkAnimatedReplay(std::string& why) {
+    std::vector<TraceOp> ops;
+    for (int i = 0; i < 30; ++i) ops.push_back({TraceOp::Insert, i * 7 % 30 - 5});
+    for (int key : {0, 0, 13, 0, -5, 0}) {
+        ops.push_back({TraceOp::Erase, key});
+        ops.push_back({TraceOp::Lookup, key});
+        ops.push_back({TraceOp::Insert, 0});
+    }
+    std::mt19937 rng(33);
+    for (int i = 0; i < 1500; ++i) ops.push_back({TraceOp::Type(rng() % 3), int(rng() % 61) - 20});
+
+    for (bool multiset : {false, true}) {
+        BTree animated(ReplayDegree, multiset), plain(ReplayDegree, multiset);
+        KeyBag bag;
+        for (const TraceOp& op : ops) {
+            if (op.type == TraceOp::Insert) {
+                animated.insertAnimated(op.key);
+                plain.insert(op.key);
+                bagInsert(bag, op.key, multiset);
+            } else if (op.type == TraceOp::Erase) {
+                animated.eraseAnimated(op.key);
+                plain.erase(op.key);
+                bagErase(bag, op.key);
+            }
+            if (!settle(animated)) {
+                why = "animation never finished";
+                return false;
+            }
+            if (op.type == TraceOp::Lookup && animated.count(op.key) != bag.count(op.key)) {
+                why = "lookup of " + std::to_string(op.key) + " counts " + std::to_string(animated.count(op.key)) +
+                      ", expected " + std::to_string(bag.count(op.key));
+                return false;
+            }
+        }
+        if (!matches(plain, bag, why)) {
+            why = "plain: " + why;
+            return false;
+        }
+        if (!matches(animated, bag, why)) {
+            why = "animated: " + why;
+            return false;
+        }
+    }
+    return true;
+}
+
+// eraseRange from both ends, at keys present and absent, empty and
+// inverted ranges, the whole tree, and eraseBatch over neighbouring keys
+bool checkEraseRange(std::string& why) {
+    std::mt19937 rng(41);
+    for (int t : {2, 3, 5}) {
+        for (bool multiset : {false, true}) {
+            BTree tree(t, multiset);
+            // Aggregates on at odd t, so their upkeep is checked too
+            tree.setAggregates(t % 2 == 1);
+            KeyBag bag;
+            auto refill = [&] {
+                for (int i = 0; i < 600; ++i) {
+                    int key = int(rng() % 400) * 2;   // even keys, so odd ones are never present
+                    tree.insert(key);
+                    bagInsert(bag, key, multiset);
+                }
+            };
+            auto eraseRange = [&](int lo, int hi) {
+                size_t expected = 0;
+                for (auto it = bag.lower_bound(lo); it != bag.end() && *it <= hi; it = bag.upper_bound(*it)) ++expected;
+                if (lo <= hi) bag.erase(bag.lower_bound(lo), bag.upper_bound(hi));
+                size_t removed = tree.eraseRange(lo, hi);
+                if (removed != expected) {
+                    why = "removed " + std::to_string(removed) + ", expected " + std::to_string(expected);
+                } else if (matches(tree, bag, why)) {
+                    return true;
+                }
+                why = "t=" + std::to_string(t) + " [" + std::to_string(lo) + ", " + std::to_string(hi) + "]: " + why;
+                return false;
+            };
+
+            refill();
+            int lo = *bag.begin(), hi = *bag.rbegin();
+            const int bounds[][2] = {{lo, lo}, {hi, hi}, {INT_MIN, lo + 1}, {hi - 1, INT_MAX}, {401, 401},
+                                     {300, 200}, {lo + 10, lo + 10}, {99, 301}, {100, 300}, {-50, -1}, {800, 900}};
+            for (const auto& range : bounds) {
+                if (!eraseRange(range[0], range[1])) return false;
+            }
+            if (!eraseRange(INT_MIN, INT_MAX)) return false;
+            if (tree.getRoot()) {
+                why = "tree not empty after erasing everything";
+                return false;
+            }
+            for (int round = 0; round < 40; ++round) {
+                refill();
+                int a = int(rng() % 820) - 10, b = int(rng() % 820) - 10;
+                if (!eraseRange(std::min(a, b), std::max(a, b))) return false;
+            }
+
+            // Batches of keys that are neighbours in the tree go as ranges
+            std::vector<int> batch;
+            for (int key = 200; key < 260; key += 2) batch.push_back(key);
+            for (int i = 0; i < 30; ++i) batch.push_back(int(rng() % 820));
+            std::vector<int> distinct(batch.begin(), batch.end());
+            std::sort(distinct.begin(), distinct.end());
+            distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+            size_t expected = 0;
+            for (int key : distinct) {
+                expected += bag.count(key) ? 1 : 0;
+                bag.erase(key);
+            }
+            size_t removed = tree.eraseBatch(batch);
+            if (removed != expected) {
+                why = "eraseBatch removed " + std::to_string(removed) + ", expected " + std::to_string(expected);
+                return false;
+            }
+            if (!matches(tree, bag, why)) {
+                why = "eraseBatch: " + why;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// split at keys present and absent, below and above every key, then join
+// the halves back, with either side or both empty
+bool checkSplitJoin(std::string& why) {
+    std::mt19937 rng(42);
+    for (int t : {2, 3, 6}) {
+        for (bool multiset : {false, true}) {
+            auto fail = [&](const std::string& what, int pivot) {
+                why = "t=" + std::to_string(t) + " pivot " + std::to_string(pivot) + ", " + what + ": " + why;
+                return false;
+            };
+            BTree tree(t, multiset), right(t, multiset);
+            tree.setAggregates(t % 2 == 1);
+            KeyBag bag;
+            for (int i = 0; i < 500; ++i) {
+                int key = int(rng() % 300) * 2;
+                tree.insert(key);
+                bagInsert(bag, key, multiset);
+            }
+            std::vector<int> pivots = {*bag.begin(), *bag.rbegin(), *bag.begin() - 1, *bag.rbegin() + 1,
+                                       INT_MIN, INT_MAX, 301, 300};
+            for (int i = 0; i < 30; ++i) pivots.push_back(int(rng() % 620) - 10);
+            for (int pivot : pivots) {
+                tree.split(pivot, right);
+                KeyBag low(bag.begin(), bag.lower_bound(pivot)), high(bag.lower_bound(pivot), bag.end());
+                if (!matches(tree, low, why)) return fail("left half", pivot);
+                if (!matches(right, high, why)) return fail("right half", pivot);
+                // A failed join must change nothing
+                if (!high.empty() && !low.empty() && right.join(tree)) {
+                    why = "joined overlapping trees";
+                    return fail("join", pivot);
+                }
+                if (!tree.join(right)) {
+                    why = "join refused";
+                    return fail("join", pivot);
+                }
+                if (!matches(tree, bag, why)) return fail("joined", pivot);
+                if (!matches(right, KeyBag(), why)) return fail("joined right", pivot);
+            }
+
+            // Both sides empty, and an empty tree taking a full one
+            BTree empty(t, multiset);
+            why = "join refused";
+            if (!empty.join(right) || !matches(empty, KeyBag(), why)) return fail("empty join", 0);
+            why = "join refused";
+            if (!empty.join(tree) || !matches(empty, bag, why) || !matches(tree, KeyBag(), why)) {
+                return fail("join into empty", 0);
+            }
+        }
+    }
+    return true;
+}
+
+// Every key's value is a function of the key, so values can be checked
+// without a second reference; a third of them are 0 so some leaves drop
+// their value array when packed
+BTree::Value valueOf(int key) {
+    return key % 3 == 0 ? 0 : BTree::Value(key) * 3;
+}
+
+bool valuesMatch(const BTree& tree, const KeyBag& bag, std::string& why) {
+    for (auto it = bag.begin(); it != bag.end(); it = bag.upper_bound(*it)) {
+        const BTree::Value* value = tree.find(*it);
+        if (!value || *value != valueOf(*it)) {
+            why = "wrong value for key " + std::to_string(*it);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Packed leaves: pack, read in place, change keys while packed, pack
+// again and unpack, with keys far apart so offsets need every width
+bool checkPackedLeaves(std::string& why) {
+    std::mt19937 rng(46);
+    for (int t : {2, 4, 16}) {
+        for (bool multiset : {false, true}) {
+            auto fail = [&](const char* what) {
+                why = "t=" + std::to_string(t) + ", " + what + ": " + why;
+                return false;
+            };
+            BTree tree(t, multiset);
+            KeyBag bag;
+            auto randomKey = [&] {
+                // Mostly a dense range, sometimes anywhere in int
+                return rng() % 4 ? int(rng() % 2000) - 1000 : int(rng());
+            };
+            for (int i = 0; i < 3000; ++i) {
+                int key = randomKey();
+                tree.insert(key, valueOf(key));
+                bagInsert(bag, key, multiset);
+            }
+
+            tree.setLeafCompression(true);
+            if (tree.packedLeafCount() != tree.getStats().leaves) {
+                why = std::to_string(tree.packedLeafCount()) + " of " + std::to_string(tree.getStats().leaves) +
+                      " leaves packed";
+                return fail("pack");
+            }
+            if (!matches(tree, bag, why)) return fail("packed");
+            for (int i = 0; i < 3000; ++i) {
+                int key = randomKey();
+                if (rng() % 3) {
+                    tree.insert(key, valueOf(key));
+                    bagInsert(bag, key, multiset);
+                } else {
+                    tree.erase(key);
+                    bagErase(bag, key);
+                }
+                if (tree.count(key) != bag.count(key)) {
+                    why = "count of " + std::to_string(key);
+                    return fail("packed change");
+                }
+            }
+            if (!matches(tree, bag, why)) return fail("changed while packed");
+            // find unpacks its leaf until the next change
+            if (!valuesMatch(tree, bag, why)) return fail("packed values");
+            tree.compressLeaves();
+            if (!matches(tree, bag, why)) return fail("packed again");
+
+            tree.setLeafCompression(false);
+            if (tree.packedLeafCount() != 0) {
+                why = std::to_string(tree.packedLeafCount()) + " leaves still packed";
+                return fail("unpack");
+            }
+            if (!matches(tree, bag, why)) return fail("unpacked");
+            if (!valuesMatch(tree, bag, why)) return fail("unpacked values");
+        }
+    }
+    return true;
+}
+
+// B* inserts: ascending and descending runs push keys into one sibling
+// after another, random ones split full pairs into three; erases and
+// animated inserts are mixed in. Random inserts must also leave the tree
+// fuller than plain splits do, or the policy is not taking effect.
+bool checkBStar(std::string& why) {
+    std::mt19937 rng(50);
+    for (int t : {2, 3, 8}) {
+        for (bool multiset : {false, true}) {
+            auto fail = [&](const char* what) {
+                why = "t=" + std::to_string(t) + ", " + what + ": " + why;
+                return false;
+            };
+            BTree tree(t, multiset), plain(t, multiset);
+            tree.setBStar(true);
+            tree.setAggregates(t % 2 == 1);
+            KeyBag bag;
+            auto insert = [&](int key) {
+                tree.insert(key);
+                plain.insert(key);
+                bagInsert(bag, key, multiset);
+            };
+            for (int key = 0; key < 400; ++key) insert(key);
+            if (!matches(tree, bag, why)) return fail("ascending");
+            for (int key = -1; key > -400; --key) insert(key);
+            if (!matches(tree, bag, why)) return fail("descending");
+            for (int i = 0; i < 4000; ++i) insert(int(rng() % 20000));
+            if (!matches(tree, bag, why)) return fail("random");
+            if (tree.fillFactor() <= plain.fillFactor()) {
+                why = "fill " + std::to_string(tree.fillFactor()) + ", plain " + std::to_string(plain.fillFactor());
+                return fail("fill");
+            }
+            for (int i = 0; i < 6000; ++i) {
+                int key = int(rng() % 2000);
+                if (rng() % 2) {
+                    insert(key);
+                } else {
+                    tree.erase(key);
+                    bagErase(bag, key);
+                }
+            }
+            if (!matches(tree, bag, why)) return fail("inserts and erases");
+            for (int i = 0; i < 200; ++i) {
+                int key = int(rng() % 3000);
+                tree.insertAnimated(key);
+                bagInsert(bag, key, multiset);
+                if (!settle(tree)) {
+                    why = "animation never finished";
+                    return fail("animated");
+                }
+            }
+            if (!matches(tree, bag, why)) return fail("animated");
+        }
+    }
+    return true;
+}
+
+struct SelfCheck {
+    const char* name;
+    bool (*run)(std::string& why);
+};
+
+const SelfCheck SelfChecks[] = {
+    {"animated replay", checkAnimatedReplay},
+    {"range erase", checkEraseRange},
+    {"split and join", checkSplitJoin},
+    {"packed leaves", checkPackedLeaves},
+    {"B* inserts", checkBStar},
+};
+
+} // namespace
+
+int replaySelfCheck() {
+    int failed = 0;
+    for (const SelfCheck& check : SelfChecks) {
+        std::string why;
+        if (check.run(why)) {
+            std::printf("[check] %-24s ok\n", check.name);
+        } else {
+            std::printf("[check] %-24s FAILED: %s\n", check.name, why.c_str());
+            ++failed;
+        }
+    }
+    std::printf("[check] %d of %zu failed\n", failed, sizeof(SelfChecks) / sizeof(SelfChecks[0]));
+    return failed ? 1 : 0;
+}
+
+int packTrace(const AppOptions& options) {
+    TraceReader reader;
+    if (!reader.open(options.packInput)) {
+        std::fprintf(stderr, "pack: %s\n", reader.error().c_str());
+        return 1;
+    }
+    TraceWriter writer;
+    if (!writer.open(options.packOutput)) {
+        std::fprintf(stderr, "pack: cannot write %s\n", options.packOutput.c_str());
+        return 1;
+    }
+    std::vector<TraceOp> batch;
+    uint64_t count = 0;
+    while (reader.read(batch, ReadBatch) > 0) {
+        for (const TraceOp& op : batch) writer.write(op);
+        count += batch.size();
+        batch.clear();
+    }
+    if (reader.failed()) {
+        std::fprintf(stderr, "pack: %s\n", reader.error().c_str());
+        return 1;
+    }
+    if (!writer.close()) {
+        std::fprintf(stderr, "pack: failed writing %s\n", options.packOutput.c_str());
+        return 1;
+    }
+    std::printf("pack: %llu ops written to %s\n", (unsigned long long)count, options.packOutput.c_str());
+    return 0;
+}
+
+bool ReplayFeed::open(const AppOptions& options) {
+    if (!reader.open(options.replayPath)) return false;
+    rate = options.replayRate;
+    stats = ReplayMeter(options.checkpoint ? options.checkpoint : 100);
+    return true;
+}
+
+bool ReplayFeed::nextOp(TraceOp& op) {
+    if (next == pending.size()) {
+        pending.clear();
+        next = 0;
+        if (reader.read(pending, ReadBatch) == 0) return false;
+    }
+    op = pending[next++];
+    return true;
+}
+
+void ReplayFeed::feed(float deltaTime, bool treeIdle, const std::vector<TreeWorker*>& workers, const RenderSnapshot& snap) {
+    if (finished || !treeIdle) return;
+    auto post = [&](const TreeWorker::Command& cmd) {
+        for (TreeWorker* worker : workers) worker->post(cmd);
+    };
+
+    // The budget only builds up while idle, so slow animations throttle the
+    // replay instead of queueing a burst behind them
+    budget = std::min(budget + deltaTime * rate, std::max(1.0f, rate));
+    while (budget >= 1.0f) {
+        TraceOp op;
+        if (!nextOp(op)) {
+            finished = true;
+            if (reader.failed()) std::fprintf(stderr, "replay: %s\n", reader.error().c_str());
+            stats.report(computeTreeStats(snap, snap.degree), true);
+            return;
+        }
+        budget -= 1.0f;
+        stats.count(op);
+        if (stats.due()) stats.report(computeTreeStats(snap, snap.degree));
+
+        // Lookups only feed the heat overlay and go straight through;
+        // mutations wait for their animation
+        if (op.type == TraceOp::Lookup) {
+            post({TreeWorker::Command::Lookup, op.key});
+            continue;
+        }
+        if (op.type == TraceOp::Insert) {
+            post({TreeWorker::Command::InsertKey, op.key});
+            return;
+        }
+        if (op.type == TraceOp::Erase) {
+            post({TreeWorker::Command::EraseKey, op.key});
+            return;
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "btree.hpp"
+#include "options.hpp"
+#include "trace.hpp"
+#include "tree_worker.hpp"
+
+struct TreeStats {
+    size_t keys = 0;
+    size_t occurrences = 0;   // keys counted with multiplicity (multisets)
+    size_t nodes = 0;
+    int height = 0;
+    double fill = 0.0;   // keys / (nodes * max keys per node)
+};
+
+// From the tree's incrementally kept statistics, so free to call
+TreeStats computeTreeStats(const BTree& tree);
+// Same numbers from a render snapshot, for a tree of minimum degree t
+TreeStats computeTreeStats(const RenderSnapshot& snap, int t);
+
+// Counts replayed operations and prints throughput and tree statistics
+// every `interval` operations.
+class ReplayMeter {
+public:
+    explicit ReplayMeter(uint64_t interval);
+
+    void count(const TraceOp& op);
+    bool due() const { return ops >= nextReport; }
+    void report(const TreeStats& stats, bool final = false);
+
+    uint64_t total() const { return ops; }
+    double opsPerSecond() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point start, last;
+    uint64_t interval;
+    uint64_t nextReport;
+    uint64_t ops = 0, lastOps = 0;
+    uint64_t byType[3] = {0, 0, 0};
+};
+
+// Ranked hot-node report: the hottest nodes with their key ranges and share
+// of recent accesses, the hottest root-to-leaf path, and how many clusters
+// of adjacent leaves the hot leaves form
+void printHeatReport(const BTree& tree, size_t top);
+
+// Replays options.replayPath straight against a BTree with no window.
+// Returns the process exit code.
+int replayHeadless(const AppOptions& options);
+
+// Runs the tree against std::multiset over built-in operation lists, with
+// no window, and prints a line per case. Returns the process exit code.
+int replaySelfCheck();
+
+// Converts options.packInput to a binary trace at options.packOutput
+int packTrace(const AppOptions& options);
+
+// Feeds a trace into the visualizer through the worker, so every insert and
+// erase plays its animation. Operations are released at most `rate` per
+// second and only while the tree is idle, one mutation at a time.
+class ReplayFeed {
+public:
+    bool open(const AppOptions& options);
+    bool active() const { return reader.fileSize() > 0 && !finished; }
+    bool done() const { return finished; }
+    const std::string& error() const { return reader.error(); }
+    const ReplayMeter& meter() const { return stats; }
+
+    // Call once per frame; treeIdle is whether the last posted op is done
+    // everywhere. Each operation goes to every worker; snap is the one
+    // progress reports describe.
+    void feed(float deltaTime, bool treeIdle, const std::vector<TreeWorker*>& workers, const RenderSnapshot& snap);
+
+private:
+    TraceReader reader;
+    ReplayMeter stats{100};
+    std::vector<TraceOp> pending;
+    size_t next = 0;
+    float rate = 5.0f;
+    float budget = 0.0f;
+    bool finished = false;
+
+    bool nextOp(TraceOp& op);
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef SDF_ATLAS_FORMAT_HPP
+#define SDF_ATLAS_FORMAT_HPP
+
+#include <cstdint>
+
+// Layout of the glyph atlas blob written by tools/font_atlas.cpp at build
+// time and read by SdfFont at startup. The blob is a header, glyphCount glyph
+// records, then width * height bytes of distance values (0.5 on the outline).
+// Both sides are little-endian, so it is read and written as is.
+namespace sdf_atlas {
+
+constexpr uint32_t Magic = 0x31464453; // "SDF1"
+
+struct Header {
+    uint32_t magic;
+    int32_t baseSize;       // pixel height the glyphs were rendered at
+    int32_t glyphCount;
+    int32_t glyphPadding;   // empty border kept around every glyph in the atlas
+    int32_t width;
+    int32_t height;
+};
+
+struct Glyph {
+    int32_t codepoint;
+    int32_t offsetX;
+    int32_t offsetY;
+    int32_t advanceX;
+    float x, y, width, height; // atlas rectangle, excluding glyphPadding
+};
+
+} // namespace sdf_atlas
+
+#endif
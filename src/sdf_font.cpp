@@ -0,0 +1,107 @@
+#include "sdf_font.hpp"
+#include <cstring>
+#include "sdf_atlas_format.hpp"
+
+namespace {
+
+// The distance lives in alpha (0.5 on the outline). Its screen-space
+// derivative is how much distance one pixel covers, which sets the width of
+// the antialiased edge at any scale.
+#if defined(__EMSCRIPTEN__)
+const char* SdfFragmentShader = R"(#version 100
+#extension GL_OES_standard_derivatives : enable
+precision mediump float;
+varying vec2 fragTexCoord;
+varying vec4 fragColor;
+uniform sampler2D texture0;
+uniform vec4 colDiffuse;
+void main() {
+    float dist = texture2D(texture0, fragTexCoord).a - 0.5;
+    float edge = max(length(vec2(dFdx(dist), dFdy(dist))), 0.0001);
+    float alpha = smoothstep(-edge, edge, dist);
+    vec4 color = fragColor * colDiffuse;
+    gl_FragColor = vec4(color.rgb, color.a * alpha);
+}
+)";
+#else
+const char* SdfFragmentShader = R"(#version 330
+in vec2 fragTexCoord;
+in vec4 fragColor;
+uniform sampler2D texture0;
+uniform vec4 colDiffuse;
+out vec4 finalColor;
+void main() {
+    float dist = texture(texture0, fragTexCoord).a - 0.5;
+    float edge = max(length(vec2(dFdx(dist), dFdy(dist))), 0.0001);
+    float alpha = smoothstep(-edge, edge, dist);
+    vec4 color = fragColor * colDiffuse;
+    finalColor = vec4(color.rgb, color.a * alpha);
+}
+)";
+#endif
+
+} // namespace
+
+bool SdfFont::load(const unsigned char* data, size_t size) {
+    unload();
+
+    sdf_atlas::Header header;
+    if (size < sizeof(header)) return false;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != sdf_atlas::Magic || header.glyphCount <= 0 ||
+        header.width <= 0 || header.height <= 0) return false;
+    size_t glyphBytes = sizeof(sdf_atlas::Glyph) * (size_t)header.glyphCount;
+    size_t pixelCount = (size_t)header.width * (size_t)header.height;
+    if (size != sizeof(header) + glyphBytes + pixelCount) return false;
+
+    const unsigned char* glyphData = data + sizeof(header);
+    const unsigned char* pixels = glyphData + glyphBytes;
+
+    Font f{};
+    f.baseSize = header.baseSize;
+    f.glyphCount = header.glyphCount;
+    f.glyphPadding = header.glyphPadding;
+    f.recs = (Rectangle*)MemAlloc(sizeof(Rectangle) * (unsigned int)f.glyphCount);
+    f.glyphs = (GlyphInfo*)MemAlloc(sizeof(GlyphInfo) * (unsigned int)f.glyphCount);
+    for (int i = 0; i < f.glyphCount; ++i) {
+        sdf_atlas::Glyph g;
+        std::memcpy(&g, glyphData + sizeof(g) * (size_t)i, sizeof(g));
+        f.recs[i] = {g.x, g.y, g.width, g.height};
+        f.glyphs[i].value = g.codepoint;
+        f.glyphs[i].offsetX = g.offsetX;
+        f.glyphs[i].offsetY = g.offsetY;
+        f.glyphs[i].advanceX = g.advanceX;
+        f.glyphs[i].image = Image{};
+    }
+
+    // Same layout raylib uses for its own SDF fonts: white with the distance
+    // in alpha, so the default shader would at least show a blurry glyph
+    Image atlas{};
+    atlas.width = header.width;
+    atlas.height = header.height;
+    atlas.mipmaps = 1;
+    atlas.format = PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA;
+    atlas.data = MemAlloc((unsigned int)(pixelCount * 2));
+    unsigned char* dst = (unsigned char*)atlas.data;
+    for (size_t i = 0; i < pixelCount; ++i) {
+        dst[2 * i] = 255;
+        dst[2 * i + 1] = pixels[i];
+    }
+    f.texture = LoadTextureFromImage(atlas);
+    UnloadImage(atlas);
+    SetTextureFilter(f.texture, TEXTURE_FILTER_BILINEAR);
+
+    fontData = f;
+    shader = LoadShaderFromMemory(nullptr, SdfFragmentShader);
+    loaded = true;
+    return true;
+}
+
+void SdfFont::unload() {
+    if (!loaded) return;
+    UnloadShader(shader);
+    UnloadFont(fontData);
+    fontData = GetFontDefault();
+    shader = Shader{};
+    loaded = false;
+}
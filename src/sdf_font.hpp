@@ -0,0 +1,48 @@
+#ifndef SDF_FONT_HPP
+#define SDF_FONT_HPP
+
+#include <cstddef>
+#include <raylib.h>
+
+// The app's only font: a signed distance field atlas generated at build time
+// (tools/font_atlas.cpp) and drawn through a shader that resolves the glyph
+// edge per screen pixel. One texture serves every text size and zoom level
+// and stays sharp when scaled, and startup skips TTF rasterization.
+//
+// font() is an ordinary raylib Font, so MeasureTextEx and LabelCache work on
+// it unchanged; anything that draws its glyphs must do so between begin()
+// and end().
+class SdfFont {
+public:
+    SdfFont() = default;
+    ~SdfFont() { unload(); }
+    SdfFont(const SdfFont&) = delete;
+    SdfFont& operator=(const SdfFont&) = delete;
+
+    // Loads an atlas blob; returns false and keeps raylib's default font if
+    // the blob is malformed. Needs a GL context.
+    bool load(const unsigned char* data, size_t size);
+    void unload();
+
+    const Font& font() const { return fontData; }
+
+    void begin() const { if (loaded) BeginShaderMode(shader); }
+    void end() const { if (loaded) EndShaderMode(); }
+
+    Vector2 measure(const char* text, float fontSize, float spacing) const {
+        return MeasureTextEx(fontData, text, fontSize, spacing);
+    }
+    // Single string in its own shader pass
+    void draw(const char* text, Vector2 pos, float fontSize, float spacing, Color tint) const {
+        begin();
+        DrawTextEx(fontData, text, pos, fontSize, spacing, tint);
+        end();
+    }
+
+private:
+    Font fontData = GetFontDefault();
+    Shader shader{};
+    bool loaded = false;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef SIMD_SEARCH_HPP
+#define SIMD_SEARCH_HPP
+
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_SEARCH_SSE2 1
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define SIMD_SEARCH_WASM 1
+#endif
+
+// Index of the first key >= k in a sorted run of ints (std::lower_bound).
+//
+// Node key arrays are short, so instead of branching per key this counts how
+// many keys are below k four at a time; in a sorted run that count is the
+// lower bound. Uses SSE2 on x86 and wasm SIMD when the web build is compiled
+// with -msimd128, and falls back to a plain scan otherwise.
+inline size_t simdLowerBound(const int* keys, size_t n, int k) {
+    size_t i = 0;
+    size_t below = 0;
+#if defined(SIMD_SEARCH_SSE2)
+    const __m128i needle = _mm_set1_epi32(k);
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, needle)));
+        below += (size_t)((mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1));
+        if (mask != 0xF) return below;
+    }
+#elif defined(SIMD_SEARCH_WASM)
+    const v128_t needle = wasm_i32x4_splat(k);
+    for (; i + 4 <= n; i += 4) {
+        v128_t v = wasm_v128_load(keys + i);
+        int mask = (int)wasm_i32x4_bitmask(wasm_i32x4_lt(v, needle));
+        below += (size_t)((mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1));
+        if (mask != 0xF) return below;
+    }
+#endif
+    for (; i < n && keys[i] < k; ++i) ++below;
+    return below;
+}
+
+#endif
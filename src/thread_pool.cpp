@@ -0,0 +1,58 @@
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(unsigned threads) {
+#if THREAD_POOL_THREADED
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 1; i < threads; ++i) workers.emplace_back(&ThreadPool::work, this);
+#else
+    (void)threads;
+#endif
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void ThreadPool::run(size_t parts, const std::function<void(size_t)>& fn) {
+    if (parts == 0) return;
+    if (workers.empty()) {
+        for (size_t part = 0; part < parts; ++part) fn(part);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        jobParts = parts;
+        nextPart.store(0, std::memory_order_relaxed);
+        busy = workers.size();
+        ++generation;
+    }
+    wake.notify_all();
+    drain();
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [&] { return busy == 0; });
+    job = nullptr;
+}
+
+void ThreadPool::drain() {
+    for (size_t part; (part = nextPart.fetch_add(1, std::memory_order_relaxed)) < jobParts;) (*job)(part);
+}
+
+void ThreadPool::work() {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+        lock.unlock();
+        drain();
+        lock.lock();
+        if (--busy == 0) idle.notify_one();
+    }
+}
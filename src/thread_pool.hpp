@@ -0,0 +1,71 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Web builds without pthreads have no threads to spare; the pool runs every
+// part on the calling thread
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define THREAD_POOL_THREADED 0
+#else
+#define THREAD_POOL_THREADED 1
+#endif
+
+// Fixed set of worker threads for fork-join loops.
+//
+// run() hands out parts [0, parts) one at a time through an atomic counter to
+// the workers and the calling thread, and returns once every part is done
+// and every worker is idle again, so the next run() can reuse the job slot.
+// Only one thread may call run() at a time.
+class ThreadPool {
+public:
+    // threads counts the calling thread; 0 uses every hardware thread
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Threads that take part in run(), the caller included
+    unsigned size() const { return (unsigned)workers.size() + 1; }
+
+    void run(size_t parts, const std::function<void(size_t part)>& fn);
+
+    // Splits [0, n) into up to size() contiguous ranges and calls
+    // fn(begin, end, part) for each, part < size()
+    template <typename F>
+    void parallelFor(size_t n, F&& fn) {
+        size_t parts = std::min<size_t>(size(), n);
+        if (parts <= 1) {
+            if (n > 0) fn((size_t)0, n, (size_t)0);
+            return;
+        }
+        run(parts, [&](size_t part) { fn(n * part / parts, n * (part + 1) / parts, part); });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    uint64_t generation = 0;
+    size_t busy = 0;      // workers still inside the current generation
+    bool stopping = false;
+
+    const std::function<void(size_t)>* job = nullptr;
+    size_t jobParts = 0;
+    std::atomic<size_t> nextPart{0};
+
+    void work();
+    void drain();
+};
+
+#endif
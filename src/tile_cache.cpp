@@ -0,0 +1,154 @@
+#include "tile_cache.hpp"
+#include <rlgl.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+TileCache::~TileCache() {
+    invalidateAll();
+}
+
+bool TileCache::setZoom(float zoom) {
+    // Nearest power of two, clamped to the camera's zoom range
+    float bucket = std::pow(2.0f, std::round(std::log2(std::max(zoom, 0.0001f))));
+    bucket = std::min(std::max(bucket, 0.125f), 4.0f);
+    if (bucket == scale) return false;
+    invalidateAll();
+    scale = bucket;
+    return true;
+}
+
+void TileCache::invalidateAll() {
+    for (auto& kv : tiles) {
+        if (kv.second.hasTexture) UnloadRenderTexture(kv.second.target);
+    }
+    tiles.clear();
+}
+
+void TileCache::tileRange(Rectangle world, int& x0, int& y0, int& x1, int& y1) const {
+    float size = tileWorldSize();
+    x0 = (int)std::floor(world.x / size);
+    y0 = (int)std::floor(world.y / size);
+    x1 = (int)std::floor((world.x + world.width) / size);
+    y1 = (int)std::floor((world.y + world.height) / size);
+}
+
+void TileCache::markDirty(Rectangle worldBox) {
+    if (scale == 0.0f) return;
+    int x0, y0, x1, y1;
+    tileRange(worldBox, x0, y0, x1, y1);
+    for (int ty = y0; ty <= y1; ++ty) {
+        for (int tx = x0; tx <= x1; ++tx) {
+            auto it = tiles.find(tileKey(tx, ty));
+            if (it != tiles.end()) it->second.dirty = true;
+        }
+    }
+}
+
+void TileCache::update(Rectangle visibleWorld, const DrawFn& drawStatic) {
+    if (scale == 0.0f) return;
+    ++frame;
+    float size = tileWorldSize();
+    int x0, y0, x1, y1;
+    tileRange(visibleWorld, x0, y0, x1, y1);
+
+    bool rendering = false;
+    for (int ty = y0; ty <= y1; ++ty) {
+        for (int tx = x0; tx <= x1; ++tx) {
+            Tile& tile = tiles[tileKey(tx, ty)];
+            tile.lastUsed = frame;
+            if (!tile.dirty) continue;
+            tile.dirty = false;
+
+            if (!tile.hasTexture) {
+                tile.target = LoadRenderTexture(TilePixels, TilePixels);
+                SetTextureFilter(tile.target.texture, TEXTURE_FILTER_BILINEAR);
+                tile.hasTexture = true;
+            }
+
+            if (!rendering) {
+                // Tiles are transparent, so accumulate premultiplied alpha;
+                // plain alpha blending would square the alpha of shadows.
+                rlSetBlendFactorsSeparate(RL_SRC_ALPHA, RL_ONE_MINUS_SRC_ALPHA, RL_ONE,
+                                          RL_ONE_MINUS_SRC_ALPHA, RL_FUNC_ADD, RL_FUNC_ADD);
+                rendering = true;
+            }
+
+            Rectangle tileWorld = {tx * size, ty * size, size, size};
+            Camera2D cam;
+            cam.offset = {0.0f, 0.0f};
+            cam.target = {tileWorld.x, tileWorld.y};
+            cam.rotation = 0.0f;
+            cam.zoom = scale;
+
+            BeginTextureMode(tile.target);
+            ClearBackground(BLANK);
+            BeginBlendMode(BLEND_CUSTOM_SEPARATE);
+            BeginMode2D(cam);
+            bool drewAnything = drawStatic(tileWorld);
+            EndMode2D();
+            EndBlendMode();
+            EndTextureMode();
+
+            if (!drewAnything) {
+                // Remember the tile as empty and release its texture
+                UnloadRenderTexture(tile.target);
+                tile.target = RenderTexture2D{};
+                tile.hasTexture = false;
+            }
+        }
+    }
+    evict();
+}
+
+void TileCache::draw(Rectangle visibleWorld) const {
+    if (scale == 0.0f) return;
+    float size = tileWorldSize();
+    int x0, y0, x1, y1;
+    tileRange(visibleWorld, x0, y0, x1, y1);
+
+    BeginBlendMode(BLEND_ALPHA_PREMULTIPLY);
+    for (int ty = y0; ty <= y1; ++ty) {
+        for (int tx = x0; tx <= x1; ++tx) {
+            auto it = tiles.find(tileKey(tx, ty));
+            if (it == tiles.end() || !it->second.hasTexture) continue;
+            // Render textures are stored bottom-up
+            Rectangle src = {0.0f, 0.0f, (float)TilePixels, -(float)TilePixels};
+            Rectangle dst = {tx * size, ty * size, size, size};
+            DrawTexturePro(it->second.target.texture, src, dst, {0.0f, 0.0f}, 0.0f, WHITE);
+        }
+    }
+    EndBlendMode();
+}
+
+size_t TileCache::textureCount() const {
+    size_t n = 0;
+    for (const auto& kv : tiles) n += kv.second.hasTexture ? 1 : 0;
+    return n;
+}
+
+void TileCache::evict() {
+    size_t textured = 0, empty = 0;
+    for (const auto& kv : tiles) ++(kv.second.hasTexture ? textured : empty);
+    if (textured <= MaxTextures && empty <= MaxEmptyTiles) return;
+
+    // Least recently used first, each kind against its own budget
+    std::vector<std::pair<uint64_t, uint64_t>> byAge; // (lastUsed, key)
+    for (const auto& kv : tiles) {
+        if (kv.second.lastUsed != frame) byAge.push_back({kv.second.lastUsed, kv.first});
+    }
+    std::sort(byAge.begin(), byAge.end());
+    for (const auto& entry : byAge) {
+        if (textured <= MaxTextures && empty <= MaxEmptyTiles) break;
+        auto it = tiles.find(entry.second);
+        if (it->second.hasTexture) {
+            if (textured <= MaxTextures) continue;
+            UnloadRenderTexture(it->second.target);
+            --textured;
+        } else {
+            if (empty <= MaxEmptyTiles) continue;
+            --empty;
+        }
+        tiles.erase(it);
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef TILE_CACHE_HPP
+#define TILE_CACHE_HPP
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <raylib.h>
+
+// World-space cache of the static part of the tree, split into square tiles
+// rendered to textures. Tiles are only re-rendered when a region that
+// overlaps them is marked dirty, so an idle tree is just a handful of
+// textured quads per frame and panning/zooming only composites.
+//
+// Each tile is TilePixels wide; the world area it covers depends on the zoom
+// level bucket (powers of two), so text stays crisp within a factor of two of
+// the current zoom. Changing bucket drops the cache.
+class TileCache {
+public:
+    static constexpr int TilePixels = 512;
+
+    // Draws whatever static content intersects the given world rectangle.
+    // Returns false if nothing was drawn, so empty tiles need no texture.
+    using DrawFn = std::function<bool(Rectangle tileWorld)>;
+
+    TileCache() = default;
+    ~TileCache();
+    TileCache(const TileCache&) = delete;
+    TileCache& operator=(const TileCache&) = delete;
+
+    // Picks the zoom bucket; returns true if that dropped the cache
+    bool setZoom(float zoom);
+
+    void markDirty(Rectangle worldBox);
+    void invalidateAll();
+
+    // Re-renders dirty or missing tiles overlapping visibleWorld. Must be
+    // called outside BeginMode2D/EndMode2D since it switches render targets.
+    void update(Rectangle visibleWorld, const DrawFn& drawStatic);
+
+    // Composites the cached tiles overlapping visibleWorld; call inside
+    // BeginMode2D with the world camera.
+    void draw(Rectangle visibleWorld) const;
+
+    float tileWorldSize() const { return (float)TilePixels / scale; }
+    // Zoom the tiles are rendered at
+    float zoomScale() const { return scale; }
+    size_t textureCount() const;
+
+private:
+    struct Tile {
+        RenderTexture2D target{};
+        bool hasTexture = false;
+        bool dirty = true;
+        uint64_t lastUsed = 0;
+    };
+
+    std::unordered_map<uint64_t, Tile> tiles;
+    float scale = 0.0f;
+    uint64_t frame = 0;
+
+    // Bound on resident textures (each is TilePixels^2 RGBA)
+    static constexpr size_t MaxTextures = 96;
+    // Bound on remembered empty tiles. They hold no texture, only spare the
+    // re-render, but would otherwise collect in the map as the view pans.
+    static constexpr size_t MaxEmptyTiles = 256;
+
+    static uint64_t tileKey(int tx, int ty) {
+        return ((uint64_t)(uint32_t)tx << 32) | (uint32_t)ty;
+    }
+    void tileRange(Rectangle world, int& x0, int& y0, int& x1, int& y1) const;
+    void evict();
+};
+
+#endif
@@ -0,0 +1,236 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TRACE_USE_MMAP 1
+#endif
+
+namespace {
+
+const char BinaryMagic[4] = {'B', 'T', 'R', 'C'};
+const uint32_t BinaryVersion = 1;
+const size_t BinaryHeaderBytes = 8;
+
+void putLE32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+uint32_t getLE32(const char* s) {
+    const unsigned char* p = (const unsigned char*)s;
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+} // namespace
+
+TraceReader::~TraceReader() {
+    close();
+}
+
+bool TraceReader::open(const std::string& path) {
+    close();
+
+#if TRACE_USE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) { errorText = "cannot open " + path; return false; }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            mapped = (const char*)p;
+            size = (uint64_t)st.st_size;
+            madvise(p, (size_t)size, MADV_SEQUENTIAL);
+        }
+    }
+    ::close(fd);
+#endif
+    if (!mapped) {
+        // No mmap here (or it failed); read through a buffer instead
+        file = std::fopen(path.c_str(), "rb");
+        if (!file) { errorText = "cannot open " + path; return false; }
+        std::fseek(file, 0, SEEK_END);
+        long length = std::ftell(file);
+        size = length > 0 ? (uint64_t)length : 0;
+        std::fseek(file, 0, SEEK_SET);
+    }
+
+    if (mapped) {
+        cur = mapped;
+        end = mapped + std::min<uint64_t>(size, ChunkBytes);
+        eof = size <= ChunkBytes;
+    } else {
+        cur = end = nullptr;
+        fill();
+    }
+
+    binary = end - cur >= (ptrdiff_t)BinaryHeaderBytes && std::memcmp(cur, BinaryMagic, 4) == 0;
+    if (binary) {
+        uint32_t version = getLE32(cur + 4);
+        if (version != BinaryVersion) {
+            errorText = "unsupported binary trace version " + std::to_string(version);
+            return false;
+        }
+        cur += BinaryHeaderBytes;
+        consumed = BinaryHeaderBytes;
+    }
+    return true;
+}
+
+void TraceReader::close() {
+#if TRACE_USE_MMAP
+    if (mapped) munmap((void*)mapped, (size_t)size);
+#endif
+    mapped = nullptr;
+    if (file) std::fclose(file);
+    file = nullptr;
+    buffer.clear();
+    cur = end = nullptr;
+    size = consumed = released = lineNumber = 0;
+    binary = eof = false;
+    errorText.clear();
+}
+
+bool TraceReader::fill() {
+    // Moves the window forward, keeping the unparsed tail [cur, end) in it
+    if (eof) return false;
+    size_t tail = (size_t)(end - cur);
+
+    if (mapped) {
+        uint64_t offset = (uint64_t)(cur - mapped);
+#if TRACE_USE_MMAP
+        // Hand parsed pages back so resident memory stays bounded
+        uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+        uint64_t upTo = offset / page * page;
+        if (upTo > released) {
+            madvise((void*)(mapped + released), (size_t)(upTo - released), MADV_DONTNEED);
+            released = upTo;
+        }
+#endif
+        uint64_t stop = std::min<uint64_t>(size, offset + tail + ChunkBytes);
+        end = mapped + stop;
+        eof = stop == size;
+        return true;
+    }
+
+    // The tail lives in the buffer itself, so locate it by offset across the resize
+    size_t start = tail > 0 ? (size_t)(cur - buffer.data()) : 0;
+    if (buffer.size() < ChunkBytes + tail) buffer.resize(ChunkBytes + tail);
+    if (tail > 0) std::memmove(buffer.data(), buffer.data() + start, tail);
+    size_t got = std::fread(buffer.data() + tail, 1, ChunkBytes, file);
+    cur = buffer.data();
+    end = cur + tail + got;
+    if (got < ChunkBytes) eof = true;
+    return got > 0;
+}
+
+size_t TraceReader::read(std::vector<TraceOp>& out, size_t maxOps) {
+    size_t before = out.size();
+    if (failed()) return 0;
+
+    while (out.size() - before < maxOps) {
+        if (binary) {
+            if ((size_t)(end - cur) < BinaryRecordBytes) {
+                if (!fill()) {
+                    if (cur != end) errorText = "truncated record at end of binary trace";
+                    break;
+                }
+                continue;
+            }
+            // Bulk decode whatever whole records the window holds
+            size_t avail = (size_t)(end - cur) / BinaryRecordBytes;
+            size_t n = std::min(avail, maxOps - (out.size() - before));
+            for (size_t i = 0; i < n; ++i, cur += BinaryRecordBytes) {
+                uint8_t op = (uint8_t)cur[0];
+                if (op > TraceOp::Lookup) {
+                    errorText = "bad op " + std::to_string(op) + " in binary record " +
+                        std::to_string((consumed - BinaryHeaderBytes) / BinaryRecordBytes);
+                    return out.size() - before;
+                }
+                out.push_back(TraceOp{(TraceOp::Type)op, (int)getLE32(cur + 1)});
+                consumed += BinaryRecordBytes;
+            }
+            continue;
+        }
+
+        const char* nl = (const char*)std::memchr(cur, '\n', (size_t)(end - cur));
+        if (!nl) {
+            // Partial line: pull in more, unless this is the unterminated last line
+            if (fill()) continue;
+            if (cur == end) break;
+            nl = end;
+        }
+        ++lineNumber;
+        const char* lineEnd = nl;
+        if (!parseLine(cur, lineEnd, out)) return out.size() - before;
+        consumed += (uint64_t)(nl - cur) + (nl < end ? 1 : 0);
+        cur = nl < end ? nl + 1 : nl;
+    }
+    return out.size() - before;
+}
+
+bool TraceReader::parseLine(const char* p, const char* lineEnd, std::vector<TraceOp>& out) {
+    while (p < lineEnd && isSpace(*p)) ++p;
+    if (p == lineEnd || *p == '#') return true;
+
+    TraceOp op;
+    switch (*p | 0x20) { // ASCII lower case
+    case 'i': op.type = TraceOp::Insert; break;
+    case 'e': op.type = TraceOp::Erase; break;
+    case 'l': op.type = TraceOp::Lookup; break;
+    default:
+        errorText = "line " + std::to_string(lineNumber) + ": unknown op '" + std::string(1, *p) + "'";
+        return false;
+    }
+    while (p < lineEnd && !isSpace(*p)) ++p;
+    while (p < lineEnd && isSpace(*p)) ++p;
+
+    auto res = std::from_chars(p, lineEnd, op.key);
+    if (res.ec != std::errc()) {
+        errorText = "line " + std::to_string(lineNumber) + ": bad key";
+        return false;
+    }
+    for (p = res.ptr; p < lineEnd; ++p) {
+        if (!isSpace(*p)) {
+            errorText = "line " + std::to_string(lineNumber) + ": trailing characters";
+            return false;
+        }
+    }
+    out.push_back(op);
+    return true;
+}
+
+bool TraceWriter::open(const std::string& path) {
+    close();
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+    unsigned char header[BinaryHeaderBytes];
+    std::memcpy(header, BinaryMagic, 4);
+    putLE32(header + 4, BinaryVersion);
+    ok = std::fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    return ok;
+}
+
+bool TraceWriter::write(const TraceOp& op) {
+    unsigned char record[5];
+    record[0] = (unsigned char)op.type;
+    putLE32(record + 1, (uint32_t)op.key);
+    ok = ok && std::fwrite(record, 1, sizeof(record), file) == sizeof(record);
+    return ok;
+}
+
+bool TraceWriter::close() {
+    if (!file) return ok;
+    ok = std::fclose(file) == 0 && ok;
+    file = nullptr;
+    return ok;
+}
@@ -0,0 +1,89 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Operation traces replayed against the tree.
+//
+// Text traces hold one operation per line: an op word whose first letter
+// picks the operation (i/insert, e/erase, l/lookup, any case) and a decimal
+// key, e.g. "i 42". Blank lines and lines starting with '#' are skipped.
+//
+// Binary traces start with the 8-byte header "BTRC" + uint32 version (1),
+// followed by packed 5-byte records: a uint8 op (0 insert, 1 erase,
+// 2 lookup) and a little-endian int32 key. The reader tells the two apart
+// by the magic.
+struct TraceOp {
+    enum Type : uint8_t { Insert = 0, Erase = 1, Lookup = 2 } type;
+    int key;
+};
+
+// Streams operations from a trace file. The file is memory-mapped where the
+// platform allows it and parsed in bounded chunks, dropping pages once they
+// have been consumed, so traces far larger than memory replay at parse speed.
+// Elsewhere it falls back to buffered reads.
+class TraceReader {
+public:
+    TraceReader() = default;
+    ~TraceReader();
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    // Appends up to maxOps operations to out; returns how many were read.
+    // Returns 0 at the end of the trace or on a malformed record (see error()).
+    size_t read(std::vector<TraceOp>& out, size_t maxOps);
+
+    bool isBinary() const { return binary; }
+    bool failed() const { return !errorText.empty(); }
+    const std::string& error() const { return errorText; }
+    uint64_t fileSize() const { return size; }
+    uint64_t bytesConsumed() const { return consumed; }
+
+private:
+    static constexpr size_t ChunkBytes = size_t(1) << 22;   // parse/readahead window
+    static constexpr size_t BinaryRecordBytes = 5;
+
+    std::FILE* file = nullptr;
+    const char* mapped = nullptr;  // whole file when memory-mapped
+    std::vector<char> buffer;      // buffered-read fallback
+    uint64_t size = 0;
+    uint64_t consumed = 0;         // bytes of the file fully parsed
+    uint64_t released = 0;         // mapped bytes handed back to the OS
+    uint64_t lineNumber = 0;
+    bool binary = false;
+    std::string errorText;
+
+    // Current window [cur, end); eof once nothing beyond it remains
+    const char* cur = nullptr;
+    const char* end = nullptr;
+    bool eof = false;
+
+    bool fill();
+    bool parseLine(const char* line, const char* lineEnd, std::vector<TraceOp>& out);
+};
+
+// Writes binary traces, e.g. to pack a text trace once for faster replay
+class TraceWriter {
+public:
+    TraceWriter() = default;
+    ~TraceWriter() { close(); }
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    bool open(const std::string& path);
+    bool write(const TraceOp& op);
+    bool close();
+
+private:
+    std::FILE* file = nullptr;
+    bool ok = true;
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include "tree_layout.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+bool TreeLayout::update(const BTree& tree) {
+    if (tree.getVersion() == treeVersion) return false;
+    treeVersion = tree.getVersion();
+
+    boxes.clear();
+    ptrXs.clear();
+    keyValues.clear();
+    edgeList.clear();
+    boxIndex.clear();
+    box = Rectangle{};
+
+    BTree::Node* root = tree.getRoot();
+    if (!root || root->keyCount() == 0) {
+        cache.clear();
+        return true;
+    }
+
+    ++pass;
+    bool changed = false;
+    Subtree& top = layoutSubtree(root, changed);
+
+    // Drop entries for nodes that are no longer in the tree
+    for (auto it = cache.begin(); it != cache.end();) {
+        if (it->second.pass != pass) it = cache.erase(it);
+        else ++it;
+    }
+
+    float minLeft = *std::min_element(top.left.begin(), top.left.end());
+    float minx = FLT_MAX, maxx = -FLT_MAX, maxy = -FLT_MAX;
+    place(root, XStart - minLeft, 0);
+    for (const auto& nb : boxes) {
+        minx = std::min(minx, nb.rect.x);
+        maxx = std::max(maxx, nb.rect.x + nb.rect.width);
+        maxy = std::max(maxy, nb.rect.y + nb.rect.height);
+    }
+    float miny = YStart - NodeHeight / 2.0f;
+    box = {minx, miny, maxx - minx, maxy - miny};
+    return true;
+}
+
+TreeLayout::Subtree& TreeLayout::layoutSubtree(BTree::Node* node, bool& changed) {
+    // unordered_map keeps element references valid across the inserts the
+    // recursion below makes
+    Subtree& s = cache[node];
+
+    bool childChanged = false;
+    for (BTree::Node* child : node->children) {
+        bool c = false;
+        layoutSubtree(child, c);
+        childChanged = childChanged || c;
+    }
+
+    size_t k = node->keyCount();
+    bool reusable = s.pass != 0 && !childChanged && s.keyCount == k && s.children == node->children;
+    s.pass = pass;
+    if (reusable) {
+        changed = false;
+        return s;
+    }
+    changed = true;
+
+    s.keyCount = k;
+    s.children = node->children;
+    float width = (float)k * KeyPitch;
+    s.left.assign(1, -NodePadding);
+    s.right.assign(1, width + NodePadding);
+    s.childOffset.clear();
+    if (node->children.empty()) return s;
+
+    // Pack children left to right against the accumulated right contour
+    std::vector<float> accLeft, accRight;
+    std::vector<float> offsets;
+    offsets.reserve(node->children.size());
+    for (size_t j = 0; j < node->children.size(); ++j) {
+        const Subtree& c = cache[node->children[j]];
+        float shift = 0.0f;
+        if (j > 0) {
+            shift = -FLT_MAX;
+            size_t overlap = std::min(accRight.size(), c.left.size());
+            for (size_t d = 0; d < overlap; ++d) {
+                shift = std::max(shift, accRight[d] - c.left[d] + SiblingGap);
+            }
+        }
+        offsets.push_back(shift);
+        for (size_t d = 0; d < c.left.size(); ++d) {
+            if (d < accLeft.size()) {
+                accLeft[d] = std::min(accLeft[d], c.left[d] + shift);
+                accRight[d] = std::max(accRight[d], c.right[d] + shift);
+            } else {
+                accLeft.push_back(c.left[d] + shift);
+                accRight.push_back(c.right[d] + shift);
+            }
+        }
+    }
+
+    // Centre this node over the midpoints of its first and last child
+    const Subtree& first = cache[node->children.front()];
+    const Subtree& last = cache[node->children.back()];
+    float firstMid = offsets.front() + (float)first.keyCount * KeyPitch / 2.0f;
+    float lastMid = offsets.back() + (float)last.keyCount * KeyPitch / 2.0f;
+    float origin = (firstMid + lastMid) / 2.0f - width / 2.0f;
+
+    for (float off : offsets) s.childOffset.push_back(off - origin);
+    for (size_t d = 0; d < accLeft.size(); ++d) {
+        s.left.push_back(accLeft[d] - origin);
+        s.right.push_back(accRight[d] - origin);
+    }
+    return s;
+}
+
+size_t TreeLayout::place(BTree::Node* node, float originX, int depth) {
+    const Subtree& s = cache[node];
+    size_t index = boxes.size();
+
+    NodeBox nb;
+    nb.node = node;
+    nb.depth = depth;
+    nb.cy = YStart + depth * LevelHeight;
+    nb.keyCount = node->keyCount();
+    nb.firstPtr = ptrXs.size();
+    nb.firstValue = keyValues.size();
+    float width = (float)nb.keyCount * KeyPitch;
+    nb.rect = {originX - NodePadding, nb.cy - NodeHeight / 2.0f, width + 2.0f * NodePadding, NodeHeight};
+    for (size_t i = 0; i <= nb.keyCount; ++i) ptrXs.push_back(originX + (float)i * KeyPitch);
+    // keyAt reads packed leaves in place
+    for (size_t i = 0; i < nb.keyCount; ++i) keyValues.push_back(node->keyAt(i));
+    boxes.push_back(nb);
+    boxIndex[node] = index;
+
+    for (size_t j = 0; j < node->children.size(); ++j) {
+        size_t ci = place(node->children[j], originX + s.childOffset[j], depth + 1);
+        const NodeBox& parent = boxes[index];
+        const NodeBox& child = boxes[ci];
+
+        // Parent pointer j to the nearest pointer on the child
+        float fromX = ptrXs[parent.firstPtr + std::min(j, parent.keyCount)];
+        float bestX = ptrXs[child.firstPtr];
+        for (size_t p = 0; p <= child.keyCount; ++p) {
+            float x = ptrXs[child.firstPtr + p];
+            if (std::fabs(x - fromX) < std::fabs(bestX - fromX)) bestX = x;
+        }
+        float parentPtrY = parent.cy + NodeHeight / 2.0f + 10.0f;
+        edgeList.push_back(Edge{{fromX, parentPtrY}, {bestX, child.cy}, ci});
+    }
+
+    NodeBox& own = boxes[index];
+    own.subtreeEnd = boxes.size();
+    own.span = own.rect;
+    if (!node->children.empty()) {
+        // Children are placed left to right and all leaves share a row
+        const Rectangle& first = boxes[index + 1].span;
+        const Rectangle& last = boxes[boxIndex[node->children.back()]].span;
+        float left = std::min(own.rect.x, first.x);
+        float right = std::max(own.rect.x + own.rect.width, last.x + last.width);
+        own.span = {left, own.rect.y, right - left, first.y + first.height - own.rect.y};
+    }
+    return index;
+}
+
+const TreeLayout::NodeBox* TreeLayout::find(const BTree::Node* node) const {
+    auto it = boxIndex.find(node);
+    return it == boxIndex.end() ? nullptr : &boxes[it->second];
+}
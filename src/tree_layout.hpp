@@ -0,0 +1,96 @@
+#ifndef TREE_LAYOUT_HPP
+#define TREE_LAYOUT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <raylib.h>
+#include "btree.hpp"
+
+// Tidy layout for the multiway tree in the Reingold-Tilford/Walker style.
+//
+// Every subtree keeps its left and right contour (outermost x per level,
+// relative to the subtree root). Siblings are packed left to right by
+// comparing the right contour of what has been placed so far with the left
+// contour of the next child, and each node is centred over its first and
+// last child. Merging costs O(height of the child), and since every leaf of
+// a B-tree sits at the same depth the sum of subtree heights is O(n), so a
+// full layout is linear.
+//
+// Subtree results are cached per node and keyed on the node's key count and
+// child pointers, so after a split or merge only the nodes on the changed
+// path recompute their contours; the rest are reused as is. The final pass
+// that turns relative offsets into world positions also maintains the
+// bounding box, so fitting the view is O(1).
+class TreeLayout {
+public:
+    static constexpr float KeyPitch = 48.0f;    // distance between child pointers
+    static constexpr float NodePadding = 18.0f; // body overhang past the outer pointers
+    static constexpr float NodeHeight = 36.0f;
+    static constexpr float SiblingGap = 24.0f;
+    static constexpr float XStart = 100.0f;
+    static constexpr float YStart = 50.0f;
+    static constexpr float LevelHeight = 80.0f;
+
+    struct NodeBox {
+        BTree::Node* node;
+        Rectangle rect;     // node body
+        float cy;
+        int depth;
+        size_t firstPtr;    // keyCount + 1 entries in pointerXs()
+        size_t firstValue;  // keyCount entries in values()
+        size_t keyCount;
+        // Boxes are in preorder, so the subtree is this box up to
+        // subtreeEnd (exclusive); span bounds all of its boxes
+        size_t subtreeEnd;
+        Rectangle span;
+    };
+
+    struct Edge { Vector2 from; Vector2 to; size_t child; /* index in nodes() */ };
+
+    // Recomputes the layout if the tree changed since the last call.
+    // Returns true if anything was recomputed.
+    bool update(const BTree& tree);
+    void invalidate() { treeVersion = UINT64_MAX; }
+
+    const std::vector<NodeBox>& nodes() const { return boxes; }
+    const std::vector<float>& pointerXs() const { return ptrXs; }
+    const std::vector<int>& values() const { return keyValues; }
+    const std::vector<Edge>& edges() const { return edgeList; }
+    const NodeBox* find(const BTree::Node* node) const;
+
+    // World-space box around every node; empty when the tree is
+    bool empty() const { return boxes.empty(); }
+    Rectangle bounds() const { return box; }
+
+    // Key centre for a node's key slot
+    Vector2 keyCenter(const NodeBox& nb, size_t i) const {
+        return {(ptrXs[nb.firstPtr + i] + ptrXs[nb.firstPtr + i + 1]) * 0.5f, nb.cy};
+    }
+
+private:
+    struct Subtree {
+        size_t keyCount = 0;
+        std::vector<BTree::Node*> children;
+        std::vector<float> left, right;   // contour per level, relative to node origin
+        std::vector<float> childOffset;   // child origin relative to node origin
+        uint64_t pass = 0;
+    };
+
+    std::unordered_map<const BTree::Node*, Subtree> cache;
+    uint64_t pass = 0;
+    uint64_t treeVersion = UINT64_MAX;
+
+    std::vector<NodeBox> boxes;
+    std::vector<float> ptrXs;
+    std::vector<int> keyValues;
+    std::vector<Edge> edgeList;
+    std::unordered_map<const BTree::Node*, size_t> boxIndex;
+    Rectangle box{};
+
+    Subtree& layoutSubtree(BTree::Node* node, bool& changed);
+    size_t place(BTree::Node* node, float originX, int depth);
+};
+
+#endif
@@ -0,0 +1,383 @@
+#include "tree_worker.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+TreeWorker::TreeWorker(int t, int initialKeys, bool multiset, bool bStar, uint32_t seed)
+    : tree(t, multiset), splitOff(t, multiset), rng(seed), dist(10, 99) {
+    // Subtree counts label collapsed subtrees when zoomed far out
+    tree.setAggregates(true);
+    splitOff.setAggregates(true);
+    tree.setBStar(bStar);
+    splitOff.setBStar(bStar);
+    for (int i = 0; i < initialKeys; ++i) tree.insert(uniqueRandomKey(), ++insertions);
+    layout.update(tree);
+    publish();
+    snapshots.consume();
+}
+
+TreeWorker::~TreeWorker() {
+    stop();
+}
+
+void TreeWorker::setCacheShapes(const CacheShape& cache, const CacheShape& tlb) {
+    simCache = visualizerCacheShape(cache);
+    simTlb = visualizerTlbShape(tlb);
+}
+
+void TreeWorker::start() {
+#if TREE_WORKER_THREADED
+    if (thread.joinable()) return;
+    stopping = false;
+    thread = std::thread(&TreeWorker::run, this);
+#endif
+}
+
+void TreeWorker::stop() {
+#if TREE_WORKER_THREADED
+    if (!thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+#endif
+}
+
+void TreeWorker::post(const Command& cmd) {
+    inFlight.fetch_add(1, std::memory_order_acq_rel);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(cmd);
+    }
+    wake.notify_one();
+}
+
+void TreeWorker::tick(float deltaTime) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pendingDelta += deltaTime;
+    }
+    wake.notify_one();
+}
+
+void TreeWorker::pump() {
+#if TREE_WORKER_THREADED
+    if (thread.joinable()) return;
+#endif
+    std::vector<Command> commands;
+    float dt = 0.0f;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        commands.swap(queue);
+        dt = pendingDelta;
+        pendingDelta = 0.0f;
+    }
+    if (step(commands, dt)) publish();
+    inFlight.fetch_sub((int)commands.size(), std::memory_order_acq_rel);
+}
+
+void TreeWorker::run() {
+    std::vector<Command> commands;
+    for (;;) {
+        float dt = 0.0f;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            // Frame ticks only matter while something is animating
+            wake.wait(lock, [&] { return stopping || !queue.empty() || (pendingDelta > 0.0f && tree.isAnimating()); });
+            if (stopping) return;
+            commands.swap(queue);
+            dt = pendingDelta;
+            pendingDelta = 0.0f;
+        }
+        if (step(commands, dt)) publish();
+        // Only count commands as done once their result is visible
+        inFlight.fetch_sub((int)commands.size(), std::memory_order_acq_rel);
+        commands.clear();
+    }
+}
+
+bool TreeWorker::step(std::vector<Command>& commands, float deltaTime) {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point begin = Clock::now();
+    bool changed = !commands.empty();
+    // A new command starts the operation being timed
+    if (changed) operationSeconds = 0.0;
+
+    // Deferred animated inserts run inside updateAnimation, so it is
+    // recorded along with the commands
+    accessLog.clear();
+    if (cacheSim) BTree::setAccessLog(&accessLog);
+
+    if (tree.isAnimating()) {
+        tree.updateAnimation(deltaTime);
+        if (tree.hasAnimationJustCompleted()) {
+            ++completedAnimations;
+            tree.clearAnimationCompletedFlag();
+        }
+        changed = true;
+    }
+
+    for (const auto& cmd : commands) apply(cmd);
+
+    // The cut happens once its path has been shown
+    if (splitPending && !tree.isAnimating()) {
+        splitPending = false;
+        tree.split(splitPivot, splitOff);
+        changed = true;
+    }
+
+    BTree::setAccessLog(nullptr);
+    if (cacheSim && !accessLog.empty()) {
+        lastMisses.clear();
+        lastAccess = cacheSim->run(accessLog, &lastMisses);
+        changed = true;
+    }
+
+    if (layout.update(tree)) {
+        // The animation system resolves target positions from these
+        tree.clearKeyPositions();
+        for (const auto& nb : layout.nodes()) {
+            for (size_t i = 0; i < nb.keyCount; ++i) tree.setKeyPosition(nb.node, (int)i, layout.keyCenter(nb, i));
+        }
+        changed = true;
+    }
+
+    if (splitLayout.update(splitOff)) changed = true;
+
+    if (wasAnimating != tree.isAnimating()) changed = true;
+    wasAnimating = tree.isAnimating();
+    operationSeconds += std::chrono::duration<double>(Clock::now() - begin).count();
+    return changed;
+}
+
+void TreeWorker::apply(const Command& cmd) {
+    switch (cmd.type) {
+    case Command::AddRandom:
+        tree.insertAnimated(uniqueRandomKey(), ++insertions);
+        break;
+    case Command::AddRandomMany:
+        for (int i = 0; i < cmd.count; ++i) tree.insertAnimated(uniqueRandomKey(), ++insertions);
+        break;
+    case Command::InsertKey:
+        // Check for duplicates before inserting
+        if (tree.isMultiset() || !tree.contains(cmd.key)) tree.insertAnimated(cmd.key, ++insertions);
+        break;
+    case Command::UpsertKey:
+        if (!tree.contains(cmd.key)) tree.insertAnimated(cmd.key, cmd.value);
+        else tree.upsert(cmd.key, cmd.value);
+        break;
+    case Command::EraseLast:
+        if (tree.hasKeys()) tree.eraseAnimated(tree.getLastInsertedKey());
+        break;
+    case Command::EraseKey:
+        tree.eraseAnimated(cmd.key);
+        break;
+    case Command::Clear:
+        tree.clearAll();
+        splitOff.clearAll();
+        break;
+    case Command::Reset:
+        tree.clearAll();
+        splitOff.clearAll();
+        for (int i = 0; i < cmd.count; ++i) tree.insert(uniqueRandomKey(), ++insertions);
+        break;
+    case Command::SetDegree:
+        tree.setDegree(cmd.count);
+        splitOff.setDegree(cmd.count);
+        break;
+    case Command::Lookup:
+        tree.contains(cmd.key);
+        break;
+    case Command::SearchKey:
+        tree.searchAnimated(cmd.key);
+        break;
+    case Command::EraseRange:
+        tree.eraseRangeAnimated(cmd.key, cmd.count);
+        break;
+    case Command::SetHeat:
+        tree.setHeatTracking(cmd.count != 0);
+        break;
+    case Command::SetCacheSim:
+        // Starts cold; the tree's own allocation is what gets simulated
+        cacheSim.reset(cmd.count ? new MemorySim(NodeLayout::Heap, tree.getDegree(), simCache, simTlb) : nullptr);
+        lastMisses.clear();
+        lastAccess = MissCounts();
+        break;
+    case Command::SetBStar:
+        tree.setBStar(cmd.count != 0);
+        splitOff.setBStar(cmd.count != 0);
+        break;
+    case Command::SplitAt:
+        if (splitPending || splitOff.hasKeys()) break;
+        tree.splitPathAnimated(cmd.key);
+        splitPending = true;
+        splitPivot = cmd.key;
+        break;
+    case Command::JoinSplit: {
+        int seam;
+        if (!splitOff.minKey(seam)) break;
+        if (tree.join(splitOff)) {
+            tree.joinSeamAnimated(seam);
+            break;
+        }
+        // Keys added since the split overlap the halves; fall back to
+        // inserting the right half's keys one by one
+        splitOff.traverse([&](BTree::Node* node, int, int i) {
+            for (uint32_t c = 0; c < node->countAt(i); ++c) tree.insert(node->keyAt(i), node->valueAt(i));
+        });
+        splitOff.clearAll();
+        break;
+    }
+    }
+}
+
+int TreeWorker::uniqueRandomKey() {
+    int val = dist(rng);
+    if (tree.isMultiset()) return val;
+    while (tree.contains(val) || splitOff.contains(val)) val = dist(rng);
+    return val;
+}
+
+void TreeWorker::publish() {
+    RenderSnapshot& snap = snapshots.back();
+    snap.serial = ++serial;
+
+    // Each slot remembers which layout it holds, so geometry is only copied
+    // into slots that are behind
+    // Both trees' versions only grow, so their sum changes with either
+    uint64_t version = tree.getVersion() + splitOff.getVersion();
+    if (snap.layoutVersion != version) {
+        snap.layoutVersion = version;
+        snap.nodes = layout.nodes();
+        snap.pointerXs = layout.pointerXs();
+        snap.values = layout.values();
+        // Values are read here, on the thread that owns the tree
+        snap.payloads.resize(snap.values.size());
+        snap.counts.resize(snap.values.size());
+        snap.subtreeKeys.clear();
+        for (const auto& nb : layout.nodes()) {
+            snap.subtreeKeys.push_back(nb.node->agg.count);
+            for (size_t i = 0; i < nb.keyCount; ++i) {
+                // Packed leaves may drop all-zero values and all-one counts
+                snap.payloads[nb.firstValue + i] = nb.node->valueAt(i);
+                snap.counts[nb.firstValue + i] = nb.node->countAt(i);
+            }
+        }
+        snap.edges = layout.edges();
+        snap.bounds = layout.bounds();
+        snap.empty = layout.empty();
+
+        snap.split = !splitLayout.empty();
+        if (snap.split) appendSplitLayout(snap);
+    }
+    snap.splitPivot = splitPivot;
+
+    snap.animations.assign(tree.getCurrentAnimations().begin(), tree.getCurrentAnimations().end());
+    snap.animationAnchors.clear();
+    for (auto& anim : snap.animations) {
+        Vector2 anchor = {NAN, NAN};
+        if (anim.type == BTree::AnimationType::KeyMoving && anim.operation == BTree::AnimationStep::DeleteKey) {
+            const TreeLayout::NodeBox* nb = layout.find(anim.targetNode);
+            if (nb && anim.targetIndex >= 0 && anim.targetIndex < (int)nb->keyCount) {
+                anchor = layout.keyCenter(*nb, (size_t)anim.targetIndex);
+            }
+        } else if (anim.type == BTree::AnimationType::KeyMoving && anim.operation == BTree::AnimationStep::BalanceTree) {
+            // The key's old slot is gone; the one now at its index stands
+            // in. The landing slot is found by key: a shift one level down
+            // may move it on, and then this hop is not drawn.
+            const TreeLayout::NodeBox* from = layout.find(anim.sourceNode);
+            const TreeLayout::NodeBox* to = layout.find(anim.targetNode);
+            if (from && to && from->keyCount > 0) {
+                size_t slot = to->keyCount;
+                for (size_t i = 0; i < to->keyCount && slot == to->keyCount; ++i) {
+                    if (layout.values()[to->firstValue + i] == anim.movingKey) slot = i;
+                }
+                if (slot < to->keyCount) {
+                    anchor = layout.keyCenter(*from, std::min((size_t)std::max(anim.sourceIndex, 0), from->keyCount - 1));
+                    anim.endPos = layout.keyCenter(*to, slot);
+                }
+            }
+        }
+        snap.animationAnchors.push_back(anchor);
+    }
+    snap.completedAnimations = completedAnimations;
+    snap.animating = tree.isAnimating();
+    snap.operationSeconds = operationSeconds;
+    snap.hasKeys = tree.hasKeys();
+    snap.lastInsertedKey = tree.getLastInsertedKey();
+    snap.degree = tree.getDegree();
+    snap.multiset = tree.isMultiset();
+    snap.bStar = tree.isBStar();
+    snap.stats = tree.getStats();
+    snap.fill = tree.fillFactor();
+    snap.memoryBytes = tree.memoryBytes();
+    snap.heat.clear();
+    if (tree.heatTracking()) {
+        uint32_t hottest = 1;
+        for (const auto& nb : layout.nodes()) hottest = std::max(hottest, tree.heatOf(nb.node));
+        for (const auto& nb : layout.nodes()) snap.heat.push_back((float)tree.heatOf(nb.node) / (float)hottest);
+        snap.heat.resize(snap.nodes.size(), 0.0f);
+    }
+
+    snap.missed.clear();
+    snap.lastAccess = lastAccess;
+    if (cacheSim) {
+        snap.missed.assign(snap.nodes.size(), 0);
+        for (const auto& m : lastMisses) {
+            // Nodes freed by the operation have no box any more
+            const TreeLayout::NodeBox* nb = layout.find(m.node);
+            if (!nb) continue;
+            snap.missed[nb - layout.nodes().data()] = (m.cacheMisses ? 1 : 0) | (m.tlbMisses ? 2 : 0);
+        }
+    }
+
+    snapshots.publish();
+}
+
+void TreeWorker::appendSplitLayout(RenderSnapshot& snap) {
+    // Shift the second tree to start a gap right of the first, tops level
+    Rectangle own = splitLayout.bounds();
+    float dx = snap.empty ? 0.0f : snap.bounds.x + snap.bounds.width + SplitGap - own.x;
+    float dy = snap.empty ? 0.0f : snap.bounds.y - own.y;
+    size_t nodeBase = snap.nodes.size(), ptrBase = snap.pointerXs.size(), valueBase = snap.values.size();
+
+    for (TreeLayout::NodeBox nb : splitLayout.nodes()) {
+        nb.rect.x += dx;
+        nb.rect.y += dy;
+        nb.cy += dy;
+        nb.firstPtr += ptrBase;
+        nb.firstValue += valueBase;
+        nb.subtreeEnd += nodeBase;
+        nb.span.x += dx;
+        nb.span.y += dy;
+        snap.nodes.push_back(nb);
+        snap.subtreeKeys.push_back(nb.node->agg.count);
+        for (size_t i = 0; i < nb.keyCount; ++i) {
+            snap.payloads.push_back(nb.node->valueAt(i));
+            snap.counts.push_back(nb.node->countAt(i));
+        }
+    }
+    for (float x : splitLayout.pointerXs()) snap.pointerXs.push_back(x + dx);
+    snap.values.insert(snap.values.end(), splitLayout.values().begin(), splitLayout.values().end());
+    for (TreeLayout::Edge e : splitLayout.edges()) {
+        e.from.x += dx;
+        e.from.y += dy;
+        e.to.x += dx;
+        e.to.y += dy;
+        e.child += nodeBase;
+        snap.edges.push_back(e);
+    }
+
+    snap.splitBounds = {own.x + dx, own.y + dy, own.width, own.height};
+    if (snap.empty) {
+        snap.bounds = snap.splitBounds;
+    } else {
+        float right = snap.splitBounds.x + snap.splitBounds.width;
+        float bottom = std::max(snap.bounds.y + snap.bounds.height, snap.splitBounds.y + snap.splitBounds.height);
+        snap.bounds.width = right - snap.bounds.x;
+        snap.bounds.height = bottom - snap.bounds.y;
+    }
+    snap.empty = false;
+}
@@ -0,0 +1,190 @@
+#ifndef TREE_WORKER_HPP
+#define TREE_WORKER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "btree.hpp"
+#include "cache_sim.hpp"
+#include "tree_layout.hpp"
+#include "triple_buffer.hpp"
+
+// Web builds without pthreads run the worker inline from the frame loop
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define TREE_WORKER_THREADED 0
+#else
+#define TREE_WORKER_THREADED 1
+#endif
+
+// Everything the renderer needs to draw one state of the tree. Node pointers
+// are only used as identities to match animations against boxes and must not
+// be dereferenced on the render thread.
+struct RenderSnapshot {
+    uint64_t serial = 0;
+    uint64_t layoutVersion = 0;   // changes whenever the geometry below does
+
+    std::vector<TreeLayout::NodeBox> nodes;
+    std::vector<float> pointerXs;
+    std::vector<int> values;
+    std::vector<BTree::Value> payloads;   // value stored with each key in values
+    std::vector<uint32_t> counts;         // occurrences of each key in values
+    std::vector<uint64_t> subtreeKeys;    // occurrences under each entry of nodes
+    std::vector<TreeLayout::Edge> edges;
+    Rectangle bounds{};
+    bool empty = true;
+
+    std::vector<BTree::AnimationStep> animations;
+    // World position of the key each animation starts from (deletions and
+    // B* rotations); NaN when it has none. A rotation's endPos is set to
+    // the slot it lands in.
+    std::vector<Vector2> animationAnchors;
+    uint64_t completedAnimations = 0;  // running count, compare across frames
+    bool animating = false;
+    // Worker time spent on the latest command so far, through every step
+    // of its animation but not the frames in between
+    double operationSeconds = 0.0;
+
+    bool hasKeys = false;
+    int lastInsertedKey = -1;
+    int degree = 0;               // minimum degree t
+    bool multiset = false;
+    bool bStar = false;           // B* inserts, see BTree::setBStar
+
+    BTree::Stats stats;
+    double fill = 0.0;
+    size_t memoryBytes = 0;
+
+    // Access heat per entry of nodes, relative to the hottest node; empty
+    // while heat tracking is off
+    std::vector<float> heat;
+
+    // Cache simulation of the last operation that touched nodes: per entry
+    // of nodes, bit 0 for a cache miss and bit 1 for a TLB miss. Empty
+    // while the simulation is off.
+    std::vector<uint8_t> missed;
+    MissCounts lastAccess;
+
+    // After a split the keys >= splitPivot live in a second tree, drawn
+    // right of the first within splitBounds, until they are joined back.
+    // Its boxes follow the first tree's in nodes and edges.
+    bool split = false;
+    int splitPivot = 0;
+    Rectangle splitBounds{};
+};
+
+// Owns the tree and its layout on a background thread. The render thread
+// posts commands and frame ticks, and reads immutable snapshots through a
+// lock-free triple buffer, so large inserts or erase rebuilds never stall
+// input or drawing.
+class TreeWorker {
+public:
+    struct Command {
+        enum Type {
+            AddRandom,      // one random key, animated; unique unless a multiset
+            AddRandomMany,  // `count` random keys, animated
+            InsertKey,      // `key`, animated; if present only a multiset counts it
+            UpsertKey,      // set `key` to `value`, inserting it animated if new
+            EraseLast,      // last inserted key, animated
+            EraseKey,       // `key`, animated
+            EraseRange,     // every key from `key` to `count`, as one animation
+            Clear,
+            Reset,          // clear and insert `count` random keys at once
+            SetDegree,      // rebuild the current keys with minimum degree `count`
+            Lookup,         // search for `key`; only visible through heat
+            SearchKey,      // search for `key`, animating the path
+            SetHeat,        // heat tracking on (`count` != 0) or off
+            SetCacheSim,    // simulate cache and TLB misses (`count` != 0) or not
+            SetBStar,       // B* inserts (`count` != 0) or plain splits
+            SplitAt,        // animate the cut, then move keys >= `key` to a second tree
+            JoinSplit       // graft the second tree back on, animating the seam
+        } type;
+        int key = 0;
+        int count = 0;
+        BTree::Value value = 0;
+    };
+
+    // Workers given the same seed pick the same random keys, so trees fed
+    // the same commands hold the same keys whatever their shape
+    explicit TreeWorker(int t, int initialKeys = 8, bool multiset = false, bool bStar = false,
+                        uint32_t seed = std::random_device{}());
+    ~TreeWorker();
+    TreeWorker(const TreeWorker&) = delete;
+    TreeWorker& operator=(const TreeWorker&) = delete;
+
+    // Shapes of the simulated cache and TLB behind SetCacheSim. Call
+    // before start(); zeros take visualizerCacheShape's defaults.
+    void setCacheShapes(const CacheShape& cache, const CacheShape& tlb);
+    const CacheShape& cacheShape() const { return simCache; }
+    const CacheShape& tlbShape() const { return simTlb; }
+
+    void start();
+    void stop();
+
+    // Render thread side; none of these wait for tree work
+    void post(const Command& cmd);
+    void tick(float deltaTime);
+    bool consume() { return snapshots.consume(); }
+    const RenderSnapshot& snapshot() const { return snapshots.front(); }
+    // True when no posted command is queued or being applied
+    bool idle() const { return inFlight.load(std::memory_order_acquire) == 0; }
+
+    // Runs pending work on the calling thread when built without threads,
+    // or while stopped: offline export steps the tree this way so every
+    // frame sees exactly the work posted before it
+    void pump();
+
+private:
+    BTree tree;
+    TreeLayout layout;
+    // Right half of a split, and a split waiting for its cut animation
+    BTree splitOff;
+    TreeLayout splitLayout;
+    bool splitPending = false;
+    int splitPivot = 0;
+    std::mt19937 rng;
+    std::uniform_int_distribution<int> dist;
+    BTree::Value insertions = 0;   // keys get their insertion number as value
+    double operationSeconds = 0.0;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<Command> queue;
+    float pendingDelta = 0.0f;
+    bool stopping = false;
+    std::atomic<int> inFlight{0};
+    std::thread thread;
+
+    TripleBuffer<RenderSnapshot> snapshots;
+    uint64_t serial = 0;
+    uint64_t completedAnimations = 0;
+    bool wasAnimating = false;
+
+    // Miss simulation: node accesses of each step run through the cache
+    // and TLB as the tree actually lays nodes out
+    CacheShape simCache = visualizerCacheShape({});
+    CacheShape simTlb = visualizerTlbShape({});
+    std::unique_ptr<MemorySim> cacheSim;
+    std::vector<BTree::NodeAccess> accessLog;
+    std::vector<NodeMisses> lastMisses;
+    MissCounts lastAccess;
+
+    void run();
+    // Applies queued commands and elapsed time; returns true if anything
+    // visible may have changed
+    bool step(std::vector<Command>& commands, float deltaTime);
+    void apply(const Command& cmd);
+    // A key not in the tree yet, or any key for a multiset
+    int uniqueRandomKey();
+    void publish();
+    // World-space gap between the two trees of a split
+    static constexpr float SplitGap = 120.0f;
+    // Adds the split-off tree's geometry after the first tree's
+    void appendSplitLayout(RenderSnapshot& snap);
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single-producer/single-consumer triple buffer.
+//
+// The producer always owns one slot to write into and the consumer one slot
+// to read from; the third slot sits in the middle and is swapped atomically.
+// Neither side ever waits for the other: a publish replaces whatever the
+// consumer has not picked up yet, and a consume just keeps the last value if
+// nothing new was published.
+template <typename T>
+class TripleBuffer {
+public:
+    // Producer: slot to fill before calling publish()
+    T& back() { return slots[backIndex]; }
+
+    void publish() {
+        backIndex = middle.exchange((uint8_t)(backIndex | FreshBit), std::memory_order_acq_rel) & IndexMask;
+    }
+
+    // Consumer: picks up the latest published slot, if any.
+    // Returns false if nothing new has been published since the last call.
+    bool consume() {
+        if (!(middle.load(std::memory_order_acquire) & FreshBit)) return false;
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+
+    const T& front() const { return slots[frontIndex]; }
+
+private:
+    static constexpr uint8_t IndexMask = 0x3;
+    static constexpr uint8_t FreshBit = 0x4;
+
+    T slots[3];
+    std::atomic<uint8_t> middle{1};
+    uint8_t backIndex = 0;   // producer only
+    uint8_t frontIndex = 2;  // consumer only
+};
+
+#endif
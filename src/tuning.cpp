@@ -0,0 +1,336 @@
+#include "tuning.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <thread>
+#include "btree.hpp"
+#include "frozen_btree.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const int Sweep[] = {2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128};
+
+// Parses sysfs sizes such as "48K" or "2048K"
+size_t parseSize(const std::string& text) {
+    size_t value = 0;
+    size_t i = 0;
+    while (i < text.size() && text[i] >= '0' && text[i] <= '9') value = value * 10 + (size_t)(text[i++] - '0');
+    if (i < text.size()) {
+        if (text[i] == 'K') value *= 1024;
+        else if (text[i] == 'M') value *= 1024 * 1024;
+        else if (text[i] == 'G') value *= 1024 * 1024 * 1024;
+    }
+    return value;
+}
+
+bool readLine(const std::string& path, std::string& out) {
+    std::ifstream in(path);
+    return (bool)std::getline(in, out);
+}
+
+double seconds(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double>(to - from).count();
+}
+
+} // namespace
+
+CacheInfo readCacheInfo() {
+    CacheInfo info;
+    bool found = false;
+    size_t l3 = 0;
+    for (int index = 0; index < 8; ++index) {
+        std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/";
+        std::string level, type, size, line;
+        if (!readLine(dir + "level", level) || !readLine(dir + "type", type) || !readLine(dir + "size", size)) break;
+        if (type == "Instruction") continue;
+        size_t bytes = parseSize(size);
+        if (bytes == 0) continue;
+        found = true;
+        if (level == "1") info.l1 = bytes;
+        else if (level == "2") info.l2 = bytes;
+        else l3 = std::max(l3, bytes);
+        if (readLine(dir + "coherency_line_size", line) && parseSize(line) > 0) info.lineSize = parseSize(line);
+    }
+#if defined(_SC_LEVEL1_DCACHE_SIZE)
+    if (!found) {
+        long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE), l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        long l3c = sysconf(_SC_LEVEL3_CACHE_SIZE), line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+        if (l1 > 0) { info.l1 = (size_t)l1; found = true; }
+        if (l2 > 0) info.l2 = (size_t)l2;
+        if (l3c > 0) l3 = (size_t)l3c;
+        if (line > 0) info.lineSize = (size_t)line;
+    }
+#endif
+    // Machines without an L3 report the L2 as the last level
+    if (found && l3 == 0) l3 = info.l2;
+    if (l3 > 0) info.llc = l3;
+    info.detected = found;
+    return info;
+}
+
+bool loadWorkload(const AppOptions& options, size_t keys, const char* tag, std::vector<TraceOp>& ops) {
+    if (!options.replayPath.empty()) {
+        TraceReader reader;
+        if (!reader.open(options.replayPath)) {
+            std::fprintf(stderr, "%s: %s\n", tag, reader.error().c_str());
+            return false;
+        }
+        while (reader.read(ops, 1 << 16) > 0) {}
+        if (reader.failed()) {
+            std::fprintf(stderr, "%s: %s\n", tag, reader.error().c_str());
+            return false;
+        }
+        std::printf("[%s] workload: %zu ops from %s\n", tag, ops.size(), options.replayPath.c_str());
+        return true;
+    }
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<int> dist(0, 1 << 30);
+    ops.reserve(keys * 2);
+    for (size_t i = 0; i < keys; ++i) ops.push_back(TraceOp{TraceOp::Insert, dist(rng)});
+    for (size_t i = 0; i < keys; ++i) {
+        // Half of the lookups hit an inserted key
+        int key = (i & 1) ? ops[rng() % keys].key : dist(rng);
+        ops.push_back(TraceOp{TraceOp::Lookup, key});
+    }
+    std::printf("[%s] workload: %zu random inserts, then as many lookups\n", tag, keys);
+    return true;
+}
+
+int runTuning(const AppOptions& options) {
+    CacheInfo cache = readCacheInfo();
+    std::printf("[tune] caches%s: L1d %zu KiB, L2 %zu KiB, LLC %zu KiB, line %zu B\n",
+                cache.detected ? "" : " (not detected, assumed)",
+                cache.l1 / 1024, cache.l2 / 1024, cache.llc / 1024, cache.lineSize);
+
+    // Random keys are sized so the tree outgrows the LLC: nodes cost well
+    // over 4 bytes a key, so llc / 4 keys is several times the LLC; capped
+    // to keep the sweep to minutes
+    size_t keys = options.tuneKeys ? options.tuneKeys
+                                   : std::min<size_t>(std::max<size_t>(1 << 18, cache.llc / 4), 1 << 23);
+    std::vector<TraceOp> ops;
+    if (!loadWorkload(options, keys, "tune", ops)) return 1;
+
+    std::vector<TuningResult> results;
+    std::printf("[tune] %5s %14s %14s %14s %7s %10s %12s %8s %6s %11s\n",
+                "t", "insert ops/s", "lookup ops/s", "batch ops/s", "hits", "total s", "node MiB", "B/key", "height", "node lines");
+    for (int t : Sweep) {
+        BTree tree(t);
+        size_t inserts = 0, lookups = 0, found = 0;
+        double insertTime = 0.0, lookupTime = 0.0, batchTime = 0.0;
+        std::vector<int> batchKeys;
+        std::vector<bool> batchFound;
+        Clock::time_point begin = Clock::now();
+
+        // Time runs of the same kind together so clock reads stay off the hot path
+        for (size_t i = 0; i < ops.size();) {
+            size_t j = i;
+            while (j < ops.size() && ops[j].type == ops[i].type) ++j;
+            Clock::time_point start = Clock::now();
+            switch (ops[i].type) {
+            case TraceOp::Insert:
+                for (size_t k = i; k < j; ++k) tree.insert(ops[k].key);
+                break;
+            case TraceOp::Erase:
+                for (size_t k = i; k < j; ++k) tree.erase(ops[k].key);
+                break;
+            case TraceOp::Lookup:
+                for (size_t k = i; k < j; ++k) found += tree.contains(ops[k].key) ? 1 : 0;
+                break;
+            }
+            double elapsed = seconds(start, Clock::now());
+            if (ops[i].type == TraceOp::Lookup) {
+                lookupTime += elapsed;
+                lookups += j - i;
+                // Again through the batch search; outside the total, which
+                // stays comparable with the one-at-a-time path
+                batchKeys.clear();
+                for (size_t k = i; k < j; ++k) batchKeys.push_back(ops[k].key);
+                Clock::time_point batchStart = Clock::now();
+                tree.containsBatch(batchKeys.data(), batchKeys.size(), batchFound);
+                batchTime += seconds(batchStart, Clock::now());
+                begin += Clock::now() - batchStart;
+            } else {
+                insertTime += elapsed;
+                inserts += j - i;
+            }
+            i = j;
+        }
+
+        TuningResult r{};
+        r.t = t;
+        r.totalSeconds = seconds(begin, Clock::now());
+        r.insertOpsPerSec = insertTime > 0.0 ? (double)inserts / insertTime : 0.0;
+        r.lookupOpsPerSec = lookupTime > 0.0 ? (double)lookups / lookupTime : 0.0;
+        r.batchLookupOpsPerSec = batchTime > 0.0 ? (double)lookups / batchTime : 0.0;
+        r.nodeBytes = tree.getStats().nodeBytes;
+        r.height = tree.getStats().height();
+        r.keys = tree.getStats().keys;
+        results.push_back(r);
+
+        size_t keyBytes = (size_t)(2 * t - 1) * sizeof(int);
+        std::printf("[tune] %5d %14.0f %14.0f %14.0f %6.1f%% %10.3f %12.2f %8.1f %6d %11zu\n",
+                    t, r.insertOpsPerSec, r.lookupOpsPerSec, r.batchLookupOpsPerSec,
+                    lookups ? 100.0 * (double)found / (double)lookups : 0.0, r.totalSeconds,
+                    (double)r.nodeBytes / (1024.0 * 1024.0),
+                    r.keys ? (double)r.nodeBytes / (double)r.keys : 0.0, r.height,
+                    (keyBytes + cache.lineSize - 1) / cache.lineSize);
+        std::fflush(stdout);
+    }
+
+    // Fastest over the whole workload; within 3% of it, prefer the leaner tree
+    auto best = std::min_element(results.begin(), results.end(),
+        [](const TuningResult& a, const TuningResult& b) { return a.totalSeconds < b.totalSeconds; });
+    const TuningResult* pick = &*best;
+    for (const auto& r : results) {
+        if (r.totalSeconds <= best->totalSeconds * 1.03 && r.nodeBytes < pick->nodeBytes) pick = &r;
+    }
+    std::printf("[tune] recommended t = %d (%.3f s, %.2f MiB of nodes; max %d keys = %zu B per node)\n",
+                pick->t, pick->totalSeconds, (double)pick->nodeBytes / (1024.0 * 1024.0),
+                2 * pick->t - 1, (size_t)(2 * pick->t - 1) * sizeof(int));
+
+    // The final tree at the recommended t against a frozen snapshot of it,
+    // on every lookup of the workload
+    BTree tree(pick->t);
+    std::vector<int> lookups;
+    Clock::time_point start = Clock::now();
+    for (const TraceOp& op : ops) {
+        if (op.type == TraceOp::Insert) tree.insert(op.key);
+        else if (op.type == TraceOp::Erase) tree.erase(op.key);
+        else lookups.push_back(op.key);
+    }
+    double plainBuild = seconds(start, Clock::now());
+
+    // The same updates with B* inserts, which fill nodes before splitting
+    {
+        BTree star(pick->t);
+        star.setBStar(true);
+        start = Clock::now();
+        for (const TraceOp& op : ops) {
+            if (op.type == TraceOp::Insert) star.insert(op.key);
+            else if (op.type == TraceOp::Erase) star.erase(op.key);
+        }
+        double starBuild = seconds(start, Clock::now());
+        const BTree::Stats& plain = tree.getStats();
+        const BTree::Stats& shared = star.getStats();
+        std::printf("[tune] B* inserts: %.2f MiB of nodes (plain %.2f), height %d (plain %d), fill %.0f%% (plain %.0f%%); "
+                    "updates take %.2fx as long\n",
+                    (double)shared.nodeBytes / (1024.0 * 1024.0), (double)plain.nodeBytes / (1024.0 * 1024.0),
+                    shared.height(), plain.height(), star.fillFactor() * 100.0, tree.fillFactor() * 100.0,
+                    plainBuild > 0.0 ? starBuild / plainBuild : 0.0);
+    }
+    if (lookups.empty()) return 0;
+    start = Clock::now();
+    FrozenBTree frozen = tree.freeze();
+    double freezeTime = seconds(start, Clock::now());
+    size_t liveHits = 0, frozenHits = 0;
+    start = Clock::now();
+    for (int key : lookups) liveHits += tree.contains(key) ? 1 : 0;
+    double liveTime = seconds(start, Clock::now());
+    start = Clock::now();
+    for (int key : lookups) frozenHits += frozen.contains(key) ? 1 : 0;
+    double frozenTime = seconds(start, Clock::now());
+    std::vector<bool> found;
+    start = Clock::now();
+    frozen.containsBatch(lookups.data(), lookups.size(), found);
+    double batchTime = seconds(start, Clock::now());
+    if (liveHits != frozenHits) {
+        std::fprintf(stderr, "tune: frozen snapshot found %zu keys, the live tree %zu\n", frozenHits, liveHits);
+        return 1;
+    }
+    std::printf("[tune] frozen snapshot: built in %.3f s, %.2f MiB; lookups %.0f/s (%.1fx the live tree), batched %.0f/s\n",
+                freezeTime, (double)frozen.memoryBytes() / (1024.0 * 1024.0),
+                frozenTime > 0.0 ? (double)lookups.size() / frozenTime : 0.0,
+                frozenTime > 0.0 ? liveTime / frozenTime : 0.0,
+                batchTime > 0.0 ? (double)lookups.size() / batchTime : 0.0);
+
+    // The same tree again with its leaves packed
+    size_t plainBytes = tree.getStats().nodeBytes;
+    tree.setLeafCompression(true);
+    size_t packedHits = 0;
+    start = Clock::now();
+    for (int key : lookups) packedHits += tree.contains(key) ? 1 : 0;
+    double packedTime = seconds(start, Clock::now());
+    if (packedHits != liveHits) {
+        std::fprintf(stderr, "tune: packed leaves found %zu keys, the plain tree %zu\n", packedHits, liveHits);
+        return 1;
+    }
+    size_t stored = std::max<size_t>(1, tree.getStats().keys);
+    std::printf("[tune] packed leaves: %.1f B/key (plain %.1f B/key); lookups %.0f/s (%.1fx the plain tree)\n",
+                (double)tree.getStats().nodeBytes / stored, (double)plainBytes / stored,
+                packedTime > 0.0 ? (double)lookups.size() / packedTime : 0.0,
+                packedTime > 0.0 ? liveTime / packedTime : 0.0);
+    return 0;
+}
+
+int runBuildBench(const AppOptions& options) {
+    const int t = 16;
+    size_t keys = options.tuneKeys ? options.tuneKeys : (size_t)1 << 24;
+    unsigned maxThreads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+
+    // Random keys with some repeats, as an unsorted dump would have
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<int> dist(0, 1 << 30);
+    std::vector<int> input(keys);
+    std::vector<BTree::Value> values(keys);
+    for (size_t i = 0; i < keys; ++i) {
+        input[i] = dist(rng);
+        values[i] = (BTree::Value)i;
+    }
+    std::printf("[build] %zu random keys, t = %d, up to %u threads\n", keys, t, maxThreads);
+    std::printf("[build] %7s %10s %12s %8s %10s %6s\n", "threads", "seconds", "Mkeys/s", "speedup", "distinct", "height");
+
+    // Baseline: the serial bulk load
+    double serial = 0.0;
+    size_t expectKeys = 0;
+    int expectHeight = 0;
+    {
+        BTree tree(t);
+        std::vector<int> k = input;
+        std::vector<BTree::Value> v = values;
+        Clock::time_point start = Clock::now();
+        tree.bulkLoad(std::move(k), std::move(v));
+        serial = seconds(start, Clock::now());
+        expectKeys = tree.getStats().keys;
+        expectHeight = tree.getStats().height();
+        std::printf("[build] %7s %10.3f %12.2f %8s %10zu %6d\n", "serial", serial,
+                    serial > 0.0 ? (double)keys / serial / 1e6 : 0.0, "", expectKeys, expectHeight);
+        std::fflush(stdout);
+    }
+
+    // Speedup is over the parallel path run on one thread
+    std::vector<unsigned> counts;
+    for (unsigned threads = 1; threads < maxThreads; threads *= 2) counts.push_back(threads);
+    counts.push_back(maxThreads);
+    double single = 0.0;
+    for (unsigned threads : counts) {
+        ThreadPool pool(threads);
+        BTree tree(t);
+        std::vector<int> k = input;
+        std::vector<BTree::Value> v = values;
+        Clock::time_point start = Clock::now();
+        tree.bulkLoad(std::move(k), std::move(v), pool);
+        double elapsed = seconds(start, Clock::now());
+        const BTree::Stats& stats = tree.getStats();
+        if (stats.keys != expectKeys || stats.height() != expectHeight) {
+            std::fprintf(stderr, "build: %u threads built %zu keys of height %d, the serial load %zu of height %d\n",
+                         threads, stats.keys, stats.height(), expectKeys, expectHeight);
+            return 1;
+        }
+        if (threads == 1) single = elapsed;
+        std::printf("[build] %7u %10.3f %12.2f %7.2fx %10zu %6d\n", threads, elapsed,
+                    elapsed > 0.0 ? (double)keys / elapsed / 1e6 : 0.0, elapsed > 0.0 ? single / elapsed : 0.0,
+                    stats.keys, stats.height());
+        std::fflush(stdout);
+    }
+    return 0;
+}
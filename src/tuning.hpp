@@ -0,0 +1,52 @@
+#ifndef TUNING_HPP
+#define TUNING_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "options.hpp"
+#include "trace.hpp"
+
+// Data cache sizes of the host, in bytes. Read from sysfs on Linux, from
+// sysconf where the C library exposes it, otherwise common defaults.
+struct CacheInfo {
+    size_t l1 = 32 * 1024;
+    size_t l2 = 1024 * 1024;
+    size_t llc = 8 * 1024 * 1024;
+    size_t lineSize = 64;
+    bool detected = false;
+};
+
+CacheInfo readCacheInfo();
+
+// Workload shared by the sweeps: the --replay trace if one was given,
+// otherwise `keys` random inserts followed by as many lookups, half of them
+// hits. Says what it loaded, prefixed with tag; false if the trace can't be
+// read.
+bool loadWorkload(const AppOptions& options, size_t keys, const char* tag, std::vector<TraceOp>& ops);
+
+// One row of the sweep
+struct TuningResult {
+    int t;
+    double insertOpsPerSec;
+    double lookupOpsPerSec;
+    double batchLookupOpsPerSec;   // the same lookups through containsBatch
+    double totalSeconds;     // whole workload
+    size_t nodeBytes;        // memory held by nodes and their arrays (BTree::Stats)
+    size_t keys;
+    int height;
+};
+
+// Benchmarks the workload (the --replay trace if given, otherwise random
+// inserts sized past the LLC followed by as many lookups) for a sweep of
+// minimum degrees, prints throughput and memory per t with a recommendation,
+// compares lookups on the recommended tree with a frozen snapshot of it
+// (frozen_btree.hpp), and returns the process exit code.
+int runTuning(const AppOptions& options);
+
+// Times the bulk load of --tune-keys random keys (16M by default) with
+// 1, 2, 4, ... threads up to --threads, printing throughput and speedup
+// over one thread, and returns the process exit code.
+int runBuildBench(const AppOptions& options);
+
+#endif
@@ -0,0 +1,139 @@
+// Build-time generator for the signed distance field glyph atlas.
+//
+// Usage: font_atlas <font.ttf> <out.bin>
+//
+// Renders printable ASCII (plus the few symbols the HUD uses) once, as
+// distance fields, and packs them into a single-channel atlas in the format
+// described by sdf_atlas_format.hpp. The app draws every text size from it
+// with a shader, so nothing is rasterized at startup.
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "sdf_atlas_format.hpp"
+
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "stb_truetype.h"
+
+namespace {
+
+constexpr int BaseSize = 48;        // glyph pixel height in the atlas
+constexpr int SdfPadding = 6;       // distance field reach outside the outline, in pixels
+constexpr unsigned char OnEdge = 128;
+constexpr float PixelDistScale = (float)OnEdge / SdfPadding;
+constexpr int GlyphPadding = 2;     // empty border between glyphs, keeps filtering clean
+constexpr int AtlasWidth = 512;
+
+struct Rendered {
+    sdf_atlas::Glyph glyph;
+    unsigned char* pixels;
+    int w, h;
+};
+
+bool readFile(const char* path, std::vector<unsigned char>& out) {
+    FILE* f = std::fopen(path, "rb");
+    if (!f) return false;
+    std::fseek(f, 0, SEEK_END);
+    long size = std::ftell(f);
+    std::fseek(f, 0, SEEK_SET);
+    out.resize(size > 0 ? (size_t)size : 0);
+    bool ok = size > 0 && std::fread(out.data(), 1, out.size(), f) == out.size();
+    std::fclose(f);
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::fprintf(stderr, "usage: %s <font.ttf> <out.bin>\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<unsigned char> ttf;
+    if (!readFile(argv[1], ttf)) {
+        std::fprintf(stderr, "font_atlas: cannot read %s\n", argv[1]);
+        return 1;
+    }
+    stbtt_fontinfo info;
+    if (!stbtt_InitFont(&info, ttf.data(), stbtt_GetFontOffsetForIndex(ttf.data(), 0))) {
+        std::fprintf(stderr, "font_atlas: %s is not a TrueType font\n", argv[1]);
+        return 1;
+    }
+
+    float scale = stbtt_ScaleForPixelHeight(&info, (float)BaseSize);
+    int ascent = 0, descent = 0, lineGap = 0;
+    stbtt_GetFontVMetrics(&info, &ascent, &descent, &lineGap);
+
+    std::vector<int> codepoints;
+    for (int c = 32; c < 127; ++c) codepoints.push_back(c);
+    codepoints.push_back(0x2022); // bullet, used in the input prompt
+
+    // Render each glyph and shelf-pack it, left to right in rows
+    std::vector<Rendered> glyphs;
+    int x = GlyphPadding, y = GlyphPadding, rowHeight = 0;
+    for (int cp : codepoints) {
+        Rendered r{};
+        int xoff = 0, yoff = 0;
+        r.pixels = stbtt_GetCodepointSDF(&info, scale, cp, SdfPadding, OnEdge, PixelDistScale,
+                                         &r.w, &r.h, &xoff, &yoff);
+        if (!r.pixels) r.w = r.h = 0; // blank glyph such as the space
+
+        int advance = 0, lsb = 0;
+        stbtt_GetCodepointHMetrics(&info, cp, &advance, &lsb);
+        r.glyph.codepoint = cp;
+        r.glyph.offsetX = xoff;
+        r.glyph.offsetY = yoff + (int)((float)ascent * scale);
+        r.glyph.advanceX = (int)((float)advance * scale);
+
+        if (x + r.w + GlyphPadding > AtlasWidth) {
+            x = GlyphPadding;
+            y += rowHeight + 2 * GlyphPadding;
+            rowHeight = 0;
+        }
+        r.glyph.x = (float)x;
+        r.glyph.y = (float)y;
+        r.glyph.width = (float)r.w;
+        r.glyph.height = (float)r.h;
+        x += r.w + 2 * GlyphPadding;
+        if (r.h > rowHeight) rowHeight = r.h;
+        glyphs.push_back(r);
+    }
+
+    // Power-of-two height so WebGL 1 can sample it without restrictions
+    int used = y + rowHeight + GlyphPadding;
+    int height = 1;
+    while (height < used) height <<= 1;
+
+    std::vector<unsigned char> atlas((size_t)AtlasWidth * height, 0);
+    for (const Rendered& r : glyphs) {
+        for (int row = 0; row < r.h; ++row) {
+            unsigned char* dst = &atlas[((size_t)r.glyph.y + row) * AtlasWidth + (size_t)r.glyph.x];
+            for (int col = 0; col < r.w; ++col) dst[col] = r.pixels[row * r.w + col];
+        }
+        if (r.pixels) stbtt_FreeSDF(r.pixels, nullptr);
+    }
+
+    sdf_atlas::Header header{};
+    header.magic = sdf_atlas::Magic;
+    header.baseSize = BaseSize;
+    header.glyphCount = (int32_t)glyphs.size();
+    header.glyphPadding = GlyphPadding;
+    header.width = AtlasWidth;
+    header.height = height;
+
+    FILE* out = std::fopen(argv[2], "wb");
+    if (!out) {
+        std::fprintf(stderr, "font_atlas: cannot write %s\n", argv[2]);
+        return 1;
+    }
+    bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1;
+    for (const Rendered& r : glyphs) ok = ok && std::fwrite(&r.glyph, sizeof(r.glyph), 1, out) == 1;
+    ok = ok && std::fwrite(atlas.data(), 1, atlas.size(), out) == atlas.size();
+    ok = std::fclose(out) == 0 && ok;
+    if (!ok) {
+        std::fprintf(stderr, "font_atlas: failed writing %s\n", argv[2]);
+        return 1;
+    }
+    return 0;
+}